@@ -8,6 +8,7 @@
 #include <ethash/hash_types.h>
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -45,12 +46,80 @@ struct ethash_epoch_context
 struct ethash_epoch_context_full;
 
 
+/**
+ * The kind of the memory block requested from an allocator.
+ */
+enum ethash_memory_kind
+{
+    /** The block containing the context header and the light cache. */
+    ETHASH_MEMORY_LIGHT_CACHE = 0,
+
+    /** The block for the full dataset. */
+    ETHASH_MEMORY_FULL_DATASET = 1,
+};
+
+/**
+ * The allocator for epoch context memory.
+ *
+ * The alloc function receives the requested size, the required alignment (a power of 2,
+ * at least the size of a pointer) and the kind of the block. It returns a pointer to
+ * zero-initialized memory or null in case of allocation failure. Only the full dataset
+ * block is required to be zero-initialized, the light cache block is fully overwritten.
+ *
+ * The free function receives the pointer previously returned by alloc together with
+ * the same size and kind.
+ */
+struct ethash_allocator
+{
+    void* (*alloc)(void* user_data, size_t size, size_t alignment, enum ethash_memory_kind kind);
+    void (*free)(void* user_data, void* ptr, size_t size, enum ethash_memory_kind kind);
+    void* user_data;
+};
+
+
 struct ethash_result
 {
     union ethash_hash256 final_hash;
     union ethash_hash256 mix_hash;
 };
 
+/**
+ * The result of the search for the first nonce meeting the boundary, see ethash_search().
+ */
+struct ethash_search_result
+{
+    /** The solution has been found, the other fields are set only then. */
+    bool solution_found;
+    uint64_t nonce;
+    union ethash_hash256 final_hash;
+    union ethash_hash256 mix_hash;
+};
+
+/**
+ * The nonce meeting the share boundary found by ethash_search_shares().
+ */
+struct ethash_share
+{
+    uint64_t nonce;
+    union ethash_hash256 final_hash;
+    union ethash_hash256 mix_hash;
+
+    /** The final hash also meets the block boundary. */
+    bool block_solution;
+};
+
+/**
+ * The seal verified by ethash_verify_batch().
+ */
+struct ethash_verification_request
+{
+    int block_number;
+    union ethash_hash256 header_hash;
+    union ethash_hash256 mix_hash;
+    uint64_t nonce;
+    union ethash_hash256 boundary;
+};
+
 
 /**
  * Calculates the number of items in the light cache for given epoch.
@@ -83,6 +152,17 @@ int ethash_calculate_full_dataset_num_items(int epoch_number) NOEXCEPT;
 union ethash_hash256 ethash_calculate_epoch_seed(int epoch_number) NOEXCEPT;
 
 
+/**
+ * Sets the allocator used by ethash_create_epoch_context() and ethash_create_epoch_context_full().
+ *
+ * The allocator is copied into every context created afterwards so the context is freed
+ * with the same allocator it has been allocated with. The allocator object itself must stay
+ * valid until replaced.
+ *
+ * @param allocator  The allocator or null to restore the default one.
+ */
+void ethash_set_global_allocator(const struct ethash_allocator* allocator) NOEXCEPT;
+
 struct ethash_epoch_context* ethash_create_epoch_context(int epoch_number) NOEXCEPT;
 
 /**
@@ -98,6 +178,39 @@ struct ethash_epoch_context* ethash_create_epoch_context(int epoch_number) NOEXC
  */
 struct ethash_epoch_context_full* ethash_create_epoch_context_full(int epoch_number) NOEXCEPT;
 
+/**
+ * Creates the epoch context with the full dataset generated on demand by page faults.
+ *
+ * This is available on Linux only. The full dataset memory is reserved without committing it
+ * and registered with userfaultfd. Background threads generate the items of a memory page when
+ * it is accessed for the first time, so the hash functions read the full dataset without
+ * checking if items have been generated and never touched pages are never allocated.
+ * Only the light cache is obtained from the global allocator.
+ *
+ * If userfaultfd is not available, this is equivalent to ethash_create_epoch_context_full().
+ *
+ * The memory allocated in the context MUST be freed with ethash_destroy_epoch_context_full().
+ *
+ * @param epoch_number  The epoch number.
+ * @return  Pointer to the context or null in case of memory allocation failure.
+ */
+struct ethash_epoch_context_full* ethash_create_epoch_context_full_on_demand(
+    int epoch_number) NOEXCEPT;
+
+/**
+ * Creates the epoch context using the given allocator instead of the global one.
+ * The null allocator is the default one, see ethash_set_global_allocator().
+ */
+struct ethash_epoch_context* ethash_create_epoch_context_with_allocator(
+    int epoch_number, const struct ethash_allocator* allocator) NOEXCEPT;
+
+/**
+ * Creates the epoch context with the full dataset using the given allocator instead of
+ * the global one. The null allocator is the default one.
+ */
+struct ethash_epoch_context_full* ethash_create_epoch_context_full_with_allocator(
+    int epoch_number, const struct ethash_allocator* allocator) NOEXCEPT;
+
 void ethash_destroy_epoch_context(struct ethash_epoch_context* context) NOEXCEPT;
 
 void ethash_destroy_epoch_context_full(struct ethash_epoch_context_full* context) NOEXCEPT;
@@ -114,10 +227,175 @@ const struct ethash_epoch_context* ethash_get_global_epoch_context(int epoch_num
 const struct ethash_epoch_context_full* ethash_get_global_epoch_context_full(
     int epoch_number) NOEXCEPT;
 
+/**
+ * The handle of the acquired global shared epoch context,
+ * see ethash_acquire_global_epoch_context().
+ */
+struct ethash_epoch_context_handle
+{
+    /** The context, null in case of memory allocation failure. */
+    const struct ethash_epoch_context* context;
+
+    /** The internal state, to be passed back to ethash_release_global_epoch_context(). */
+    void* internal;
+};
+
+/**
+ * The handle of the acquired global shared epoch context with full dataset,
+ * see ethash_acquire_global_epoch_context_full().
+ */
+struct ethash_epoch_context_full_handle
+{
+    /** The context, null in case of memory allocation failure. */
+    const struct ethash_epoch_context_full* context;
+
+    /** The internal state, to be passed back to ethash_release_global_epoch_context_full(). */
+    void* internal;
+};
+
+/**
+ * Acquires the global shared epoch context.
+ *
+ * The context stays allocated until the handle is released, also when it is evicted from
+ * the global contexts in the meantime. Acquiring the context of a resident epoch takes no lock,
+ * so many threads can acquire contexts concurrently, also of a new epoch once it is built.
+ * The context of a new epoch is built by the first thread requesting it, the other threads
+ * requesting the same epoch wait for this build. The handle may be released by any thread.
+ */
+struct ethash_epoch_context_handle ethash_acquire_global_epoch_context(int epoch_number) NOEXCEPT;
+
+/**
+ * Acquires the global shared epoch context with full dataset initialized.
+ * See ethash_acquire_global_epoch_context().
+ */
+struct ethash_epoch_context_full_handle ethash_acquire_global_epoch_context_full(
+    int epoch_number) NOEXCEPT;
+
+/**
+ * Starts building the global shared epoch context in the background, e.g. of the next epoch.
+ *
+ * The context is built by the library's threads, the contexts of different epochs in parallel.
+ * The later requests for the epoch wait for this build instead of starting another one.
+ * The prepared context does not evict the resident contexts, the capacity is exceeded by one
+ * until the prepared context is acquired, when the least recently used context is evicted,
+ * or until the next context is built. It does not become the most recently used context until
+ * it is acquired, so it is the first one evicted if it is not used.
+ *
+ * @return  False if the build cannot be scheduled, e.g. out of memory.
+ */
+bool ethash_prepare_global_epoch_context(int epoch_number) NOEXCEPT;
+
+/**
+ * Starts building the global shared epoch context with full dataset in the background.
+ * See ethash_prepare_global_epoch_context().
+ */
+bool ethash_prepare_global_epoch_context_full(int epoch_number) NOEXCEPT;
+
+/**
+ * Releases the handle of the global shared epoch context. The null context handle is ignored.
+ */
+void ethash_release_global_epoch_context(struct ethash_epoch_context_handle handle) NOEXCEPT;
+
+/**
+ * Releases the handle of the global shared epoch context with full dataset.
+ * See ethash_release_global_epoch_context().
+ */
+void ethash_release_global_epoch_context_full(
+    struct ethash_epoch_context_full_handle handle) NOEXCEPT;
+
+/**
+ * Sets the maximum number of the global shared epoch contexts kept in memory.
+ *
+ * The global contexts of the recently used epochs are kept so switching between them,
+ * e.g. when verifying blocks around an epoch boundary, does not rebuild them. The least recently
+ * used contexts above the capacity are released, but stay allocated until no thread uses them
+ * and no handle refers to them.
+ *
+ * @param capacity  The number of the contexts, at least 1. The default is 2.
+ */
+void ethash_set_global_epoch_context_capacity(size_t capacity) NOEXCEPT;
+
+/**
+ * Sets the maximum number of the global shared epoch contexts with full dataset kept in memory.
+ * See ethash_set_global_epoch_context_capacity().
+ *
+ * @param capacity  The number of the contexts, at least 1. The default is 1.
+ */
+void ethash_set_global_epoch_context_full_capacity(size_t capacity) NOEXCEPT;
+
+/**
+ * Gets the epoch numbers of the global shared epoch contexts kept in memory.
+ *
+ * @param epoch_numbers  The output array for the epoch numbers, from the most recently used.
+ * @param capacity       The capacity of the output array.
+ * @return               The number of the contexts, may be greater than the capacity.
+ */
+size_t ethash_get_global_epoch_contexts(int epoch_numbers[], size_t capacity) NOEXCEPT;
+
+/**
+ * Gets the epoch numbers of the global shared epoch contexts with full dataset kept in memory.
+ * See ethash_get_global_epoch_contexts().
+ */
+size_t ethash_get_global_epoch_contexts_full(int epoch_numbers[], size_t capacity) NOEXCEPT;
+
 
 struct ethash_result ethash_hash(const struct ethash_epoch_context* context,
     const union ethash_hash256* header_hash, uint64_t nonce) NOEXCEPT;
 
+struct ethash_result ethash_hash_full(const struct ethash_epoch_context_full* context,
+    const union ethash_hash256* header_hash, uint64_t nonce) NOEXCEPT;
+
+/**
+ * Computes the hashes of many nonces with the light cache in one call.
+ *
+ * The hash i of the header_hashes[i] and the nonces[i] is stored in results[i].
+ * Multiple hashes are computed in lock-step with their full dataset items computed interleaved.
+ */
+void ethash_hash_batch(const struct ethash_epoch_context* context,
+    const union ethash_hash256 header_hashes[], const uint64_t nonces[], size_t num_hashes,
+    struct ethash_result results[]) NOEXCEPT;
+
+/**
+ * Computes the hashes of many nonces with the full dataset in one call.
+ * See ethash_hash_batch(), here the full dataset loads of multiple hashes are interleaved.
+ */
+void ethash_hash_full_batch(const struct ethash_epoch_context_full* context,
+    const union ethash_hash256 header_hashes[], const uint64_t nonces[], size_t num_hashes,
+    struct ethash_result results[]) NOEXCEPT;
+
+/**
+ * Searches the nonce range for the first nonce with the final hash meeting the boundary
+ * using the light cache.
+ *
+ * @param result  The output for the result of the search.
+ */
+void ethash_search_light(const struct ethash_epoch_context* context,
+    const union ethash_hash256* header_hash, const union ethash_hash256* boundary,
+    uint64_t start_nonce, size_t iterations, struct ethash_search_result* result) NOEXCEPT;
+
+/**
+ * Searches the nonce range for the first nonce with the final hash meeting the boundary
+ * using the full dataset. See ethash_search_light().
+ */
+void ethash_search(const struct ethash_epoch_context_full* context,
+    const union ethash_hash256* header_hash, const union ethash_hash256* boundary,
+    uint64_t start_nonce, size_t iterations, struct ethash_search_result* result) NOEXCEPT;
+
+/**
+ * Searches the nonce range for all the shares using the full dataset.
+ *
+ * The nonces with the final hash meeting the share boundary are stored in the nonce order,
+ * flagged if they also meet the block boundary. The search stops when the output array is full.
+ *
+ * @param shares    The output array for the shares.
+ * @param capacity  The capacity of the output array.
+ * @return          The number of shares stored.
+ */
+size_t ethash_search_shares(const struct ethash_epoch_context_full* context,
+    const union ethash_hash256* header_hash, const union ethash_hash256* share_boundary,
+    const union ethash_hash256* block_boundary, uint64_t start_nonce, size_t iterations,
+    struct ethash_share shares[], size_t capacity) NOEXCEPT;
+
 bool ethash_verify(const struct ethash_epoch_context* context,
     const union ethash_hash256* header_hash, const union ethash_hash256* mix_hash, uint64_t nonce,
     const union ethash_hash256* boundary) NOEXCEPT;
@@ -126,6 +404,47 @@ bool ethash_verify_final_hash(const union ethash_hash256* header_hash,
     const union ethash_hash256* mix_hash, uint64_t nonce,
     const union ethash_hash256* boundary) NOEXCEPT;
 
+/**
+ * Verifies the seal against the block difficulty instead of the boundary.
+ *
+ * The difficulty is the 256-bit big-endian number. The final hash meets the difficulty
+ * if final_hash <= 2^256 / difficulty, this is checked without the division.
+ * Every hash meets the difficulty 0.
+ */
+bool ethash_verify_against_difficulty(const struct ethash_epoch_context* context,
+    const union ethash_hash256* header_hash, const union ethash_hash256* mix_hash, uint64_t nonce,
+    const union ethash_hash256* difficulty) NOEXCEPT;
+
+bool ethash_verify_final_hash_against_difficulty(const union ethash_hash256* header_hash,
+    const union ethash_hash256* mix_hash, uint64_t nonce,
+    const union ethash_hash256* difficulty) NOEXCEPT;
+
+/**
+ * Verifies the seal of the RLP-encoded block header against the difficulty from the header.
+ *
+ * The mix hash and the nonce are located in the header and the seal hash is computed from
+ * the header bytes directly, without re-encoding the header.
+ *
+ * @param block_number  The number of the block. The header is invalid if it has another number
+ *                      or the block is not in the epoch of the context.
+ * @return  False if the seal is invalid or the header is malformed.
+ */
+bool ethash_verify_header_rlp(const struct ethash_epoch_context* context, int block_number,
+    const uint8_t* header, size_t header_size) NOEXCEPT;
+
+/**
+ * Verifies the seals of many block headers or shares in one call using multiple threads.
+ *
+ * The seals are verified with the global shared epoch contexts of their blocks,
+ * see ethash_get_global_epoch_context().
+ *
+ * @param results  The output array, results[i] is set if the seal i is valid.
+ * @return         False if the verification failed, e.g. out of memory or a thread could
+ *                 not be started. All the results are then unset.
+ */
+bool ethash_verify_batch(const struct ethash_verification_request requests[],
+    size_t num_requests, bool results[]) NOEXCEPT;
+
 #ifdef __cplusplus
 }
 #endif
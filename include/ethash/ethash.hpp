@@ -17,9 +17,11 @@
 #include <ethash/ethash.h>
 #include <ethash/hash_types.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <vector>
 
 namespace ethash
 {
@@ -35,6 +37,8 @@ using epoch_context_full = ethash_epoch_context_full;
 
 using result = ethash_result;
 
+using allocator = ethash_allocator;
+
 /// Constructs a 256-bit hash from an array of bytes.
 ///
 /// @param bytes  A pointer to array of at least 32 bytes.
@@ -119,6 +123,29 @@ inline epoch_context_full_ptr create_epoch_context_full(int epoch_number) noexce
     return {ethash_create_epoch_context_full(epoch_number), ethash_destroy_epoch_context_full};
 }
 
+/// Creates Ethash epoch context with the full dataset generated on page faults.
+///
+/// See ethash_create_epoch_context_full_on_demand().
+inline epoch_context_full_ptr create_epoch_context_full_on_demand(int epoch_number) noexcept
+{
+    return {ethash_create_epoch_context_full_on_demand(epoch_number),
+        ethash_destroy_epoch_context_full};
+}
+
+/// Creates Ethash epoch context with the memory provided by the given allocator.
+inline epoch_context_ptr create_epoch_context(int epoch_number, const allocator& a) noexcept
+{
+    return {ethash_create_epoch_context_with_allocator(epoch_number, &a),
+        ethash_destroy_epoch_context};
+}
+
+inline epoch_context_full_ptr create_epoch_context_full(
+    int epoch_number, const allocator& a) noexcept
+{
+    return {ethash_create_epoch_context_full_with_allocator(epoch_number, &a),
+        ethash_destroy_epoch_context_full};
+}
+
 
 inline result hash(
     const epoch_context& context, const hash256& header_hash, uint64_t nonce) noexcept
@@ -140,12 +167,193 @@ inline bool verify(const epoch_context& context, const hash256& header_hash, con
     return ethash_verify(&context, &header_hash, &mix_hash, nonce, &boundary);
 }
 
+/// Returns the boundary 2^256 / difficulty, the maximum boundary for the difficulty 0 or 1.
+///
+/// The recent conversions are cached by every thread.
+hash256 get_boundary_from_difficulty(const hash256& difficulty) noexcept;
+
+/// Checks if the final hash meets the difficulty, i.e. final_hash <= 2^256 / difficulty.
+///
+/// The check multiplies final_hash * difficulty instead of dividing.
+bool check_against_difficulty(const hash256& final_hash, const hash256& difficulty) noexcept;
+
+inline bool verify_final_hash_against_difficulty(const hash256& header_hash,
+    const hash256& mix_hash, uint64_t nonce, const hash256& difficulty) noexcept
+{
+    return ethash_verify_final_hash_against_difficulty(&header_hash, &mix_hash, nonce, &difficulty);
+}
+
+inline bool verify_against_difficulty(const epoch_context& context, const hash256& header_hash,
+    const hash256& mix_hash, uint64_t nonce, const hash256& difficulty) noexcept
+{
+    return ethash_verify_against_difficulty(&context, &header_hash, &mix_hash, nonce, &difficulty);
+}
+
+inline bool verify_header_rlp(const epoch_context& context, int block_number,
+    const uint8_t* header, size_t header_size) noexcept
+{
+    return ethash_verify_header_rlp(&context, block_number, header, header_size);
+}
+
 search_result search_light(const epoch_context& context, const hash256& header_hash,
     const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept;
 
 search_result search(const epoch_context_full& context, const hash256& header_hash,
     const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept;
 
+/// The nonce meeting the share boundary found by search_shares().
+using share = ethash_share;
+
+/// Searches the nonce range for all the shares.
+///
+/// The shares, i.e. the nonces with the final hash meeting the share boundary,
+/// are recorded in the nonce order together with the flag whether they meet the block boundary
+/// as well. The search sweeps through all the nonces unless the output array is full.
+///
+/// @param shares    The output array for the shares.
+/// @param capacity  The capacity of the output array.
+/// @return          The number of shares stored. If this equals the capacity the search
+///                  has stopped at the nonce of the last share.
+size_t search_shares(const epoch_context_full& context, const hash256& header_hash,
+    const hash256& share_boundary, const hash256& block_boundary, uint64_t start_nonce,
+    size_t iterations, share* shares, size_t capacity) noexcept;
+
+/// Searches the nonce range for all the shares using the light cache. See search_shares().
+size_t search_light_shares(const epoch_context& context, const hash256& header_hash,
+    const hash256& share_boundary, const hash256& block_boundary, uint64_t start_nonce,
+    size_t iterations, share* shares, size_t capacity) noexcept;
+
+/// The result of the multithreaded search.
+struct parallel_search_result
+{
+    /// The solution found. If multiple threads have found solutions, this is the first one
+    /// reported, not necessarily the one with the lowest nonce.
+    search_result solution;
+
+    /// The number of nonces hashed by each of the threads.
+    std::vector<uint64_t> hash_counts;
+};
+
+/// Searches the nonce range using multiple threads.
+///
+/// The range is split evenly between the threads. Each thread takes nonces from the front
+/// of its part in chunks sized to take about a millisecond. A thread which exhausted its part
+/// steals the upper half of the largest remaining part of another thread. All threads stop
+/// after finishing their current chunks once any thread has found a solution.
+///
+/// The threads are taken from the thread pool owned by the library. Concurrent calls
+/// share the pool threads.
+///
+/// @param num_threads  The number of threads, 0 means the number of hardware threads.
+///                     Limited by the number of hardware threads.
+parallel_search_result search_parallel(const epoch_context_full& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads = 0);
+
+/// Searches the nonce range using multiple threads and the light cache.
+///
+/// See search_parallel().
+parallel_search_result search_light_parallel(const epoch_context& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads = 0);
+
+/// The outcome of the preemptible search.
+enum class search_status
+{
+    /// All the nonces have been hashed and no solution has been found.
+    exhausted,
+
+    /// The solution has been found.
+    solution_found,
+
+    /// The search has been stopped because the job generation has changed.
+    preempted,
+};
+
+/// The result of the preemptible search.
+struct preemptible_search_result
+{
+    search_status status = search_status::exhausted;
+
+    /// The solution, valid only if the status is search_status::solution_found.
+    search_result solution;
+
+    /// The number of nonces hashed. The search of the same job can be continued
+    /// from start_nonce + num_hashes.
+    uint64_t num_hashes = 0;
+};
+
+/// Searches the nonce range until a solution is found, the range is exhausted
+/// or the job is replaced.
+///
+/// The shared job generation counter is checked before every batch of 8 nonces in the full
+/// dataset search and before every nonce in the light cache search. The search is preempted
+/// as soon as the counter differs from the generation of the searched job. The thread pushing
+/// a new job increments the counter, the same can be done to stop the search.
+///
+/// @param generation      The shared job generation counter.
+/// @param job_generation  The generation of the job being searched.
+preemptible_search_result search_preemptible(const epoch_context_full& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept;
+
+/// Searches the nonce range with the light cache until a solution is found, the range is
+/// exhausted or the job is replaced. See search_preemptible().
+preemptible_search_result search_light_preemptible(const epoch_context& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept;
+
+
+/// The seal of a block header or a share to be verified by verify_batch().
+using verification_request = ethash_verification_request;
+
+/// Verifies the seals of many block headers or shares using multiple threads.
+///
+/// The final hashes of all the seals are checked against the boundaries first. The remaining
+/// seals are grouped by epoch and their mix hashes are computed with the global shared epoch
+/// contexts, see get_global_epoch_context(). Multiple seals are hashed in lock-step with their
+/// full dataset items computed interleaved. The work is split between the threads of the
+/// library-owned thread pool, concurrent calls share the pool threads. The thread-local
+/// context of get_global_epoch_context() is not changed.
+///
+/// @return  The bitmap of the results, the bit i is set if the seal i is valid.
+/// @throws  std::bad_alloc if an epoch context cannot be built.
+std::vector<bool> verify_batch(const verification_request requests[], size_t num_requests);
+
+
+/// The snapshot of the library telemetry counters.
+///
+/// The counters are summed over all threads since the library has been loaded, so the rates
+/// are obtained from the differences of two snapshots. The full dataset items are counted
+/// in 1024-bit units, the ProgPoW 2048-bit item counts as two.
+struct telemetry_snapshot
+{
+    /// False if the library has been built without ETHASH_TELEMETRY, all counters are 0 then.
+    bool enabled = false;
+
+    /// The number of Ethash and ProgPoW hashes computed, including verification.
+    uint64_t num_hashes = 0;
+
+    /// The number of full dataset items generated on first access.
+    uint64_t dataset_items_generated = 0;
+
+    /// The number of full dataset accesses served by already generated items.
+    uint64_t dataset_items_cached = 0;
+
+    /// The number of full dataset items computed from the light cache by the light hashing
+    /// and the verification.
+    uint64_t light_items_computed = 0;
+
+    /// The number of bytes read from the full dataset.
+    uint64_t dataset_bytes_read() const noexcept
+    {
+        return (dataset_items_generated + dataset_items_cached) * sizeof(hash1024);
+    }
+};
+
+/// Returns the current values of the telemetry counters.
+telemetry_snapshot get_telemetry() noexcept;
+
 
 /// Tries to find the epoch number matching the given seed hash.
 ///
@@ -169,4 +377,46 @@ inline const epoch_context_full& get_global_epoch_context_full(int epoch_number)
 {
     return *ethash_get_global_epoch_context_full(epoch_number);
 }
+
+/// Alias for ethash_acquire_global_epoch_context().
+static constexpr auto acquire_global_epoch_context = ethash_acquire_global_epoch_context;
+
+/// Alias for ethash_acquire_global_epoch_context_full().
+static constexpr auto acquire_global_epoch_context_full =
+    ethash_acquire_global_epoch_context_full;
+
+/// Alias for ethash_prepare_global_epoch_context().
+static constexpr auto prepare_global_epoch_context = ethash_prepare_global_epoch_context;
+
+/// Alias for ethash_prepare_global_epoch_context_full().
+static constexpr auto prepare_global_epoch_context_full =
+    ethash_prepare_global_epoch_context_full;
+
+/// Alias for ethash_release_global_epoch_context().
+static constexpr auto release_global_epoch_context = ethash_release_global_epoch_context;
+
+/// Alias for ethash_release_global_epoch_context_full().
+static constexpr auto release_global_epoch_context_full =
+    ethash_release_global_epoch_context_full;
+
+/// Alias for ethash_set_global_epoch_context_capacity().
+static constexpr auto set_global_epoch_context_capacity =
+    ethash_set_global_epoch_context_capacity;
+
+/// Alias for ethash_set_global_epoch_context_full_capacity().
+static constexpr auto set_global_epoch_context_full_capacity =
+    ethash_set_global_epoch_context_full_capacity;
+
+/// Returns the epoch numbers of the global shared epoch contexts kept in memory,
+/// from the most recently used. See ethash_get_global_epoch_contexts().
+inline std::vector<int> get_global_epoch_contexts()
+{
+    std::vector<int> epoch_numbers(2);
+    size_t n;
+    while ((n = ethash_get_global_epoch_contexts(epoch_numbers.data(), epoch_numbers.size())) >
+           epoch_numbers.size())
+        epoch_numbers.resize(n);
+    epoch_numbers.resize(n);
+    return epoch_numbers;
+}
 }  // namespace ethash
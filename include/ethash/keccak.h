@@ -34,6 +34,24 @@ union ethash_hash256 ethash_keccak256_32(const uint8_t data[32]) NOEXCEPT;
 union ethash_hash512 ethash_keccak512(const uint8_t* data, size_t size) NOEXCEPT;
 union ethash_hash512 ethash_keccak512_64(const uint8_t data[64]) NOEXCEPT;
 
+/**
+ * The state of the incremental Keccak-256 hashing.
+ *
+ * The data may be passed in any number of pieces of any sizes, without buffering.
+ */
+struct ethash_keccak256_context
+{
+    uint64_t state[25];
+
+    /** The number of bytes absorbed into the current block. */
+    size_t offset;
+};
+
+void ethash_keccak256_init(struct ethash_keccak256_context* context) NOEXCEPT;
+void ethash_keccak256_update(
+    struct ethash_keccak256_context* context, const uint8_t* data, size_t size) NOEXCEPT;
+union ethash_hash256 ethash_keccak256_final(struct ethash_keccak256_context* context) NOEXCEPT;
+
 #ifdef __cplusplus
 }
 #endif
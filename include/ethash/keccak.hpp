@@ -29,6 +29,23 @@ inline hash512 keccak512(const hash512& input) noexcept
     return ethash_keccak512_64(input.bytes);
 }
 
+/// The incremental Keccak-256 hashing.
+class keccak256_hasher
+{
+public:
+    keccak256_hasher() noexcept { ethash_keccak256_init(&context); }
+
+    void update(const uint8_t* data, size_t size) noexcept
+    {
+        ethash_keccak256_update(&context, data, size);
+    }
+
+    hash256 final() noexcept { return ethash_keccak256_final(&context); }
+
+private:
+    ethash_keccak256_context context;
+};
+
 static constexpr auto keccak256_32 = ethash_keccak256_32;
 static constexpr auto keccak512_64 = ethash_keccak512_64;
 
@@ -0,0 +1,79 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+///
+/// Merkle commitment to the full dataset
+///
+/// The full node builds the Merkle tree over all items of the full dataset of an epoch
+/// and publishes the root. For every (header hash, nonce) pair it can then produce
+/// a proof consisting of the dataset items accessed by the Ethash main loop together with
+/// their Merkle branches. The proof is verified against the epoch root without
+/// building the light cache.
+///
+/// The leaves of the tree are Keccak-256 hashes of the 128-byte full dataset items.
+/// An inner node is the Keccak-256 hash of the concatenation of its two children.
+/// If a level has odd number of nodes, the last node is paired with the zero hash.
+
+#pragma once
+
+#include <ethash/ethash.hpp>
+
+#include <vector>
+
+namespace ethash
+{
+/// The Merkle tree built over the full dataset items.
+struct dataset_merkle_tree
+{
+    /// The number of leaves, i.e. the number of full dataset items.
+    int num_items = 0;
+
+    /// The nodes of all levels, starting with the leaves and ending with the root.
+    std::vector<hash256> nodes;
+
+    /// The offsets of the levels in the nodes array.
+    std::vector<size_t> level_offsets;
+
+    /// The root of the tree. The tree must not be empty.
+    const hash256& root() const noexcept { return nodes.back(); }
+};
+
+/// The proof of the Ethash computation for a single nonce.
+struct dataset_proof
+{
+    /// The full dataset items in the order they are accessed by the Ethash main loop.
+    hash1024 items[num_dataset_accesses];
+
+    /// The Merkle branches of the items. For every item there are
+    /// get_dataset_merkle_depth() sibling hashes ordered from the leaf level up.
+    std::vector<hash256> branches;
+};
+
+/// Returns the number of levels above the leaves in the Merkle tree over given number of items.
+int get_dataset_merkle_depth(int num_items) noexcept;
+
+/// Builds the Merkle tree over the full dataset.
+///
+/// The missing full dataset items are generated and stored in the context.
+/// The work is split across the given number of threads, 0 means the number of hardware threads.
+dataset_merkle_tree build_dataset_merkle_tree(
+    const epoch_context_full& context, unsigned num_threads = 0);
+
+/// Creates the proof for the Ethash computation of given header hash and nonce.
+dataset_proof create_dataset_proof(const epoch_context_full& context,
+    const dataset_merkle_tree& tree, const hash256& header_hash, uint64_t nonce);
+
+/// Verifies the Ethash work using the proof instead of an epoch context.
+///
+/// @param root                    The Merkle root of the full dataset of the epoch.
+/// @param full_dataset_num_items  The number of items in the full dataset of the epoch,
+///                                see calculate_full_dataset_num_items().
+/// @return  True if the items match the root and the recomputed Ethash result matches
+///          the mix hash and the boundary. False if the number of items is not the number
+///          of the full dataset items of any epoch.
+bool verify_dataset_proof(const hash256& root, int full_dataset_num_items,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce, const hash256& boundary,
+    const dataset_proof& proof) noexcept;
+}  // namespace ethash
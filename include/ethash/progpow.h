@@ -0,0 +1,93 @@
+/* ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+ * Copyright 2018-2019 Pawel Bylica.
+ * Licensed under the Apache License, Version 2.0.
+ */
+
+/**
+ * @file
+ *
+ * ProgPoW C API
+ *
+ * The C API of the default ProgPoW revision, see progpow.hpp. The epoch contexts
+ * and the result types are shared with the Ethash C API.
+ */
+
+#pragma once
+
+#include <ethash/ethash.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ethash_result ethash_progpow_hash(const struct ethash_epoch_context* context,
+    int block_number, const union ethash_hash256* header_hash, uint64_t nonce) NOEXCEPT;
+
+struct ethash_result ethash_progpow_hash_full(const struct ethash_epoch_context_full* context,
+    int block_number, const union ethash_hash256* header_hash, uint64_t nonce) NOEXCEPT;
+
+/**
+ * Computes the hashes of many nonces with the light cache in one call.
+ *
+ * The hash i of the block_numbers[i], the header_hashes[i] and the nonces[i] is stored in
+ * results[i]. The blocks must be in the epoch of the context. Multiple hashes are computed
+ * in lock-step with their full dataset items computed interleaved.
+ */
+void ethash_progpow_hash_batch(const struct ethash_epoch_context* context,
+    const int block_numbers[], const union ethash_hash256 header_hashes[], const uint64_t nonces[],
+    size_t num_hashes, struct ethash_result results[]) NOEXCEPT;
+
+/**
+ * Computes the hashes of many nonces with the full dataset in one call.
+ * See ethash_progpow_hash_batch(), here the full dataset loads of multiple hashes of the same
+ * period are interleaved.
+ */
+void ethash_progpow_hash_full_batch(const struct ethash_epoch_context_full* context,
+    const int block_numbers[], const union ethash_hash256 header_hashes[], const uint64_t nonces[],
+    size_t num_hashes, struct ethash_result results[]) NOEXCEPT;
+
+bool ethash_progpow_verify(const struct ethash_epoch_context* context, int block_number,
+    const union ethash_hash256* header_hash, const union ethash_hash256* mix_hash, uint64_t nonce,
+    const union ethash_hash256* boundary) NOEXCEPT;
+
+/**
+ * Verifies the seal against the block difficulty, see ethash_verify_against_difficulty().
+ */
+bool ethash_progpow_verify_against_difficulty(const struct ethash_epoch_context* context,
+    int block_number, const union ethash_hash256* header_hash, const union ethash_hash256* mix_hash,
+    uint64_t nonce, const union ethash_hash256* difficulty) NOEXCEPT;
+
+/**
+ * Verifies the seals of many block headers or shares in one call using multiple threads,
+ * see ethash_verify_batch().
+ */
+bool ethash_progpow_verify_batch(const struct ethash_verification_request requests[],
+    size_t num_requests, bool results[]) NOEXCEPT;
+
+/**
+ * Searches the nonce range using the light cache, see ethash_search_light().
+ */
+void ethash_progpow_search_light(const struct ethash_epoch_context* context, int block_number,
+    const union ethash_hash256* header_hash, const union ethash_hash256* boundary,
+    uint64_t start_nonce, size_t iterations, struct ethash_search_result* result) NOEXCEPT;
+
+/**
+ * Searches the nonce range using the full dataset, see ethash_search().
+ */
+void ethash_progpow_search(const struct ethash_epoch_context_full* context, int block_number,
+    const union ethash_hash256* header_hash, const union ethash_hash256* boundary,
+    uint64_t start_nonce, size_t iterations, struct ethash_search_result* result) NOEXCEPT;
+
+/**
+ * Searches the nonce range for all the shares using the full dataset,
+ * see ethash_search_shares().
+ */
+size_t ethash_progpow_search_shares(const struct ethash_epoch_context_full* context,
+    int block_number, const union ethash_hash256* header_hash,
+    const union ethash_hash256* share_boundary, const union ethash_hash256* block_boundary,
+    uint64_t start_nonce, size_t iterations, struct ethash_share shares[],
+    size_t capacity) NOEXCEPT;
+
+#ifdef __cplusplus
+}
+#endif
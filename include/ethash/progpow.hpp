@@ -11,6 +11,7 @@
 #pragma once
 
 #include <ethash/ethash.hpp>
+#include <ethash/progpow.h>
 
 namespace progpow
 {
@@ -21,11 +22,32 @@ using namespace ethash;  // Include ethash namespace.
 /// https://github.com/ifdefelse/ProgPOW#change-history.
 constexpr auto revision = "0.9.3";
 
-constexpr int period_length = 10;
+/// The parameters of a ProgPoW revision.
+///
+/// The published revisions differ in the number of blocks of a program period and
+/// the numbers of the cache accesses and the math operations of a round. The numbers of
+/// the lanes and the registers and the L1 cache size are the same in all of them.
+template <int PeriodLength, int NumCacheAccesses, int NumMathOperations>
+struct revision_params
+{
+    static constexpr int period_length = PeriodLength;
+    static constexpr int num_cache_accesses = NumCacheAccesses;
+    static constexpr int num_math_operations = NumMathOperations;
+};
+
+/// The revision 0.9.2.
+using revision_0_9_2 = revision_params<50, 12, 20>;
+
+/// The revision 0.9.3, the default one.
+using revision_0_9_3 = revision_params<10, 11, 18>;
+
+using default_revision = revision_0_9_3;
+
+constexpr int period_length = default_revision::period_length;
 constexpr uint32_t num_regs = 32;
 constexpr size_t num_lanes = 16;
-constexpr int num_cache_accesses = 11;
-constexpr int num_math_operations = 18;
+constexpr int num_cache_accesses = default_revision::num_cache_accesses;
+constexpr int num_math_operations = default_revision::num_math_operations;
 constexpr size_t l1_cache_size = 16 * 1024;
 constexpr size_t l1_cache_num_items = l1_cache_size / sizeof(uint32_t);
 
@@ -38,12 +60,102 @@ result hash(const epoch_context_full& context, int block_number, const hash256&
 bool verify(const epoch_context& context, int block_number, const hash256& header_hash,
     const hash256& mix_hash, uint64_t nonce, const hash256& boundary) noexcept;
 
+/// Verifies the seal against the block difficulty, see ethash::verify_against_difficulty().
+bool verify_against_difficulty(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,
+    const hash256& difficulty) noexcept;
+
+/// Verifies the seal of the RLP-encoded block header, see ethash::verify_header_rlp().
+bool verify_header_rlp(const epoch_context& context, int block_number, const uint8_t* header,
+    size_t header_size) noexcept;
+
+/// Verifies the seals of many block headers or shares using multiple threads,
+/// see ethash::verify_batch().
+std::vector<bool> verify_batch(const verification_request requests[], size_t num_requests);
+
+search_result search_light(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations) noexcept;
+
+search_result search(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations) noexcept;
+
+/// Searches the nonce range for all the shares, see ethash::search_shares().
+size_t search_shares(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept;
+
+/// Searches the nonce range for all the shares using the light cache,
+/// see ethash::search_shares().
+size_t search_light_shares(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept;
+
+/// The functions of the given revision, e.g. progpow::hash<progpow::revision_0_9_2>().
+///
+/// The functions without the revision template argument use the default revision.
+/// Instantiated for revision_0_9_2 and revision_0_9_3.
+/// @{
+template <typename Revision>
+result hash(const epoch_context& context, int block_number, const hash256& header_hash,
+    uint64_t nonce) noexcept;
+
+template <typename Revision>
+result hash(const epoch_context_full& context, int block_number, const hash256& header_hash,
+    uint64_t nonce) noexcept;
+
+template <typename Revision>
+bool verify(const epoch_context& context, int block_number, const hash256& header_hash,
+    const hash256& mix_hash, uint64_t nonce, const hash256& boundary) noexcept;
+
+template <typename Revision>
+bool verify_against_difficulty(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,
+    const hash256& difficulty) noexcept;
+
+template <typename Revision>
 search_result search_light(const epoch_context& context, int block_number,
     const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
     size_t iterations) noexcept;
 
+template <typename Revision>
 search_result search(const epoch_context_full& context, int block_number,
     const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
     size_t iterations) noexcept;
 
+template <typename Revision>
+size_t search_shares(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept;
+
+template <typename Revision>
+size_t search_light_shares(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept;
+/// @}
+
+/// Searches the nonce range using multiple threads, see ethash::search_parallel().
+parallel_search_result search_parallel(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads = 0);
+
+/// Searches the nonce range using multiple threads and the light cache,
+/// see ethash::search_parallel().
+parallel_search_result search_light_parallel(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads = 0);
+
+/// Searches the nonce range until a solution is found, the range is exhausted
+/// or the job is replaced, see ethash::search_preemptible().
+preemptible_search_result search_preemptible(const epoch_context_full& context,
+    int block_number, const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations, const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept;
+
+/// Searches the nonce range with the light cache until a solution is found, the range is
+/// exhausted or the job is replaced, see ethash::search_preemptible().
+preemptible_search_result search_light_preemptible(const epoch_context& context,
+    int block_number, const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations, const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept;
+
 }  // namespace progpow
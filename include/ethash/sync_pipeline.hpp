@@ -0,0 +1,184 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+///
+/// The verification pipeline for the historical sync
+///
+/// Long header ranges span many epochs. Verifying them with the global epoch context stalls
+/// all verifier threads at every epoch boundary while the next context is being built.
+/// The pipeline builds the contexts of the upcoming epochs in the background while the worker
+/// threads verify the seals of the epochs already built, and returns the results in the order
+/// the seals have been submitted.
+
+#pragma once
+
+#include <ethash/ethash.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ethash
+{
+struct sync_pipeline_options
+{
+    /// Verify ProgPoW seals instead of Ethash seals.
+    bool progpow = false;
+
+    /// The maximum number of epoch contexts in memory, including the ones being built.
+    /// At least 2 allows building the next context while verifying the current epoch.
+    size_t max_resident_contexts = 2;
+
+    /// The number of threads building the contexts.
+    unsigned num_build_threads = 1;
+
+    /// The number of threads verifying the seals, 0 means the hardware concurrency.
+    unsigned num_verify_threads = 0;
+
+    /// The maximum number of submitted seals with the results not taken yet.
+    size_t max_pending = 4096;
+};
+
+/// The result of the seal verification returned by sync_pipeline::pop().
+struct sync_result
+{
+    verification_request request;
+    bool valid;
+
+    /// The seal has not been verified because the context of its epoch could not be built,
+    /// e.g. because of the memory allocation failure. The valid is false then.
+    bool error;
+};
+
+/// The multithreaded verifier of the stream of seals.
+///
+/// The seals are submitted with push() and their results taken with pop() in the same order.
+/// The contexts of the epochs of the submitted seals are built ahead in submission order,
+/// as long as the number of the resident contexts allows. A context is released once all
+/// its submitted seals are verified and its slot is needed for another epoch.
+///
+/// If a context cannot be built, the seals of its epoch are reported with the error
+/// while the failed context stays resident. The build is retried for the seals of the epoch
+/// submitted after the failed context has been released.
+class sync_pipeline
+{
+public:
+    /// The counters of the pipeline.
+    struct stats
+    {
+        /// The number of the contexts built.
+        uint64_t contexts_built = 0;
+
+        /// The maximum number of the contexts in memory at the same time.
+        size_t peak_resident_contexts = 0;
+
+        /// The number of the context builds that have failed.
+        uint64_t build_failures = 0;
+    };
+
+    explicit sync_pipeline(const sync_pipeline_options& options);
+
+    /// Waits for the seals being verified, the seals not verified yet are discarded.
+    ~sync_pipeline();
+
+    sync_pipeline(const sync_pipeline&) = delete;
+    sync_pipeline& operator=(const sync_pipeline&) = delete;
+
+    /// Submits the seal for verification.
+    ///
+    /// Waits while max_pending results are not taken, so the results must be taken
+    /// by another thread or try_push() used instead.
+    void push(const verification_request& request);
+
+    /// Submits the seal for verification unless max_pending results are not taken.
+    ///
+    /// @return  False if the seal has not been submitted.
+    bool try_push(const verification_request& request);
+
+    /// Marks the end of the stream, no more seals are submitted.
+    void close();
+
+    /// Takes the result of the next seal in the submission order, waiting for it.
+    ///
+    /// @return  False if the pipeline is closed and all the results have been taken.
+    bool pop(sync_result& out);
+
+    /// Returns the pipeline counters.
+    stats get_stats() const;
+
+private:
+    struct entry
+    {
+        verification_request request;
+        int epoch_number;
+        bool claimed;
+        bool done;
+        bool valid;
+        bool error;
+    };
+
+    struct resident_context
+    {
+        int epoch_number;
+
+        /// The context, null while being built or if the build has failed.
+        std::shared_ptr<const epoch_context> context;
+
+        bool building;
+    };
+
+    /// Stops and joins the threads.
+    void stop() noexcept;
+
+    // The helpers below require the mutex to be locked.
+
+    bool can_push() const noexcept;
+    void push_locked(const verification_request& request);
+    resident_context* find_context(int epoch_number) noexcept;
+
+    /// Selects the first epoch of the unclaimed seals without a context and reserves
+    /// the context slot for it, evicting a context without unverified seals if needed.
+    ///
+    /// @return  False if there is no such epoch or no slot can be reserved now.
+    bool reserve_context(int& epoch_number) noexcept;
+
+    /// Claims up to verification_chunk_size unclaimed seals of the same epoch
+    /// with the context built.
+    ///
+    /// @return  The number of the claimed seals.
+    size_t claim(entry* claimed[], const epoch_context*& context) noexcept;
+
+    /// The body of the context building threads.
+    void build() noexcept;
+
+    /// The body of the verifier threads.
+    void verify() noexcept;
+
+    const sync_pipeline_options options;
+
+    mutable std::mutex mutex;
+    std::condition_variable build_needed;
+    std::condition_variable work_available;
+    std::condition_variable result_ready;
+    std::condition_variable space_available;
+
+    /// The submitted seals with the results not taken yet, in submission order.
+    std::deque<entry> entries;
+
+    /// The index in entries of the first seal not claimed by a verifier thread.
+    size_t first_unclaimed = 0;
+
+    std::vector<resident_context> contexts;
+
+    stats counters;
+    bool closed = false;
+    bool stopping = false;
+
+    std::vector<std::thread> threads;
+};
+}  // namespace ethash
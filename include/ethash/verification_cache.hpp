@@ -0,0 +1,115 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+///
+/// The cache of verification outcomes
+///
+/// The same block or share often reaches a node many times. The cache remembers whether
+/// the mix hash of a seal is correct, keyed by the epoch number (the ProgPoW period for ProgPoW),
+/// the header hash, the nonce and the mix hash. The final hash is checked against the boundary
+/// on every call as this is cheap and the boundaries of the same seal may differ.
+///
+/// Concurrent verifications of the same seal are deduplicated: the first one computes
+/// the outcome, the others wait for it.
+
+#pragma once
+
+#include <ethash/ethash.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace ethash
+{
+/// The bounded concurrent cache of verification outcomes.
+///
+/// The entries are split between shards by the key hash. Every shard has its own lock
+/// and evicts the oldest entries when full.
+class verification_cache
+{
+public:
+    /// The counters of the cache lookups.
+    struct stats
+    {
+        /// The number of lookups finding the outcome, including the waits for the outcome
+        /// being computed by another thread.
+        uint64_t hits = 0;
+
+        /// The number of outcomes computed.
+        uint64_t misses = 0;
+    };
+
+    /// Creates the cache storing at most capacity outcomes.
+    explicit verification_cache(size_t capacity);
+
+    ~verification_cache();
+
+    verification_cache(const verification_cache&) = delete;
+    verification_cache& operator=(const verification_cache&) = delete;
+
+    /// The cached ethash::verify().
+    bool verify(const epoch_context& context, const hash256& header_hash,
+        const hash256& mix_hash, uint64_t nonce, const hash256& boundary);
+
+    /// The cached progpow::verify().
+    bool verify_progpow(const epoch_context& context, int block_number,
+        const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,
+        const hash256& boundary);
+
+    /// The cached ethash::verify_batch().
+    ///
+    /// Only the seals not in the cache and not being verified by other threads are passed
+    /// to the batch verifier.
+    std::vector<bool> verify_batch(const verification_request requests[], size_t num_requests);
+
+    /// The cached progpow::verify_batch(), see verify_batch().
+    std::vector<bool> verify_batch_progpow(
+        const verification_request requests[], size_t num_requests);
+
+    /// Returns the number of cached outcomes.
+    size_t size() const noexcept;
+
+    /// Returns the lookup counters.
+    stats get_stats() const noexcept;
+
+private:
+    struct key;
+    struct shard;
+    class claim_guard;
+
+    /// The result of the lookup.
+    enum class status
+    {
+        valid,
+        invalid,
+        claimed,  ///< The outcome is missing, the caller computes it and calls publish().
+        pending,  ///< The outcome is being computed by another call.
+    };
+
+    /// Looks up the outcome and claims the key if it is missing. If wait is true,
+    /// waits for the pending outcome instead of returning status::pending.
+    status lookup(const key& k, bool wait);
+
+    /// Stores the outcome of the claimed key and wakes up the waiting calls.
+    void publish(const key& k, bool valid);
+
+    /// Removes the claim of the key without an outcome, the waiting calls claim it again.
+    void release(const key& k) noexcept;
+
+    template <typename Algorithm>
+    bool verify_seal(const epoch_context& context, const verification_request& request);
+
+    template <typename Algorithm>
+    std::vector<bool> verify_seals(const verification_request requests[], size_t num_requests);
+
+    size_t num_shards = 0;
+    size_t shard_capacity = 0;
+    std::unique_ptr<shard[]> shards;
+
+    std::atomic<uint64_t> num_hits{0};
+    std::atomic<uint64_t> num_misses{0};
+};
+}  // namespace ethash
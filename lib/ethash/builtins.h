@@ -36,6 +36,18 @@ inline int __builtin_popcount(unsigned int x)
     return (int)__popcnt(x);
 }
 
+/**
+ * Prefetches the cache line containing `addr` into all levels of the cache hierarchy.
+ */
+inline void __builtin_prefetch(const void* addr)
+{
+#if defined(_M_X64) || defined(_M_IX86)
+    _mm_prefetch((const char*)addr, _MM_HINT_T0);
+#else
+    (void)addr;
+#endif
+}
+
 #ifdef __cplusplus
 }
 #endif
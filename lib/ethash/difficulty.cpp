@@ -0,0 +1,83 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The verification against the block difficulty instead of the boundary.
+
+#include "ethash-internal.hpp"
+#include "uint256.hpp"
+
+namespace ethash
+{
+namespace
+{
+/// The number of the recent difficulty to boundary conversions remembered by every thread.
+/// Miners and pools work with only a few difficulties at a time.
+constexpr size_t boundary_cache_size = 4;
+
+struct boundary_cache_entry
+{
+    hash256 difficulty;
+    hash256 boundary;
+};
+
+/// The entries are valid only for difficulties > 1 as the zero-initialized entries map
+/// the difficulty 0 to the boundary 0.
+thread_local boundary_cache_entry boundary_cache[boundary_cache_size];
+thread_local size_t boundary_cache_next = 0;
+
+/// Returns true if the difficulty is 0 or 1, then every hash meets it.
+inline bool is_trivial_difficulty(const uint256& d) noexcept
+{
+    return (d.words[1] | d.words[2] | d.words[3]) == 0 && d.words[0] <= 1;
+}
+
+hash256 calculate_boundary(const uint256& difficulty) noexcept
+{
+    // 2^256 does not fit 256 bits, but for d > 1: 2^256 / d = (2^256 - d) / d + 1.
+    uint256 numerator;
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        numerator.words[i] = 0 - difficulty.words[i] - borrow;
+        borrow = difficulty.words[i] != 0 || borrow != 0;
+    }
+
+    uint256 q = udivrem(numerator, difficulty).quot;
+    for (size_t i = 0; i < 4 && ++q.words[i] == 0; ++i)
+    {
+    }
+    return uint256_to_be(q);
+}
+}  // namespace
+
+hash256 get_boundary_from_difficulty(const hash256& difficulty) noexcept
+{
+    const uint256 d = uint256_from_be(difficulty);
+    if (is_trivial_difficulty(d))
+    {
+        hash256 max;
+        std::memset(max.bytes, 0xff, sizeof(max));
+        return max;
+    }
+
+    for (const auto& entry : boundary_cache)
+    {
+        if (is_equal(entry.difficulty, difficulty))
+            return entry.boundary;
+    }
+
+    auto& entry = boundary_cache[boundary_cache_next];
+    boundary_cache_next = (boundary_cache_next + 1) % boundary_cache_size;
+    entry.difficulty = difficulty;
+    entry.boundary = calculate_boundary(d);
+    return entry.boundary;
+}
+
+bool check_against_difficulty(const hash256& final_hash, const hash256& difficulty) noexcept
+{
+    const uint256 d = uint256_from_be(difficulty);
+    return is_zero(d) || is_product_at_most_2pow256(uint256_from_be(final_hash), d);
+}
+}  // namespace ethash
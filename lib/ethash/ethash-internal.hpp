@@ -10,25 +10,54 @@
 
 #include <ethash/ethash.hpp>
 
+#include "bit_manipulation.h"
 #include "endianness.hpp"
+#include "simd.hpp"
+#include "telemetry.hpp"
+#include <ethash/keccak.hpp>
 
+#include <cstring>
 #include <memory>
+#include <new>
+#include <string>
 #include <vector>
 
+namespace ethash
+{
+struct dataset_pager;
+}
+
 extern "C" struct ethash_epoch_context_full : ethash_epoch_context
 {
     ethash_hash1024* full_dataset;
 
+    /// The allocator the context memory has been obtained from.
+    const ethash_allocator allocator;
+
+    /// The userfaultfd handler generating the full dataset pages on first access.
+    /// If not null, all full dataset items can be read directly without checking if
+    /// they have been generated.
+    ethash::dataset_pager* full_dataset_pager = nullptr;
+
     constexpr ethash_epoch_context_full(int epoch, int light_num_items,
         const ethash_hash512* light, const uint32_t* l1, int dataset_num_items,
-        ethash_hash1024* dataset) noexcept
+        ethash_hash1024* dataset, const ethash_allocator& alloc) noexcept
       : ethash_epoch_context{epoch, light_num_items, light, l1, dataset_num_items},
-        full_dataset{dataset}
+        full_dataset{dataset},
+        allocator{alloc}
     {}
 };
 
 namespace ethash
 {
+/// The alignment of the light cache and the full dataset memory blocks.
+constexpr size_t memory_alignment = 4096;
+
+/// The size of the context header placed in front of the light cache.
+/// Rounded up to the light cache item size so the light cache items are cache line aligned.
+constexpr size_t context_header_size =
+    (sizeof(ethash_epoch_context_full) + sizeof(hash512) - 1) / sizeof(hash512) * sizeof(hash512);
+
 inline bool is_less_or_equal(const hash256& a, const hash256& b) noexcept
 {
     for (size_t i = 0; i < (sizeof(a) / sizeof(a.word64s[0])); ++i)
@@ -48,10 +77,119 @@ inline bool is_equal(const hash256& a, const hash256& b) noexcept
 
 void build_light_cache(hash512 cache[], int num_items, const hash256& seed) noexcept;
 
+inline hash512 hash_seed(const hash256& header_hash, uint64_t nonce) noexcept
+{
+    nonce = le::uint64(nonce);
+    uint8_t init_data[sizeof(header_hash) + sizeof(nonce)];
+    std::memcpy(&init_data[0], &header_hash, sizeof(header_hash));
+    std::memcpy(&init_data[sizeof(header_hash)], &nonce, sizeof(nonce));
+
+    return keccak512(init_data, sizeof(init_data));
+}
+
+inline hash256 hash_final(const hash512& seed, const hash256& mix_hash)
+{
+    uint8_t final_data[sizeof(seed) + sizeof(mix_hash)];
+    std::memcpy(&final_data[0], seed.bytes, sizeof(seed));
+    std::memcpy(&final_data[sizeof(seed)], mix_hash.bytes, sizeof(mix_hash));
+    return keccak256(final_data, sizeof(final_data));
+}
+
+/// Reduces the 1024-bit mix to the 256-bit mix hash.
+template <typename Isa = isa::generic>
+inline ALWAYS_INLINE hash256 reduce_mix(const hash1024& mix) noexcept
+{
+    return le::uint32s(fnv1_reduce(Isa{}, mix));
+}
+
+/// The Ethash main loop computing the mix hash.
+///
+/// The full dataset items are obtained by calling lookup(index). This allows to run
+/// the same loop on the light cache, on the full dataset and on items coming from outside,
+/// e.g. with a Merkle proof. The lookup is a compile-time policy: it is inlined into
+/// the loop and may return a reference to the item to avoid copying it.
+///
+/// @tparam Isa       The instruction set of the FNV mixing, see simd.hpp.
+/// @param num_items  The number of items in the full dataset.
+/// @param seed       The seed hash computed by hash_seed().
+/// @param lookup     The function returning the full dataset item of given index,
+///                   by value or by reference.
+template <typename Isa = isa::generic, typename Lookup>
+inline ALWAYS_INLINE hash256 hash_kernel(
+    uint32_t num_items, const hash512& seed, Lookup&& lookup) noexcept
+{
+    static constexpr size_t num_words = sizeof(hash1024) / sizeof(uint32_t);
+    const uint32_t seed_init = le::uint32(seed.word32s[0]);
+
+    hash1024 mix{{le::uint32s(seed), le::uint32s(seed)}};
+
+    for (uint32_t i = 0; i < num_dataset_accesses; ++i)
+    {
+        const uint32_t p = fnv1(i ^ seed_init, mix.word32s[i % num_words]) % num_items;
+        const auto& item = lookup(p);
+        fnv1_mix(Isa{}, mix, le::uint32s(item));
+    }
+
+    telemetry::add(telemetry::hashes, 1);
+    return reduce_mix<Isa>(mix);
+}
+
+/// Checks if the number of items is the number of the full dataset items of any epoch,
+/// see ethash_calculate_full_dataset_num_items().
+bool is_full_dataset_num_items(int num_items) noexcept;
+
+struct dataset_proof;
+
+/// Verifies the Ethash work using the proof, see verify_dataset_proof(), for any positive
+/// number of the full dataset items. Allows the tests to use small mocked datasets.
+bool verify_dataset_proof_any_size(const hash256& root, int full_dataset_num_items,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce, const hash256& boundary,
+    const dataset_proof& proof) noexcept;
+
 hash512 calculate_dataset_item_512(const epoch_context& context, int64_t index) noexcept;
 hash1024 calculate_dataset_item_1024(const epoch_context& context, uint32_t index) noexcept;
 hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t index) noexcept;
 
+/// Calculates the 2048-bit full dataset items of the given indexes.
+///
+/// The computations of multiple items are interleaved to keep more light cache loads in flight.
+void calculate_dataset_items_2048(const epoch_context& context, const uint32_t indexes[],
+    hash2048 items[], size_t num_items) noexcept;
+
+/// The global shared epoch context acquired for the lifetime of the object,
+/// see ethash_acquire_global_epoch_context().
+///
+/// Unlike get_global_epoch_context() it does not replace the context of the calling thread,
+/// so the references the caller holds stay valid.
+class scoped_global_epoch_context
+{
+public:
+    /// Acquires the context, throws std::bad_alloc if it cannot be built.
+    explicit scoped_global_epoch_context(int epoch_number)
+      : handle{ethash_acquire_global_epoch_context(epoch_number)}
+    {
+        if (handle.context == nullptr)
+            throw std::bad_alloc{};
+    }
+
+    ~scoped_global_epoch_context() { ethash_release_global_epoch_context(handle); }
+
+    scoped_global_epoch_context(const scoped_global_epoch_context&) = delete;
+    scoped_global_epoch_context& operator=(const scoped_global_epoch_context&) = delete;
+
+    const epoch_context& get() const noexcept { return *handle.context; }
+
+private:
+    const ethash_epoch_context_handle handle;
+};
+
+/// Computes the Ethash mix hashes of the seeds with the light cache.
+///
+/// Multiple seeds are processed in lock-step with their full dataset items
+/// computed interleaved.
+void hash_mix_light_batch(const epoch_context& context, const hash512 seeds[],
+    hash256 mix_hashes[], size_t num_hashes) noexcept;
+
 namespace generic
 {
 using hash_fn_512 = hash512 (*)(const uint8_t* data, size_t size);
@@ -60,9 +198,111 @@ using build_light_cache_fn = void (*)(hash512 cache[], int num_items, const hash
 void build_light_cache(
     hash_fn_512 hash_fn, hash512 cache[], int num_items, const hash256& seed) noexcept;
 
-epoch_context_full* create_epoch_context(
-    build_light_cache_fn build_fn, int epoch_number, bool full) noexcept;
+epoch_context_full* create_epoch_context(build_light_cache_fn build_fn, int epoch_number,
+    bool full, const ethash_allocator& allocator) noexcept;
+
+/// Creates the full context with the full dataset generated on page faults.
+///
+/// Returns null if userfaultfd is not available, the caller should fall back to
+/// create_epoch_context() then. In case of memory allocation failure, the out_of_memory flag
+/// is set.
+epoch_context_full* create_epoch_context_on_demand(build_light_cache_fn build_fn,
+    int epoch_number, const ethash_allocator& allocator, bool& out_of_memory) noexcept;
 
 }  // namespace generic
 
+/// The instruction sets the hot functions can be compiled for.
+///
+/// These are the x86-64 micro-architecture levels: v2 adds SSE4.2 and POPCNT,
+/// v3 adds AVX2, BMI2, FMA and LZCNT, v4 adds AVX-512.
+enum class instruction_set
+{
+    generic,
+    x86_64_v2,
+    x86_64_v3,
+    x86_64_v4,
+};
+
+/// Returns the best instruction set supported by the CPU.
+instruction_set detect_instruction_set() noexcept;
+
+/// Returns the instruction set of the hot functions currently in use.
+///
+/// The instruction set returned by detect_instruction_set() is selected when the library
+/// is loaded.
+instruction_set get_instruction_set() noexcept;
+
+/// Returns the comma-separated CPU features the kernels of the instruction set are compiled
+/// for, as in their target attribute. Empty for the generic instruction set.
+const char* get_target_features(instruction_set set) noexcept;
+
+/// Checks if the CPU supports the feature named as in the target attributes.
+///
+/// @param known  Set to false if the feature is not known to the check, it is not supported
+///               then.
+bool is_cpu_feature_supported(const std::string& name, bool& known) noexcept;
+
+/// Switches the hot functions to the given instruction set. Not thread-safe, for testing only.
+///
+/// @return  False if the CPU does not support the instruction set; nothing is changed then.
+bool set_instruction_set(instruction_set set) noexcept;
+
+/// Stops the page fault handler and releases the full dataset memory of the on-demand context.
+void destroy_dataset_pager(dataset_pager* pager) noexcept;
+
+/// The fields of the RLP-encoded block header needed to verify its seal.
+struct header_seal
+{
+    /// The Keccak-256 of the header without the mix hash and the nonce,
+    /// the header_hash argument of verify().
+    hash256 seal_hash;
+    hash256 mix_hash;
+    uint64_t nonce;
+    hash256 difficulty;
+    uint64_t number;
+};
+
+/// Decodes the seal of the RLP-encoded block header.
+///
+/// @return  False if the header is malformed.
+bool decode_header_seal(const uint8_t* header, size_t header_size, header_seal& seal) noexcept;
+
 }  // namespace ethash
+
+namespace progpow
+{
+/// A variant of Keccak hash function for ProgPoW.
+///
+/// This Keccak hash function uses 800-bit permutation (Keccak-f[800]) with 576 bitrate.
+/// It take exactly 576 bits of input (split across 3 arguments) and adds no padding.
+///
+/// @param header_hash  The 256-bit header hash.
+/// @param nonce        The 64-bit nonce.
+/// @param mix_hash     Additional 256-bits of data.
+/// @return             The 256-bit output of the hash function.
+ethash::hash256 keccak_progpow_256(
+    const ethash::hash256& header_hash, uint64_t nonce, const ethash::hash256& mix_hash) noexcept;
+
+/// The same as keccak_progpow_256() but uses null mix
+/// and returns top 64 bits of the output being a big-endian prefix of the 256-bit hash.
+uint64_t keccak_progpow_64(const ethash::hash256& header_hash, uint64_t nonce) noexcept;
+
+/// Switches the ProgPoW hot functions to the given instruction set,
+/// called by ethash::set_instruction_set().
+void select_kernels(ethash::instruction_set set) noexcept;
+
+/// Enables or disables the JIT compiled ProgPoW rounds in place of the scalar interpreter,
+/// enabled by default where available. Safe to call concurrently with hashing, the calls in
+/// progress may still use the previous setting.
+///
+/// @return  False if the JIT compiler is not available for the platform or the CPU.
+bool set_jit_enabled(bool enabled) noexcept;
+
+/// Computes the ProgPoW mix hashes of the seeds with the light cache.
+///
+/// Multiple seeds are processed in lock-step with their full dataset items computed interleaved,
+/// see ethash::calculate_dataset_items_2048(). The block numbers may differ but must be
+/// of the same epoch.
+void hash_mix_light_batch(const ethash::epoch_context& context, const int block_numbers[],
+    const uint64_t seeds[], ethash::hash256 mix_hashes[], size_t num_hashes) noexcept;
+}  // namespace progpow
@@ -6,16 +6,24 @@
 
 #include "../support/attributes.h"
 #include "bit_manipulation.h"
+#include "builtins.h"
 #include "endianness.hpp"
 #include "primes.h"
+#include "telemetry.hpp"
 #include <ethash/keccak.hpp>
 #include <ethash/progpow.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
 
+#if ETHASH_X86_64_SIMD
+#include <cpuid.h>
+#endif
+
 namespace ethash
 {
 // Internal constants:
@@ -33,26 +41,25 @@ static_assert(light_cache_item_size == ETHASH_LIGHT_CACHE_ITEM_SIZE, "");
 static_assert(full_dataset_item_size == ETHASH_FULL_DATASET_ITEM_SIZE, "");
 
 
-namespace
+bool is_full_dataset_num_items(int num_items) noexcept
 {
-using ::fnv1;
+    static constexpr int item_size = sizeof(hash1024);
+    static constexpr int num_items_init = full_dataset_init_size / item_size;
+    static constexpr int num_items_growth = full_dataset_growth / item_size;
 
-inline hash512 fnv1(const hash512& u, const hash512& v) noexcept
-{
-    hash512 r;
-    for (size_t i = 0; i < sizeof(r) / sizeof(r.word32s[0]); ++i)
-        r.word32s[i] = fnv1(u.word32s[i], v.word32s[i]);
-    return r;
-}
+    if (num_items <= 0)
+        return false;
 
-inline hash512 bitwise_xor(const hash512& x, const hash512& y) noexcept
-{
-    hash512 z;
-    for (size_t i = 0; i < sizeof(z) / sizeof(z.word64s[0]); ++i)
-        z.word64s[i] = x.word64s[i] ^ y.word64s[i];
-    return z;
+    // The number of items is the largest prime not above the upper bound of the epoch,
+    // the gaps between primes are much smaller than the growth, so the epoch is the first one
+    // with the upper bound not below the number of items.
+    int epoch_number = 0;
+    if (num_items > num_items_init)
+        epoch_number = (num_items - num_items_init - 1) / num_items_growth + 1;
+    if (epoch_number > (std::numeric_limits<int>::max() - num_items_init) / num_items_growth)
+        return false;
+    return ethash_calculate_full_dataset_num_items(epoch_number) == num_items;
 }
-}  // namespace
 
 int find_epoch_number(const hash256& seed) noexcept
 {
@@ -96,10 +103,42 @@ int find_epoch_number(const hash256& seed) noexcept
     return -1;
 }
 
+namespace
+{
+NO_SANITIZE("unsigned-integer-overflow")
+void* default_alloc(void*, size_t size, size_t alignment, ethash_memory_kind) noexcept
+{
+    // Over-allocate to make room for the alignment adjustment and the original pointer,
+    // which is stored in the word directly preceding the aligned block.
+    if (size > std::numeric_limits<size_t>::max() - alignment)
+        return nullptr;
+
+    char* const base = static_cast<char*>(std::calloc(1, size + alignment));
+    if (!base)
+        return nullptr;
+
+    const auto aligned_addr = (reinterpret_cast<uintptr_t>(base) + alignment) & ~(alignment - 1);
+    char* const aligned = base + (aligned_addr - reinterpret_cast<uintptr_t>(base));
+    reinterpret_cast<void**>(aligned)[-1] = base;
+    return aligned;
+}
+
+void default_free(void*, void* ptr, size_t, ethash_memory_kind) noexcept
+{
+    if (ptr)
+        std::free(reinterpret_cast<void**>(ptr)[-1]);
+}
+
+constexpr ethash_allocator default_allocator{default_alloc, default_free, nullptr};
+
+std::atomic<const ethash_allocator*> global_allocator{&default_allocator};
+}  // namespace
+
 namespace generic
 {
-void build_light_cache(
-    hash_fn_512 hash_fn, hash512 cache[], int num_items, const hash256& seed) noexcept
+template <typename Isa>
+inline ALWAYS_INLINE void build_light_cache(
+    Isa, hash_fn_512 hash_fn, hash512 cache[], int num_items, const hash256& seed) noexcept
 {
     hash512 item = hash_fn(seed.bytes, sizeof(seed));
     cache[0] = item;
@@ -122,39 +161,56 @@ void build_light_cache(
             // Second index.
             const uint32_t w = static_cast<uint32_t>(num_items + (i - 1)) % index_limit;
 
-            const hash512 x = bitwise_xor(cache[v], cache[w]);
+            const hash512 x = bitwise_xor(Isa{}, cache[v], cache[w]);
             cache[i] = hash_fn(x.bytes, sizeof(x));
         }
     }
 }
 
-epoch_context_full* create_epoch_context(
-    build_light_cache_fn build_fn, int epoch_number, bool full) noexcept
+void build_light_cache(
+    hash_fn_512 hash_fn, hash512 cache[], int num_items, const hash256& seed) noexcept
 {
-    static_assert(sizeof(epoch_context_full) < sizeof(hash512), "epoch_context too big");
-    static constexpr size_t context_alloc_size = sizeof(hash512);
+    build_light_cache(isa::generic{}, hash_fn, cache, num_items, seed);
+}
 
+epoch_context_full* create_epoch_context(build_light_cache_fn build_fn, int epoch_number,
+    bool full, const ethash_allocator& allocator) noexcept
+{
     const int light_cache_num_items = calculate_light_cache_num_items(epoch_number);
     const int full_dataset_num_items = calculate_full_dataset_num_items(epoch_number);
     const size_t light_cache_size = get_light_cache_size(light_cache_num_items);
-    const size_t full_dataset_size =
-        full ? static_cast<size_t>(full_dataset_num_items) * sizeof(hash1024) :
-               progpow::l1_cache_size;
+    const size_t full_dataset_size = static_cast<size_t>(full_dataset_num_items) * sizeof(hash1024);
 
-    const size_t alloc_size = context_alloc_size + light_cache_size + full_dataset_size;
+    // The light context keeps the ProgPoW L1 cache right after the light cache.
+    // In the full context the L1 cache is the beginning of the full dataset.
+    const size_t light_alloc_size =
+        context_header_size + light_cache_size + (full ? 0 : progpow::l1_cache_size);
 
-    char* const alloc_data = static_cast<char*>(std::calloc(1, alloc_size));
+    char* const alloc_data = static_cast<char*>(allocator.alloc(
+        allocator.user_data, light_alloc_size, memory_alignment, ETHASH_MEMORY_LIGHT_CACHE));
     if (!alloc_data)
         return nullptr;  // Signal out-of-memory by returning null pointer.
 
-    hash512* const light_cache = reinterpret_cast<hash512*>(alloc_data + context_alloc_size);
+    hash1024* full_dataset = nullptr;
+    if (full)
+    {
+        full_dataset = static_cast<hash1024*>(allocator.alloc(
+            allocator.user_data, full_dataset_size, memory_alignment, ETHASH_MEMORY_FULL_DATASET));
+        if (!full_dataset)
+        {
+            allocator.free(
+                allocator.user_data, alloc_data, light_alloc_size, ETHASH_MEMORY_LIGHT_CACHE);
+            return nullptr;
+        }
+    }
+
+    hash512* const light_cache = reinterpret_cast<hash512*>(alloc_data + context_header_size);
     const hash256 epoch_seed = calculate_epoch_seed(epoch_number);
     build_fn(light_cache, light_cache_num_items, epoch_seed);
 
     uint32_t* const l1_cache =
-        reinterpret_cast<uint32_t*>(alloc_data + context_alloc_size + light_cache_size);
-
-    hash1024* full_dataset = full ? reinterpret_cast<hash1024*>(l1_cache) : nullptr;
+        full ? reinterpret_cast<uint32_t*>(full_dataset) :
+               reinterpret_cast<uint32_t*>(alloc_data + context_header_size + light_cache_size);
 
     epoch_context_full* const context = new (alloc_data) epoch_context_full{
         epoch_number,
@@ -163,6 +219,7 @@ epoch_context_full* create_epoch_context(
         l1_cache,
         full_dataset_num_items,
         full_dataset,
+        allocator,
     };
 
     auto* full_dataset_2048 = reinterpret_cast<hash2048*>(l1_cache);
@@ -172,19 +229,19 @@ epoch_context_full* create_epoch_context(
 }
 }  // namespace generic
 
-void build_light_cache(hash512 cache[], int num_items, const hash256& seed) noexcept
+namespace generic
 {
-    return generic::build_light_cache(keccak512, cache, num_items, seed);
-}
-
+template <typename Isa>
 struct item_state
 {
-    const hash512* const cache;
-    const int64_t num_cache_items;
-    const uint32_t seed;
+    const hash512* cache;
+    int64_t num_cache_items;
+    uint32_t seed;
 
     hash512 mix;
 
+    item_state() noexcept = default;
+
     ALWAYS_INLINE item_state(const epoch_context& context, int64_t index) noexcept
       : cache{context.light_cache},
         num_cache_items{context.light_cache_num_items},
@@ -200,15 +257,17 @@ struct item_state
         static constexpr size_t num_words = sizeof(mix) / sizeof(uint32_t);
         const uint32_t t = fnv1(seed ^ round, mix.word32s[round % num_words]);
         const int64_t parent_index = t % num_cache_items;
-        mix = fnv1(mix, le::uint32s(cache[parent_index]));
+        mix = fnv1(Isa{}, mix, le::uint32s(cache[parent_index]));
     }
 
     ALWAYS_INLINE hash512 final() noexcept { return keccak512(le::uint32s(mix)); }
 };
 
-hash512 calculate_dataset_item_512(const epoch_context& context, int64_t index) noexcept
+template <typename Isa>
+inline ALWAYS_INLINE hash512 calculate_dataset_item_512(
+    Isa, const epoch_context& context, int64_t index) noexcept
 {
-    item_state item0{context, index};
+    item_state<Isa> item0{context, index};
     for (uint32_t j = 0; j < full_dataset_item_parents; ++j)
         item0.update(j);
     return item0.final();
@@ -218,10 +277,12 @@ hash512 calculate_dataset_item_512(const epoch_context& context, int64_t index)
 ///
 /// This consist of two 512-bit items produced by calculate_dataset_item_partial().
 /// Here the computation is done interleaved for better performance.
-hash1024 calculate_dataset_item_1024(const epoch_context& context, uint32_t index) noexcept
+template <typename Isa>
+inline ALWAYS_INLINE hash1024 calculate_dataset_item_1024(
+    Isa, const epoch_context& context, uint32_t index) noexcept
 {
-    item_state item0{context, int64_t(index) * 2};
-    item_state item1{context, int64_t(index) * 2 + 1};
+    item_state<Isa> item0{context, int64_t(index) * 2};
+    item_state<Isa> item1{context, int64_t(index) * 2 + 1};
 
     for (uint32_t j = 0; j < full_dataset_item_parents; ++j)
     {
@@ -232,12 +293,14 @@ hash1024 calculate_dataset_item_1024(const epoch_context& context, uint32_t inde
     return hash1024{{item0.final(), item1.final()}};
 }
 
-hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t index) noexcept
+template <typename Isa>
+inline ALWAYS_INLINE hash2048 calculate_dataset_item_2048(
+    Isa, const epoch_context& context, uint32_t index) noexcept
 {
-    item_state item0{context, int64_t(index) * 4};
-    item_state item1{context, int64_t(index) * 4 + 1};
-    item_state item2{context, int64_t(index) * 4 + 2};
-    item_state item3{context, int64_t(index) * 4 + 3};
+    item_state<Isa> item0{context, int64_t(index) * 4};
+    item_state<Isa> item1{context, int64_t(index) * 4 + 1};
+    item_state<Isa> item2{context, int64_t(index) * 4 + 2};
+    item_state<Isa> item3{context, int64_t(index) * 4 + 3};
 
     for (uint32_t j = 0; j < full_dataset_item_parents; ++j)
     {
@@ -250,76 +313,687 @@ hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t inde
     return hash2048{{item0.final(), item1.final(), item2.final(), item3.final()}};
 }
 
-namespace
+/// Calculates N 512-bit full dataset items of arbitrary indexes.
+///
+/// The computations are interleaved so the light cache loads of all the items are in flight
+/// at the same time.
+template <typename Isa, size_t N>
+inline ALWAYS_INLINE void calculate_dataset_items_512(Isa, const epoch_context& context,
+    const int64_t (&indexes)[N], hash512 (&items)[N]) noexcept
 {
-using lookup_fn = hash1024 (*)(const epoch_context&, uint32_t);
+    item_state<Isa> states[N];
+    for (size_t n = 0; n < N; ++n)
+        states[n] = item_state<Isa>{context, indexes[n]};
+
+    for (uint32_t j = 0; j < full_dataset_item_parents; ++j)
+    {
+        for (size_t n = 0; n < N; ++n)
+            states[n].update(j);
+    }
 
-inline hash512 hash_seed(const hash256& header_hash, uint64_t nonce) noexcept
+    for (size_t n = 0; n < N; ++n)
+        items[n] = states[n].final();
+}
+
+/// The number of 512-bit full dataset items computed interleaved by the batch functions.
+constexpr size_t items_batch_size = 8;
+
+/// Calculates the 2048-bit full dataset items of the given indexes, two at a time.
+template <typename Isa>
+inline ALWAYS_INLINE void calculate_dataset_items_2048(Isa, const epoch_context& context,
+    const uint32_t indexes[], hash2048 items[], size_t num_items) noexcept
 {
-    nonce = le::uint64(nonce);
-    uint8_t init_data[sizeof(header_hash) + sizeof(nonce)];
-    std::memcpy(&init_data[0], &header_hash, sizeof(header_hash));
-    std::memcpy(&init_data[sizeof(header_hash)], &nonce, sizeof(nonce));
+    static constexpr size_t num_parts = sizeof(hash2048) / sizeof(hash512);
+    static constexpr size_t batch_size = items_batch_size / num_parts;
+
+    size_t i = 0;
+    for (; num_items - i >= batch_size; i += batch_size)
+    {
+        int64_t part_indexes[items_batch_size];
+        hash512 parts[items_batch_size];
+        for (size_t k = 0; k < items_batch_size; ++k)
+            part_indexes[k] = int64_t(indexes[i + k / num_parts] * num_parts + k % num_parts);
 
-    return keccak512(init_data, sizeof(init_data));
+        calculate_dataset_items_512(Isa{}, context, part_indexes, parts);
+
+        for (size_t k = 0; k < items_batch_size; ++k)
+            items[i + k / num_parts].hash512s[k % num_parts] = parts[k];
+    }
+
+    for (; i < num_items; ++i)
+        items[i] = calculate_dataset_item_2048(Isa{}, context, indexes[i]);
 }
 
-inline hash256 hash_final(const hash512& seed, const hash256& mix_hash)
+// The full dataset lookup policies of hash_kernel(). The full context ones return
+// references to the items in the full dataset to avoid copying them.
+
+/// Computes the full dataset items from the light cache.
+template <typename Isa>
+struct light_lookup
 {
-    uint8_t final_data[sizeof(seed) + sizeof(mix_hash)];
-    std::memcpy(&final_data[0], seed.bytes, sizeof(seed));
-    std::memcpy(&final_data[sizeof(seed)], mix_hash.bytes, sizeof(mix_hash));
-    return keccak256(final_data, sizeof(final_data));
+    const epoch_context& context;
+
+    ALWAYS_INLINE hash1024 operator()(uint32_t index) const noexcept
+    {
+        telemetry::add(telemetry::light_items_computed, 1);
+        return calculate_dataset_item_1024(Isa{}, context, index);
+    }
+};
+
+/// Reads the full dataset items provided by the page fault handler.
+struct direct_lookup
+{
+    const epoch_context_full& context;
+
+    ALWAYS_INLINE const hash1024& operator()(uint32_t index) const noexcept
+    {
+        telemetry::add(telemetry::dataset_items_cached, 1);
+        return context.full_dataset[index];
+    }
+};
+
+/// Reads the full dataset items generating the missing ones.
+template <typename Isa>
+struct lazy_lookup
+{
+    const epoch_context_full& context;
+
+    ALWAYS_INLINE const hash1024& operator()(uint32_t index) const noexcept
+    {
+        hash1024& item = context.full_dataset[index];
+        if (item.word64s[0] == 0)
+        {
+            // TODO: Copy elision here makes it thread-safe?
+            item = calculate_dataset_item_1024(Isa{}, context, index);
+            telemetry::add(telemetry::dataset_items_generated, 1);
+        }
+        else
+            telemetry::add(telemetry::dataset_items_cached, 1);
+
+        return item;
+    }
+};
+
+/// The number of nonces the full dataset search processes in lock-step.
+constexpr size_t search_batch_size = 8;
+
+/// Issues the prefetch of both cache lines of the full dataset item.
+inline void prefetch_item(const hash1024* item) noexcept
+{
+    __builtin_prefetch(&item->hash512s[0]);
+    __builtin_prefetch(&item->hash512s[1]);
+}
+
+/// The Ethash main loop computing N mix hashes in lock-step.
+///
+/// Every full dataset access depends on the mix of the previous round so the single-nonce
+/// loop waits for one memory load at a time. Here the rounds of N independent nonces are
+/// interleaved: the item for the next round of a nonce is prefetched as soon as its index is
+/// known, and is read only after the other N - 1 nonces have been mixed. This keeps N memory
+/// loads in flight.
+template <typename Isa, size_t N, typename Lookup>
+inline ALWAYS_INLINE void hash_kernel_multi(uint32_t num_items, const hash1024* full_dataset,
+    const hash512 (&seeds)[N], hash256 (&mix_hashes)[N], Lookup lookup) noexcept
+{
+    static constexpr size_t num_words = sizeof(hash1024) / sizeof(uint32_t);
+
+    hash1024 mix[N];
+    uint32_t seed_init[N];
+    uint32_t indexes[N];
+
+    for (size_t n = 0; n < N; ++n)
+    {
+        seed_init[n] = le::uint32(seeds[n].word32s[0]);
+        mix[n] = hash1024{{le::uint32s(seeds[n]), le::uint32s(seeds[n])}};
+        indexes[n] = fnv1(seed_init[n], mix[n].word32s[0]) % num_items;
+        prefetch_item(&full_dataset[indexes[n]]);
+    }
+
+    for (uint32_t i = 0; i < num_dataset_accesses; ++i)
+    {
+        const uint32_t next = i + 1;
+        for (size_t n = 0; n < N; ++n)
+        {
+            const auto& item = lookup(indexes[n]);
+            fnv1_mix(Isa{}, mix[n], le::uint32s(item));
+
+            if (next < num_dataset_accesses)
+            {
+                const uint32_t t = fnv1(next ^ seed_init[n], mix[n].word32s[next % num_words]);
+                indexes[n] = t % num_items;
+                prefetch_item(&full_dataset[indexes[n]]);
+            }
+        }
+    }
+
+    for (size_t n = 0; n < N; ++n)
+        mix_hashes[n] = reduce_mix<Isa>(mix[n]);
+    telemetry::add(telemetry::hashes, N);
 }
 
-inline hash256 hash_kernel(
-    const epoch_context& context, const hash512& seed, lookup_fn lookup) noexcept
+/// The number of nonces the light cache batch hashing processes in lock-step.
+/// Both halves of their full dataset items are computed interleaved.
+constexpr size_t light_batch_size = items_batch_size / 2;
+
+/// The Ethash main loop computing N mix hashes with the light cache in lock-step.
+///
+/// The full dataset items of all N nonces in a round are computed interleaved,
+/// see calculate_dataset_items_512().
+template <typename Isa, size_t N>
+inline ALWAYS_INLINE void hash_kernel_light_multi(const epoch_context& context,
+    const hash512 (&seeds)[N], hash256 (&mix_hashes)[N]) noexcept
 {
     static constexpr size_t num_words = sizeof(hash1024) / sizeof(uint32_t);
-    const uint32_t index_limit = static_cast<uint32_t>(context.full_dataset_num_items);
-    const uint32_t seed_init = le::uint32(seed.word32s[0]);
+    const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);
 
-    hash1024 mix{{le::uint32s(seed), le::uint32s(seed)}};
+    hash1024 mix[N];
+    uint32_t seed_init[N];
+    for (size_t n = 0; n < N; ++n)
+    {
+        seed_init[n] = le::uint32(seeds[n].word32s[0]);
+        mix[n] = hash1024{{le::uint32s(seeds[n]), le::uint32s(seeds[n])}};
+    }
 
     for (uint32_t i = 0; i < num_dataset_accesses; ++i)
     {
-        const uint32_t p = fnv1(i ^ seed_init, mix.word32s[i % num_words]) % index_limit;
-        const hash1024 newdata = le::uint32s(lookup(context, p));
+        int64_t indexes[2 * N];
+        for (size_t n = 0; n < N; ++n)
+        {
+            const uint32_t p = fnv1(i ^ seed_init[n], mix[n].word32s[i % num_words]) % num_items;
+            indexes[2 * n] = int64_t(p) * 2;
+            indexes[2 * n + 1] = int64_t(p) * 2 + 1;
+        }
+
+        hash512 items[2 * N];
+        calculate_dataset_items_512(Isa{}, context, indexes, items);
 
-        for (size_t j = 0; j < num_words; ++j)
-            mix.word32s[j] = fnv1(mix.word32s[j], newdata.word32s[j]);
+        for (size_t n = 0; n < N; ++n)
+            fnv1_mix(Isa{}, mix[n], le::uint32s(hash1024{{items[2 * n], items[2 * n + 1]}}));
     }
 
-    hash256 mix_hash;
-    for (size_t i = 0; i < num_words; i += 4)
+    for (size_t n = 0; n < N; ++n)
+        mix_hashes[n] = reduce_mix<Isa>(mix[n]);
+    telemetry::add(telemetry::hashes, N);
+    telemetry::add(telemetry::light_items_computed, N * num_dataset_accesses);
+}
+
+/// Computes the mix hashes of the seeds with the light cache, light_batch_size at a time.
+template <typename Isa>
+inline ALWAYS_INLINE void hash_mix_light_batch(Isa, const epoch_context& context,
+    const hash512 seeds[], hash256 mix_hashes[], size_t num_hashes) noexcept
+{
+    size_t i = 0;
+    for (; num_hashes - i >= light_batch_size; i += light_batch_size)
     {
-        const uint32_t h1 = fnv1(mix.word32s[i], mix.word32s[i + 1]);
-        const uint32_t h2 = fnv1(h1, mix.word32s[i + 2]);
-        const uint32_t h3 = fnv1(h2, mix.word32s[i + 3]);
-        mix_hash.word32s[i / 4] = h3;
+        hash512 batch_seeds[light_batch_size];
+        hash256 batch_mix_hashes[light_batch_size];
+        std::copy_n(&seeds[i], light_batch_size, batch_seeds);
+        hash_kernel_light_multi<Isa>(context, batch_seeds, batch_mix_hashes);
+        std::copy_n(batch_mix_hashes, light_batch_size, &mix_hashes[i]);
     }
 
-    return le::uint32s(mix_hash);
+    const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);
+    for (; i < num_hashes; ++i)
+        mix_hashes[i] = hash_kernel<Isa>(num_items, seeds[i], light_lookup<Isa>{context});
 }
-}  // namespace
 
-result hash(const epoch_context_full& context, const hash256& header_hash, uint64_t nonce) noexcept
+/// Computes the mix hashes of the seeds with the full dataset, search_batch_size at a time.
+template <typename Isa, typename Lookup>
+inline ALWAYS_INLINE void hash_mix_full_batch(const epoch_context_full& context,
+    const hash512 seeds[], hash256 mix_hashes[], size_t num_hashes, Lookup lookup) noexcept
 {
-    static const auto lazy_lookup = [](const epoch_context& ctx, uint32_t index) noexcept
+    const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);
+    size_t i = 0;
+    for (; num_hashes - i >= search_batch_size; i += search_batch_size)
     {
-        auto full_dataset = static_cast<const epoch_context_full&>(ctx).full_dataset;
-        hash1024& item = full_dataset[index];
-        if (item.word64s[0] == 0)
+        hash512 batch_seeds[search_batch_size];
+        hash256 batch_mix_hashes[search_batch_size];
+        std::copy_n(&seeds[i], search_batch_size, batch_seeds);
+        hash_kernel_multi<Isa>(
+            num_items, context.full_dataset, batch_seeds, batch_mix_hashes, lookup);
+        std::copy_n(batch_mix_hashes, search_batch_size, &mix_hashes[i]);
+    }
+
+    for (; i < num_hashes; ++i)
+        mix_hashes[i] = hash_kernel<Isa>(num_items, seeds[i], lookup);
+}
+
+/// Hashes the nonces with the full dataset and calls visit(nonce, final_hash, mix_hash)
+/// for them in order until it returns false.
+template <typename Isa, typename Lookup, typename Visitor>
+inline ALWAYS_INLINE void search_full(const epoch_context_full& context,
+    const hash256& header_hash, uint64_t start_nonce, size_t iterations, Lookup lookup,
+    Visitor& visit) noexcept
+{
+    const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);
+    const uint64_t end_nonce = start_nonce + iterations;
+    uint64_t nonce = start_nonce;
+
+    for (; end_nonce - nonce >= search_batch_size; nonce += search_batch_size)
+    {
+        hash512 seeds[search_batch_size];
+        hash256 mix_hashes[search_batch_size];
+        for (size_t n = 0; n < search_batch_size; ++n)
+            seeds[n] = hash_seed(header_hash, nonce + n);
+
+        hash_kernel_multi<Isa>(num_items, context.full_dataset, seeds, mix_hashes, lookup);
+
+        for (size_t n = 0; n < search_batch_size; ++n)
         {
-            // TODO: Copy elision here makes it thread-safe?
-            item = calculate_dataset_item_1024(ctx, index);
+            if (!visit(nonce + n, hash_final(seeds[n], mix_hashes[n]), mix_hashes[n]))
+                return;
         }
+    }
 
-        return item;
-    };
+    for (; nonce < end_nonce; ++nonce)
+    {
+        const hash512 seed = hash_seed(header_hash, nonce);
+        const hash256 mix_hash = hash_kernel<Isa>(num_items, seed, lookup);
+        if (!visit(nonce, hash_final(seed, mix_hash), mix_hash))
+            return;
+    }
+}
+
+/// The search visitor stopping at the first solution.
+struct solution_visitor
+{
+    const hash256& boundary;
+    search_result solution;
+
+    bool operator()(uint64_t nonce, const hash256& final_hash, const hash256& mix_hash) noexcept
+    {
+        if (!is_less_or_equal(final_hash, boundary))
+            return true;
+        solution = {{final_hash, mix_hash}, nonce};
+        return false;
+    }
+};
+
+/// The search visitor recording all the shares until the output array is full.
+struct share_visitor
+{
+    const hash256& share_boundary;
+    const hash256& block_boundary;
+    share* const shares;
+    const size_t capacity;
+    size_t num_shares;
+
+    bool operator()(uint64_t nonce, const hash256& final_hash, const hash256& mix_hash) noexcept
+    {
+        if (!is_less_or_equal(final_hash, share_boundary))
+            return true;
+        shares[num_shares++] = {
+            nonce, final_hash, mix_hash, is_less_or_equal(final_hash, block_boundary)};
+        return num_shares != capacity;
+    }
+};
+
+}  // namespace generic
+
+namespace
+{
+/// The hot functions compiled for a specific instruction set.
+struct kernel_table
+{
+    instruction_set set;
+    void (*build_light_cache)(hash512 cache[], int num_items, const hash256& seed) noexcept;
+    hash512 (*calculate_dataset_item_512)(const epoch_context& context, int64_t index) noexcept;
+    hash1024 (*calculate_dataset_item_1024)(
+        const epoch_context& context, uint32_t index) noexcept;
+    hash2048 (*calculate_dataset_item_2048)(
+        const epoch_context& context, uint32_t index) noexcept;
+    hash256 (*hash_mix_light)(const epoch_context& context, const hash512& seed) noexcept;
+    hash256 (*hash_mix_full)(const epoch_context_full& context, const hash512& seed) noexcept;
+    search_result (*search_full)(const epoch_context_full& context, const hash256& header_hash,
+        const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept;
+    size_t (*search_shares_full)(const epoch_context_full& context, const hash256& header_hash,
+        const hash256& share_boundary, const hash256& block_boundary, uint64_t start_nonce,
+        size_t iterations, share* shares, size_t capacity) noexcept;
+    void (*calculate_dataset_items_2048)(const epoch_context& context, const uint32_t indexes[],
+        hash2048 items[], size_t num_items) noexcept;
+    void (*hash_mix_light_batch)(const epoch_context& context, const hash512 seeds[],
+        hash256 mix_hashes[], size_t num_hashes) noexcept;
+    void (*hash_mix_full_batch)(const epoch_context_full& context, const hash512 seeds[],
+        hash256 mix_hashes[], size_t num_hashes) noexcept;
+};
+
+/// Defines the kernel table of the instruction set NAME in the namespace NAME_kernels.
+///
+/// The ISA selects the implementation of the hash operations from simd.hpp.
+/// The ATTRIBUTES are applied to all the functions. All the code these functions are built of
+/// is always inlined so it is compiled for the instruction set of the attributes.
+#define DEFINE_KERNELS(NAME, ISA, ATTRIBUTES)                                                      \
+    namespace NAME##_kernels                                                                       \
+    {                                                                                              \
+    ATTRIBUTES void build_light_cache(                                                             \
+        hash512 cache[], int num_items, const hash256& seed) noexcept                              \
+    {                                                                                              \
+        generic::build_light_cache(isa::ISA{}, keccak512, cache, num_items, seed);                 \
+    }                                                                                              \
+    ATTRIBUTES hash512 calculate_dataset_item_512(                                                 \
+        const epoch_context& context, int64_t index) noexcept                                      \
+    {                                                                                              \
+        return generic::calculate_dataset_item_512(isa::ISA{}, context, index);                    \
+    }                                                                                              \
+    ATTRIBUTES hash1024 calculate_dataset_item_1024(                                               \
+        const epoch_context& context, uint32_t index) noexcept                                     \
+    {                                                                                              \
+        return generic::calculate_dataset_item_1024(isa::ISA{}, context, index);                   \
+    }                                                                                              \
+    ATTRIBUTES hash2048 calculate_dataset_item_2048(                                               \
+        const epoch_context& context, uint32_t index) noexcept                                     \
+    {                                                                                              \
+        return generic::calculate_dataset_item_2048(isa::ISA{}, context, index);                   \
+    }                                                                                              \
+    ATTRIBUTES hash256 hash_mix_light(const epoch_context& context, const hash512& seed) noexcept  \
+    {                                                                                              \
+        const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);              \
+        return hash_kernel<isa::ISA>(num_items, seed, generic::light_lookup<isa::ISA>{context});   \
+    }                                                                                              \
+    ATTRIBUTES hash256 hash_mix_full(                                                              \
+        const epoch_context_full& context, const hash512& seed) noexcept                           \
+    {                                                                                              \
+        const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);              \
+        if (context.full_dataset_pager)                                                            \
+            return hash_kernel<isa::ISA>(num_items, seed, generic::direct_lookup{context});        \
+        return hash_kernel<isa::ISA>(num_items, seed, generic::lazy_lookup<isa::ISA>{context});    \
+    }                                                                                              \
+    ATTRIBUTES search_result search_full(const epoch_context_full& context,                        \
+        const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,                 \
+        size_t iterations) noexcept                                                                \
+    {                                                                                              \
+        generic::solution_visitor visitor{boundary, {}};                                           \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            generic::search_full<isa::ISA>(context, header_hash, start_nonce, iterations,          \
+                generic::direct_lookup{context}, visitor);                                         \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            generic::search_full<isa::ISA>(context, header_hash, start_nonce, iterations,          \
+                generic::lazy_lookup<isa::ISA>{context}, visitor);                                 \
+        }                                                                                          \
+        return visitor.solution;                                                                   \
+    }                                                                                              \
+    ATTRIBUTES size_t search_shares_full(const epoch_context_full& context,                        \
+        const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,  \
+        uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept          \
+    {                                                                                              \
+        if (capacity == 0)                                                                         \
+            return 0;                                                                              \
+        generic::share_visitor visitor{share_boundary, block_boundary, shares, capacity, 0};       \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            generic::search_full<isa::ISA>(context, header_hash, start_nonce, iterations,          \
+                generic::direct_lookup{context}, visitor);                                         \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            generic::search_full<isa::ISA>(context, header_hash, start_nonce, iterations,          \
+                generic::lazy_lookup<isa::ISA>{context}, visitor);                                 \
+        }                                                                                          \
+        return visitor.num_shares;                                                                 \
+    }                                                                                              \
+    ATTRIBUTES void calculate_dataset_items_2048(const epoch_context& context,                     \
+        const uint32_t indexes[], hash2048 items[], size_t num_items) noexcept                     \
+    {                                                                                              \
+        generic::calculate_dataset_items_2048(isa::ISA{}, context, indexes, items, num_items);     \
+    }                                                                                              \
+    ATTRIBUTES void hash_mix_light_batch(const epoch_context& context, const hash512 seeds[],      \
+        hash256 mix_hashes[], size_t num_hashes) noexcept                                          \
+    {                                                                                              \
+        generic::hash_mix_light_batch(isa::ISA{}, context, seeds, mix_hashes, num_hashes);         \
+    }                                                                                              \
+    ATTRIBUTES void hash_mix_full_batch(const epoch_context_full& context, const hash512 seeds[],  \
+        hash256 mix_hashes[], size_t num_hashes) noexcept                                          \
+    {                                                                                              \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            generic::hash_mix_full_batch<isa::ISA>(                                                \
+                context, seeds, mix_hashes, num_hashes, generic::direct_lookup{context});          \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            generic::hash_mix_full_batch<isa::ISA>(context, seeds, mix_hashes, num_hashes,         \
+                generic::lazy_lookup<isa::ISA>{context});                                          \
+        }                                                                                          \
+    }                                                                                              \
+    constexpr kernel_table table = {instruction_set::NAME, build_light_cache,                      \
+        calculate_dataset_item_512, calculate_dataset_item_1024, calculate_dataset_item_2048,      \
+        hash_mix_light, hash_mix_full, search_full, search_shares_full,                            \
+        calculate_dataset_items_2048, hash_mix_light_batch, hash_mix_full_batch};                  \
+    }
 
+DEFINE_KERNELS(generic, generic, )
+#if ETHASH_X86_64_SIMD
+DEFINE_KERNELS(x86_64_v2, generic, TARGET_X86_64_V2)
+DEFINE_KERNELS(x86_64_v3, avx2, TARGET_X86_64_V3)
+DEFINE_KERNELS(x86_64_v4, avx512, TARGET_X86_64_V4)
+#endif
+
+#undef DEFINE_KERNELS
+
+/// The kernels in use. Starts with the generic ones so it is usable before the selection.
+const kernel_table* kernels = &generic_kernels::table;
+
+#if ETHASH_X86_64_SIMD
+/// The CPUID bit of the CPU feature named as in the target attributes.
+struct cpu_feature
+{
+    const char* name;
+    unsigned leaf;
+
+    /// The index of the register in the EAX, EBX, ECX, EDX order.
+    unsigned reg;
+    unsigned bit;
+
+    /// The XCR0 bits of the register state the OS must enable for the feature.
+    unsigned xcr0_mask;
+};
+
+constexpr unsigned ebx = 1;
+constexpr unsigned ecx = 2;
+constexpr unsigned avx_state = 0x6;
+constexpr unsigned avx512_state = 0xe6;
+
+constexpr cpu_feature cpu_features[] = {
+    {"sse3", 1, ecx, 0, 0},
+    {"ssse3", 1, ecx, 9, 0},
+    {"fma", 1, ecx, 12, avx_state},
+    {"cx16", 1, ecx, 13, 0},
+    {"sse4.1", 1, ecx, 19, 0},
+    {"sse4.2", 1, ecx, 20, 0},
+    {"movbe", 1, ecx, 22, 0},
+    {"popcnt", 1, ecx, 23, 0},
+    {"xsave", 1, ecx, 26, 0},
+    {"avx", 1, ecx, 28, avx_state},
+    {"f16c", 1, ecx, 29, avx_state},
+    {"bmi", 7, ebx, 3, 0},
+    {"avx2", 7, ebx, 5, avx_state},
+    {"bmi2", 7, ebx, 8, 0},
+    {"avx512f", 7, ebx, 16, avx512_state},
+    {"avx512dq", 7, ebx, 17, avx512_state},
+    {"avx512cd", 7, ebx, 28, avx512_state},
+    {"avx512bw", 7, ebx, 30, avx512_state},
+    {"avx512vl", 7, ebx, 31, avx512_state},
+    {"lzcnt", 0x80000001, ecx, 5, 0},
+};
+
+/// Finds the feature of the given name, not null-terminated. Returns null if not known.
+const cpu_feature* find_cpu_feature(const char* name, size_t name_size) noexcept
+{
+    for (const auto& feature : cpu_features)
+    {
+        if (std::strlen(feature.name) == name_size &&
+            std::strncmp(feature.name, name, name_size) == 0)
+            return &feature;
+    }
+    return nullptr;
+}
+
+bool check_cpu_feature(const cpu_feature& feature) noexcept
+{
+    unsigned regs[4];
+    if (!__get_cpuid_count(feature.leaf, 0, &regs[0], &regs[1], &regs[2], &regs[3]) ||
+        ((regs[feature.reg] >> feature.bit) & 1) == 0)
+        return false;
+
+    if (feature.xcr0_mask == 0)
+        return true;
+
+    // The register state must be enabled by the OS, checked with XGETBV if OSXSAVE is set.
+    if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]) || ((regs[ecx] >> 27) & 1) == 0)
+        return false;
+    unsigned xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    return (xcr0_lo & feature.xcr0_mask) == feature.xcr0_mask;
+}
+
+/// Checks the CPU supports all the features of the target attribute of the instruction set.
+///
+/// Called when the library is loaded, so the feature list is parsed in place without
+/// allocations.
+bool is_supported(instruction_set set) noexcept
+{
+    const char* name = get_target_features(set);
+    while (*name != '\0')
+    {
+        const char* end = std::strchr(name, ',');
+        if (end == nullptr)
+            end = name + std::strlen(name);
+
+        const auto* feature = find_cpu_feature(name, static_cast<size_t>(end - name));
+        if (feature == nullptr || !check_cpu_feature(*feature))
+            return false;
+        name = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+__attribute__((constructor)) void select_kernels() noexcept
+{
+    set_instruction_set(detect_instruction_set());
+}
+#else
+bool is_supported(instruction_set set) noexcept
+{
+    return set == instruction_set::generic;
+}
+#endif
+}  // namespace
+
+const char* get_target_features(instruction_set set) noexcept
+{
+    switch (set)
+    {
+#if ETHASH_X86_64_SIMD
+    case instruction_set::x86_64_v2:
+        return ETHASH_X86_64_V2_FEATURES;
+    case instruction_set::x86_64_v3:
+        return ETHASH_X86_64_V3_FEATURES;
+    case instruction_set::x86_64_v4:
+        return ETHASH_X86_64_V4_FEATURES;
+#endif
+    default:
+        return "";
+    }
+}
+
+bool is_cpu_feature_supported(const std::string& name, bool& known) noexcept
+{
+#if ETHASH_X86_64_SIMD
+    if (const auto* feature = find_cpu_feature(name.data(), name.size()))
+    {
+        known = true;
+        return check_cpu_feature(*feature);
+    }
+#endif
+    (void)name;
+    known = false;
+    return false;
+}
+
+instruction_set detect_instruction_set() noexcept
+{
+    // The checks are ordered from the best instruction set.
+    for (const auto set : {instruction_set::x86_64_v4, instruction_set::x86_64_v3,
+             instruction_set::x86_64_v2})
+    {
+        if (is_supported(set))
+            return set;
+    }
+    return instruction_set::generic;
+}
+
+instruction_set get_instruction_set() noexcept
+{
+    return kernels->set;
+}
+
+bool set_instruction_set(instruction_set set) noexcept
+{
+    if (!is_supported(set))
+        return false;
+
+    switch (set)
+    {
+    case instruction_set::generic:
+        kernels = &generic_kernels::table;
+        break;
+#if ETHASH_X86_64_SIMD
+    case instruction_set::x86_64_v2:
+        kernels = &x86_64_v2_kernels::table;
+        break;
+    case instruction_set::x86_64_v3:
+        kernels = &x86_64_v3_kernels::table;
+        break;
+    case instruction_set::x86_64_v4:
+        kernels = &x86_64_v4_kernels::table;
+        break;
+#endif
+    default:
+        return false;
+    }
+    progpow::select_kernels(set);
+    return true;
+}
+
+void build_light_cache(hash512 cache[], int num_items, const hash256& seed) noexcept
+{
+    kernels->build_light_cache(cache, num_items, seed);
+}
+
+hash512 calculate_dataset_item_512(const epoch_context& context, int64_t index) noexcept
+{
+    return kernels->calculate_dataset_item_512(context, index);
+}
+
+hash1024 calculate_dataset_item_1024(const epoch_context& context, uint32_t index) noexcept
+{
+    return kernels->calculate_dataset_item_1024(context, index);
+}
+
+hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t index) noexcept
+{
+    return kernels->calculate_dataset_item_2048(context, index);
+}
+
+void calculate_dataset_items_2048(const epoch_context& context, const uint32_t indexes[],
+    hash2048 items[], size_t num_items) noexcept
+{
+    kernels->calculate_dataset_items_2048(context, indexes, items, num_items);
+}
+
+void hash_mix_light_batch(const epoch_context& context, const hash512 seeds[],
+    hash256 mix_hashes[], size_t num_hashes) noexcept
+{
+    kernels->hash_mix_light_batch(context, seeds, mix_hashes, num_hashes);
+}
+
+result hash(const epoch_context_full& context, const hash256& header_hash, uint64_t nonce) noexcept
+{
     const hash512 seed = hash_seed(header_hash, nonce);
-    const hash256 mix_hash = hash_kernel(context, seed, lazy_lookup);
+    const hash256 mix_hash = kernels->hash_mix_full(context, seed);
     return {hash_final(seed, mix_hash), mix_hash};
 }
 
@@ -339,14 +1013,33 @@ search_result search_light(const epoch_context& context, const hash256& header_h
 search_result search(const epoch_context_full& context, const hash256& header_hash,
     const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept
 {
+    return kernels->search_full(context, header_hash, boundary, start_nonce, iterations);
+}
+
+size_t search_light_shares(const epoch_context& context, const hash256& header_hash,
+    const hash256& share_boundary, const hash256& block_boundary, uint64_t start_nonce,
+    size_t iterations, share* shares, size_t capacity) noexcept
+{
+    if (capacity == 0)
+        return 0;
+
+    generic::share_visitor visitor{share_boundary, block_boundary, shares, capacity, 0};
     const uint64_t end_nonce = start_nonce + iterations;
     for (uint64_t nonce = start_nonce; nonce < end_nonce; ++nonce)
     {
-        result r = hash(context, header_hash, nonce);
-        if (is_less_or_equal(r.final_hash, boundary))
-            return {r, nonce};
+        const result r = hash(context, header_hash, nonce);
+        if (!visitor(nonce, r.final_hash, r.mix_hash))
+            break;
     }
-    return {};
+    return visitor.num_shares;
+}
+
+size_t search_shares(const epoch_context_full& context, const hash256& header_hash,
+    const hash256& share_boundary, const hash256& block_boundary, uint64_t start_nonce,
+    size_t iterations, share* shares, size_t capacity) noexcept
+{
+    return kernels->search_shares_full(context, header_hash, share_boundary, block_boundary,
+        start_nonce, iterations, shares, capacity);
 }
 }  // namespace ethash
 
@@ -392,14 +1085,49 @@ int ethash_calculate_full_dataset_num_items(int epoch_number) noexcept
     return num_items;
 }
 
+void ethash_set_global_allocator(const ethash_allocator* allocator) noexcept
+{
+    global_allocator.store(allocator ? allocator : &default_allocator, std::memory_order_release);
+}
+
 epoch_context* ethash_create_epoch_context(int epoch_number) noexcept
 {
-    return generic::create_epoch_context(build_light_cache, epoch_number, false);
+    return ethash_create_epoch_context_with_allocator(
+        epoch_number, global_allocator.load(std::memory_order_acquire));
 }
 
 epoch_context_full* ethash_create_epoch_context_full(int epoch_number) noexcept
 {
-    return generic::create_epoch_context(build_light_cache, epoch_number, true);
+    return ethash_create_epoch_context_full_with_allocator(
+        epoch_number, global_allocator.load(std::memory_order_acquire));
+}
+
+epoch_context_full* ethash_create_epoch_context_full_on_demand(int epoch_number) noexcept
+{
+    const ethash_allocator& allocator = *global_allocator.load(std::memory_order_acquire);
+
+    bool out_of_memory = false;
+    epoch_context_full* const context = generic::create_epoch_context_on_demand(
+        build_light_cache, epoch_number, allocator, out_of_memory);
+    if (context || out_of_memory)
+        return context;
+
+    // The userfaultfd is not available, fall back to the lazily generated full dataset.
+    return generic::create_epoch_context(build_light_cache, epoch_number, true, allocator);
+}
+
+epoch_context* ethash_create_epoch_context_with_allocator(
+    int epoch_number, const ethash_allocator* allocator) noexcept
+{
+    return generic::create_epoch_context(
+        build_light_cache, epoch_number, false, allocator ? *allocator : default_allocator);
+}
+
+epoch_context_full* ethash_create_epoch_context_full_with_allocator(
+    int epoch_number, const ethash_allocator* allocator) noexcept
+{
+    return generic::create_epoch_context(
+        build_light_cache, epoch_number, true, allocator ? *allocator : default_allocator);
 }
 
 void ethash_destroy_epoch_context_full(epoch_context_full* context) noexcept
@@ -409,18 +1137,110 @@ void ethash_destroy_epoch_context_full(epoch_context_full* context) noexcept
 
 void ethash_destroy_epoch_context(epoch_context* context) noexcept
 {
-    context->~epoch_context();
-    std::free(context);
+    // All contexts are allocated as epoch_context_full, the light ones have null full dataset.
+    auto* const c = static_cast<epoch_context_full*>(context);
+    const ethash_allocator allocator = c->allocator;
+
+    // The on-demand context has the light context layout and the full dataset not owned
+    // by the allocator.
+    if (c->full_dataset_pager)
+    {
+        destroy_dataset_pager(c->full_dataset_pager);
+        c->full_dataset = nullptr;
+    }
+
+    const bool full = c->full_dataset != nullptr;
+
+    if (full)
+    {
+        const auto full_dataset_size =
+            static_cast<size_t>(get_full_dataset_size(c->full_dataset_num_items));
+        allocator.free(
+            allocator.user_data, c->full_dataset, full_dataset_size, ETHASH_MEMORY_FULL_DATASET);
+    }
+
+    const size_t light_alloc_size = context_header_size +
+                                    get_light_cache_size(c->light_cache_num_items) +
+                                    (full ? 0 : progpow::l1_cache_size);
+    c->~epoch_context_full();
+    allocator.free(allocator.user_data, c, light_alloc_size, ETHASH_MEMORY_LIGHT_CACHE);
 }
 
 ethash_result ethash_hash(
     const epoch_context* context, const hash256* header_hash, uint64_t nonce) noexcept
 {
     const hash512 seed = hash_seed(*header_hash, nonce);
-    const hash256 mix_hash = hash_kernel(*context, seed, calculate_dataset_item_1024);
+    const hash256 mix_hash = kernels->hash_mix_light(*context, seed);
     return {hash_final(seed, mix_hash), mix_hash};
 }
 
+ethash_result ethash_hash_full(
+    const epoch_context_full* context, const hash256* header_hash, uint64_t nonce) noexcept
+{
+    return hash(*context, *header_hash, nonce);
+}
+
+void ethash_hash_batch(const epoch_context* context, const hash256 header_hashes[],
+    const uint64_t nonces[], size_t num_hashes, ethash_result results[]) noexcept
+{
+    // The hashes are computed in chunks with the seeds and the mix hashes on the stack.
+    constexpr size_t chunk_size = 64;
+    hash512 seeds[chunk_size];
+    hash256 mix_hashes[chunk_size];
+    for (size_t i = 0; i < num_hashes; i += chunk_size)
+    {
+        const size_t n = std::min(chunk_size, num_hashes - i);
+        for (size_t j = 0; j < n; ++j)
+            seeds[j] = hash_seed(header_hashes[i + j], nonces[i + j]);
+        kernels->hash_mix_light_batch(*context, seeds, mix_hashes, n);
+        for (size_t j = 0; j < n; ++j)
+            results[i + j] = {hash_final(seeds[j], mix_hashes[j]), mix_hashes[j]};
+    }
+}
+
+void ethash_hash_full_batch(const epoch_context_full* context, const hash256 header_hashes[],
+    const uint64_t nonces[], size_t num_hashes, ethash_result results[]) noexcept
+{
+    // Like ethash_hash_batch(), with the full dataset loads of the nonces interleaved.
+    constexpr size_t chunk_size = 64;
+    hash512 seeds[chunk_size];
+    hash256 mix_hashes[chunk_size];
+    for (size_t i = 0; i < num_hashes; i += chunk_size)
+    {
+        const size_t n = std::min(chunk_size, num_hashes - i);
+        for (size_t j = 0; j < n; ++j)
+            seeds[j] = hash_seed(header_hashes[i + j], nonces[i + j]);
+        kernels->hash_mix_full_batch(*context, seeds, mix_hashes, n);
+        for (size_t j = 0; j < n; ++j)
+            results[i + j] = {hash_final(seeds[j], mix_hashes[j]), mix_hashes[j]};
+    }
+}
+
+void ethash_search_light(const epoch_context* context, const hash256* header_hash,
+    const hash256* boundary, uint64_t start_nonce, size_t iterations,
+    ethash_search_result* result) noexcept
+{
+    const search_result r =
+        search_light(*context, *header_hash, *boundary, start_nonce, iterations);
+    *result = {r.solution_found, r.nonce, r.final_hash, r.mix_hash};
+}
+
+void ethash_search(const epoch_context_full* context, const hash256* header_hash,
+    const hash256* boundary, uint64_t start_nonce, size_t iterations,
+    ethash_search_result* result) noexcept
+{
+    const search_result r = search(*context, *header_hash, *boundary, start_nonce, iterations);
+    *result = {r.solution_found, r.nonce, r.final_hash, r.mix_hash};
+}
+
+size_t ethash_search_shares(const epoch_context_full* context, const hash256* header_hash,
+    const hash256* share_boundary, const hash256* block_boundary, uint64_t start_nonce,
+    size_t iterations, ethash_share shares[], size_t capacity) noexcept
+{
+    return search_shares(*context, *header_hash, *share_boundary, *block_boundary, start_nonce,
+        iterations, shares, capacity);
+}
+
 bool ethash_verify_final_hash(const hash256* header_hash, const hash256* mix_hash, uint64_t nonce,
     const hash256* boundary) noexcept
 {
@@ -435,7 +1255,25 @@ bool ethash_verify(const epoch_context* context, const hash256* header_hash,
     if (!is_less_or_equal(hash_final(seed, *mix_hash), *boundary))
         return false;
 
-    const hash256 expected_mix_hash = hash_kernel(*context, seed, calculate_dataset_item_1024);
+    const hash256 expected_mix_hash = kernels->hash_mix_light(*context, seed);
+    return is_equal(expected_mix_hash, *mix_hash);
+}
+
+bool ethash_verify_final_hash_against_difficulty(const hash256* header_hash,
+    const hash256* mix_hash, uint64_t nonce, const hash256* difficulty) noexcept
+{
+    const hash512 seed = hash_seed(*header_hash, nonce);
+    return check_against_difficulty(hash_final(seed, *mix_hash), *difficulty);
+}
+
+bool ethash_verify_against_difficulty(const epoch_context* context, const hash256* header_hash,
+    const hash256* mix_hash, uint64_t nonce, const hash256* difficulty) noexcept
+{
+    const hash512 seed = hash_seed(*header_hash, nonce);
+    if (!check_against_difficulty(hash_final(seed, *mix_hash), *difficulty))
+        return false;
+
+    const hash256 expected_mix_hash = kernels->hash_mix_light(*context, seed);
     return is_equal(expected_mix_hash, *mix_hash);
 }
 
@@ -0,0 +1,182 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The verification of the RLP-encoded block headers.
+///
+/// The header is the RLP list of the fields:
+/// [parent_hash, ommers_hash, beneficiary, state_root, transactions_root, receipts_root,
+///  logs_bloom, difficulty, number, gas_limit, gas_used, timestamp, extra_data, mix_hash, nonce,
+///  ...the fields added by later forks].
+/// The seal hash is the Keccak-256 of the same list without the mix hash and the nonce.
+
+#include "ethash-internal.hpp"
+
+namespace ethash
+{
+namespace
+{
+constexpr size_t difficulty_index = 7;
+constexpr size_t number_index = 8;
+constexpr size_t mix_hash_index = 13;
+constexpr size_t nonce_index = 14;
+
+/// The RLP item, a string or a list.
+struct rlp_item
+{
+    const uint8_t* begin;    ///< The beginning of the encoding, i.e. of the prefix.
+    const uint8_t* payload;  ///< The beginning of the payload.
+    const uint8_t* end;      ///< The end of the encoding and of the payload.
+    bool is_list;
+
+    size_t payload_size() const noexcept { return static_cast<size_t>(end - payload); }
+};
+
+/// Decodes the item starting at pos. Fails if the item does not fit before end
+/// or is not in the canonical (shortest) encoding.
+bool decode_item(const uint8_t* pos, const uint8_t* end, rlp_item& item) noexcept
+{
+    if (pos == end)
+        return false;
+
+    item.begin = pos;
+    const uint8_t prefix = *pos;
+    if (prefix < 0x80)
+    {
+        item.payload = pos;
+        item.end = pos + 1;
+        item.is_list = false;
+        return true;
+    }
+
+    item.is_list = prefix >= 0xc0;
+    const uint8_t base = item.is_list ? 0xc0 : 0x80;
+    size_t payload_size = prefix - base;
+    ++pos;
+
+    // The prefixes 0xb8-0xbf and 0xf8-0xff are followed by the big-endian payload size.
+    if (payload_size > 55)
+    {
+        const size_t size_size = payload_size - 55;
+        if (size_size > sizeof(size_t) || size_size > static_cast<size_t>(end - pos))
+            return false;
+        if (*pos == 0)  // The size with leading zero bytes.
+            return false;
+        payload_size = 0;
+        for (size_t i = 0; i < size_size; ++i)
+            payload_size = (payload_size << 8) | *pos++;
+        if (payload_size <= 55)  // The long form of the short payload.
+            return false;
+    }
+
+    if (payload_size > static_cast<size_t>(end - pos))
+        return false;
+    if (!item.is_list && payload_size == 1 && *pos < 0x80)  // The single byte with a prefix.
+        return false;
+    item.payload = pos;
+    item.end = pos + payload_size;
+    return true;
+}
+
+/// Decodes the big-endian integer of at most max_size bytes into the last bytes of out.
+/// Fails for the integers with leading zero bytes, the zero is the empty string.
+bool decode_integer(const rlp_item& item, uint8_t* out, size_t max_size) noexcept
+{
+    const size_t size = item.payload_size();
+    if (item.is_list || size > max_size || (size != 0 && item.payload[0] == 0))
+        return false;
+    std::memset(out, 0, max_size);
+    std::memcpy(&out[max_size - size], item.payload, size);
+    return true;
+}
+
+/// Feeds the RLP list prefix of the given payload size to the hasher.
+void hash_list_prefix(keccak256_hasher& hasher, size_t payload_size) noexcept
+{
+    uint8_t prefix[1 + sizeof(size_t)];
+    size_t prefix_size = 1;
+    if (payload_size <= 55)
+        prefix[0] = static_cast<uint8_t>(0xc0 + payload_size);
+    else
+    {
+        size_t size_size = 0;
+        for (size_t s = payload_size; s != 0; s >>= 8)
+            ++size_size;
+        prefix[0] = static_cast<uint8_t>(0xf7 + size_size);
+        for (size_t i = size_size; i != 0; --i)
+            prefix[prefix_size++] = static_cast<uint8_t>(payload_size >> (8 * (i - 1)));
+    }
+    hasher.update(prefix, prefix_size);
+}
+}  // namespace
+
+bool decode_header_seal(const uint8_t* header, size_t header_size, header_seal& seal) noexcept
+{
+    const uint8_t* const header_end = header + header_size;
+    rlp_item list;
+    if (!decode_item(header, header_end, list) || !list.is_list || list.end != header_end)
+        return false;
+
+    rlp_item fields[nonce_index + 1];
+    const uint8_t* pos = list.payload;
+    for (auto& field : fields)
+    {
+        if (!decode_item(pos, list.end, field))
+            return false;
+        pos = field.end;
+    }
+
+    const rlp_item& mix_hash = fields[mix_hash_index];
+    const rlp_item& nonce = fields[nonce_index];
+    if (mix_hash.is_list || mix_hash.payload_size() != sizeof(seal.mix_hash) || nonce.is_list ||
+        nonce.payload_size() != sizeof(seal.nonce))
+        return false;
+
+    uint8_t number[sizeof(seal.number)];
+    if (!decode_integer(fields[difficulty_index], seal.difficulty.bytes, sizeof(seal.difficulty)) ||
+        !decode_integer(fields[number_index], number, sizeof(number)))
+        return false;
+
+    std::memcpy(seal.mix_hash.bytes, mix_hash.payload, sizeof(seal.mix_hash));
+    uint64_t n = 0;
+    for (size_t i = 0; i < sizeof(seal.nonce); ++i)
+        n = (n << 8) | nonce.payload[i];
+    seal.nonce = n;
+    n = 0;
+    for (const auto byte : number)
+        n = (n << 8) | byte;
+    seal.number = n;
+
+    // Hash the fields around the mix hash and the nonce under the shortened list prefix.
+    keccak256_hasher hasher;
+    hash_list_prefix(hasher, list.payload_size() - static_cast<size_t>(nonce.end - mix_hash.begin));
+    hasher.update(list.payload, static_cast<size_t>(mix_hash.begin - list.payload));
+    hasher.update(nonce.end, static_cast<size_t>(list.end - nonce.end));
+    seal.seal_hash = hasher.final();
+    return true;
+}
+}  // namespace ethash
+
+using namespace ethash;
+
+extern "C" {
+
+bool ethash_verify_header_rlp(const epoch_context* context, int block_number,
+    const uint8_t* header, size_t header_size) noexcept
+{
+    header_seal seal;
+    if (!decode_header_seal(header, header_size, seal) ||
+        seal.number != static_cast<uint64_t>(block_number) ||
+        get_epoch_number(block_number) != context->epoch_number)
+        return false;
+
+    // The zero difficulty is invalid for the headers sealed with Ethash.
+    if (is_equal(seal.difficulty, hash256{}))
+        return false;
+
+    return ethash_verify_against_difficulty(
+        context, &seal.seal_hash, &seal.mix_hash, seal.nonce, &seal.difficulty);
+}
+
+}  // extern "C"
@@ -3,9 +3,16 @@
 // Licensed under the Apache License, Version 2.0.
 
 #include "ethash-internal.hpp"
+#include "thread_pool.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <vector>
 
 #if !defined(__has_cpp_attribute)
 #define __has_cpp_attribute(x) 0
@@ -23,77 +30,619 @@ using namespace ethash;
 
 namespace
 {
-std::mutex shared_context_mutex;
-std::shared_ptr<epoch_context> shared_context;
-thread_local std::shared_ptr<epoch_context> thread_local_context;
+/// The number of the hazard pointers in a block.
+constexpr size_t hazards_per_block = 8;
 
-std::mutex shared_context_full_mutex;
-std::shared_ptr<epoch_context_full> shared_context_full;
-thread_local std::shared_ptr<epoch_context_full> thread_local_context_full;
+/// The block of hazard pointers.
+///
+/// The non-null hazard pointer announces the context it points to is in use by the handle
+/// owning it. Only the thread owning the block claims its null hazard pointers, but any thread
+/// may reset them when releasing the handles. The blocks are never freed, the blocks of
+/// the exited threads are reused by new threads.
+struct hazard_block
+{
+    std::atomic<const void*> hazards[hazards_per_block];
 
-/// Update thread local epoch context.
+    /// The next block in the registry, immutable once registered.
+    hazard_block* next_registered;
+
+    /// The next block owned by the same thread, accessed by the owning thread only.
+    /// Links the free blocks under the registry mutex.
+    hazard_block* next_owned;
+};
+
+std::mutex registry_mutex;
+std::atomic<hazard_block*> registered_blocks{nullptr};
+hazard_block* free_blocks = nullptr;
+
+/// Takes the free block or allocates a new one, returns null if the allocation fails.
+ATTRIBUTE_NOINLINE hazard_block* take_hazard_block() noexcept
+{
+    std::lock_guard<std::mutex> lock{registry_mutex};
+    if (free_blocks != nullptr)
+    {
+        auto* block = free_blocks;
+        free_blocks = block->next_owned;
+        block->next_owned = nullptr;
+        return block;
+    }
+
+    auto* block = new (std::nothrow) hazard_block{};
+    if (block == nullptr)
+        return nullptr;
+    block->next_registered = registered_blocks.load(std::memory_order_relaxed);
+    registered_blocks.store(block, std::memory_order_release);
+    return block;
+}
+
+/// The hazard blocks owned by the thread, returned to the registry when the thread exits.
+class thread_hazards
+{
+public:
+    constexpr thread_hazards() noexcept = default;
+
+    ~thread_hazards()
+    {
+        std::lock_guard<std::mutex> lock{registry_mutex};
+        while (m_blocks != nullptr)
+        {
+            auto* block = m_blocks;
+            m_blocks = block->next_owned;
+            block->next_owned = free_blocks;
+            free_blocks = block;
+        }
+    }
+
+    /// Returns the null hazard pointer for a new handle, takes another block if all are in use.
+    /// Returns null if there is no memory for another block.
+    std::atomic<const void*>* claim() noexcept
+    {
+        while (true)
+        {
+            for (auto* block = m_blocks; block != nullptr; block = block->next_owned)
+            {
+                for (auto& hazard : block->hazards)
+                {
+                    if (hazard.load(std::memory_order_relaxed) == nullptr)
+                        return &hazard;
+                }
+            }
+
+            auto* block = take_hazard_block();
+            if (block == nullptr)
+                return nullptr;
+            block->next_owned = m_blocks;
+            m_blocks = block;
+        }
+    }
+
+private:
+    hazard_block* m_blocks = nullptr;
+};
+
+thread_local thread_hazards local_hazards;
+
+/// Checks if any hazard pointer points to the context.
+bool is_hazardous(const void* context) noexcept
+{
+    for (auto* block = registered_blocks.load(std::memory_order_acquire); block != nullptr;
+         block = block->next_registered)
+    {
+        for (const auto& hazard : block->hazards)
+        {
+            if (hazard.load(std::memory_order_acquire) == context)
+                return true;
+        }
+    }
+    return false;
+}
+
+
+/// The number of the slots of the contexts published for the lock-free acquisition.
+constexpr size_t num_slots = 64;
+
+inline size_t get_slot_index(int epoch_number) noexcept
+{
+    return static_cast<unsigned>(epoch_number) % num_slots;
+}
+
+/// The global shared epoch contexts of the recently used epochs.
 ///
-/// This function is on the slow path. It's separated to allow inlining the fast
-/// path.
+/// The resident contexts are published in the slots indexed by the epoch number so the readers
+/// acquire them without taking the mutex: the context is protected by the reader's hazard
+/// pointer and checked to be still published. A resident context not published because its
+/// slot is taken by another epoch is acquired under the mutex.
 ///
-/// @todo: Redesign to guarantee deallocation before new allocation.
-ATTRIBUTE_NOINLINE
-void update_local_context(int epoch_number)
+/// The least recently used contexts above the capacity are unpublished and retired. The retired
+/// context is freed when no hazard pointer points to it, checked every time the mutex is taken
+/// and when a handle is released while any context is retired.
+///
+/// The contexts are built without holding the mutex. The entry of the epoch being built is
+/// added first, so the later requests for the same epoch wait for this build only and
+/// the requests for other epochs proceed, also building them in parallel.
+///
+/// The time of the use of a context is the logical clock, advanced only under the mutex.
+/// The readers store the clock in the slot if it differs, so the steady state reads write
+/// nothing shared and the uses between the same two clock ticks are not ordered.
+template <typename ContextPtr>
+struct context_cache
+{
+    using context_type = typename ContextPtr::element_type;
+
+    struct entry
+    {
+        /// The context, null while being built.
+        ContextPtr context;
+        int epoch_number;
+        uint64_t last_used;
+    };
+
+    std::atomic<context_type*> slots[num_slots];
+    std::atomic<uint64_t> slots_last_used[num_slots];
+    std::atomic<uint64_t> clock;
+
+    std::mutex mutex;
+    std::condition_variable built;
+    std::vector<entry> entries;
+    std::vector<ContextPtr> retired;
+
+    /// The size of retired, read without the mutex by release().
+    std::atomic<size_t> num_retired;
+
+    size_t capacity;
+};
+
+context_cache<epoch_context_ptr> shared_contexts{{}, {}, {}, {}, {}, {}, {}, {}, 2};
+
+/// The full contexts are large, only the most recent one is kept by default.
+context_cache<epoch_context_full_ptr> shared_contexts_full{{}, {}, {}, {}, {}, {}, {}, {}, 1};
+
+inline context_cache<epoch_context_ptr>& get_cache(const ethash_epoch_context_handle&) noexcept
+{
+    return shared_contexts;
+}
+
+inline context_cache<epoch_context_full_ptr>& get_cache(
+    const ethash_epoch_context_full_handle&) noexcept
+{
+    return shared_contexts_full;
+}
+
+template <typename ContextPtr>
+uint64_t get_last_used(const context_cache<ContextPtr>& cache,
+    const typename context_cache<ContextPtr>::entry& e) noexcept
 {
-    // Release the shared pointer of the obsoleted context.
-    thread_local_context.reset();
+    const size_t index = get_slot_index(e.epoch_number);
+    if (!e.context || cache.slots[index].load(std::memory_order_relaxed) != e.context.get())
+        return e.last_used;
+    return std::max(e.last_used, cache.slots_last_used[index].load(std::memory_order_relaxed));
+}
 
-    // Local context invalid, check the shared context.
-    std::lock_guard<std::mutex> lock{shared_context_mutex};
+/// Publishes the context in its slot, taking it from the other epoch's context if needed.
+template <typename ContextPtr>
+void publish(context_cache<ContextPtr>& cache, typename context_cache<ContextPtr>::entry& e,
+    uint64_t now) noexcept
+{
+    const size_t index = get_slot_index(e.epoch_number);
+    auto& slot = cache.slots[index];
+    const auto* current = slot.load(std::memory_order_relaxed);
+    if (current != nullptr && current != e.context.get())
+    {
+        // Keep the time of the lock-free uses of the context losing the slot.
+        for (auto& other : cache.entries)
+        {
+            if (other.context.get() == current)
+                other.last_used = get_last_used(cache, other);
+        }
+    }
+    cache.slots_last_used[index].store(now, std::memory_order_relaxed);
+    slot.store(e.context.get(), std::memory_order_release);
+}
 
-    if (!shared_context || shared_context->epoch_number != epoch_number)
+/// Retires the least recently used contexts above the given number.
+/// The contexts being built are counted, but not retired, so the capacity may be exceeded
+/// by the builds in parallel until the next build starts.
+template <typename ContextPtr>
+void evict(context_cache<ContextPtr>& cache, size_t size) noexcept
+{
+    auto& entries = cache.entries;
+    while (entries.size() > size)
     {
-        // Release the shared pointer of the obsoleted context.
-        shared_context.reset();
+        auto lru = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->context &&
+                (lru == entries.end() || get_last_used(cache, *it) < get_last_used(cache, *lru)))
+                lru = it;
+        }
+        if (lru == entries.end())
+            return;
+
+        auto& slot = cache.slots[get_slot_index(lru->epoch_number)];
+        if (slot.load(std::memory_order_relaxed) == lru->context.get())
+            slot.store(nullptr, std::memory_order_relaxed);
 
-        // Build new context.
-        shared_context = create_epoch_context(epoch_number);
+        cache.retired.push_back(std::move(lru->context));
+        cache.num_retired.store(cache.retired.size(), std::memory_order_relaxed);
+        entries.erase(lru);
     }
+}
+
+/// Frees the retired contexts no hazard pointer points to.
+template <typename ContextPtr>
+void reclaim(context_cache<ContextPtr>& cache) noexcept
+{
+    // Pairs with the fence of the reader between setting the hazard pointer and checking
+    // the context is still published, and with the fence of release() between resetting
+    // the hazard pointer and checking num_retired.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    thread_local_context = shared_context;
+    auto& retired = cache.retired;
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+                      [](const ContextPtr& c) noexcept { return !is_hazardous(c.get()); }),
+        retired.end());
+    cache.num_retired.store(retired.size(), std::memory_order_relaxed);
 }
 
-ATTRIBUTE_NOINLINE
-void update_local_context_full(int epoch_number)
+/// Acquires the context published in the slot of the epoch, the fast path.
+///
+/// Takes no lock and does no atomic read-modify-write.
+///
+/// @return  The context or null if not published.
+template <typename ContextPtr>
+inline typename ContextPtr::element_type* acquire_published(
+    context_cache<ContextPtr>& cache, int epoch_number, std::atomic<const void*>& hazard) noexcept
+{
+    const size_t index = get_slot_index(epoch_number);
+    auto& slot = cache.slots[index];
+
+    auto* context = slot.load(std::memory_order_acquire);
+    if (context == nullptr)
+        return nullptr;
+
+    hazard.store(context, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // The context still published is not freed until the hazard pointer is reset.
+    if (slot.load(std::memory_order_acquire) != context || context->epoch_number != epoch_number)
+        return nullptr;
+
+    const uint64_t now = cache.clock.load(std::memory_order_relaxed);
+    auto& last_used = cache.slots_last_used[index];
+    if (last_used.load(std::memory_order_relaxed) != now)
+        last_used.store(now, std::memory_order_relaxed);
+    return context;
+}
+
+template <typename ContextPtr>
+typename std::vector<typename context_cache<ContextPtr>::entry>::iterator find_entry(
+    context_cache<ContextPtr>& cache, int epoch_number) noexcept
+{
+    return std::find_if(cache.entries.begin(), cache.entries.end(),
+        [epoch_number](const typename context_cache<ContextPtr>::entry& e) noexcept {
+            return e.epoch_number == epoch_number;
+        });
+}
+
+/// Advances the clock, returns the time of the use by the caller holding the mutex.
+template <typename ContextPtr>
+uint64_t tick(context_cache<ContextPtr>& cache) noexcept
+{
+    // The readers store the clock after this tick, so their uses order after this one.
+    const uint64_t now = cache.clock.load(std::memory_order_relaxed) + 1;
+    cache.clock.store(now + 1, std::memory_order_relaxed);
+    return now;
+}
+
+/// Finds the context of the epoch in the cache or builds it, the slow path.
+///
+/// The context found is published and becomes the most recently used one. If the context is
+/// being built by another thread, waits for this build. Otherwise the least recently used
+/// contexts are retired and the new one is built without holding the mutex.
+///
+/// @return  The context or null in case of memory allocation failure.
+template <typename ContextPtr, typename CreateFn>
+ATTRIBUTE_NOINLINE typename ContextPtr::element_type* acquire_shared(
+    context_cache<ContextPtr>& cache, int epoch_number, std::atomic<const void*>& hazard,
+    CreateFn create) noexcept
+{
+    std::unique_lock<std::mutex> lock{cache.mutex};
+
+    auto it = find_entry(cache, epoch_number);
+    while (it != cache.entries.end() && !it->context)
+    {
+        // Wait for the build by another thread. If the context has been evicted
+        // in the meantime, or the build has failed, look it up again.
+        cache.built.wait(lock);
+        it = find_entry(cache, epoch_number);
+    }
+
+    if (it == cache.entries.end())
+    {
+        // Release the least recently used contexts before allocating the new one.
+        evict(cache, cache.capacity - 1);
+        reclaim(cache);
+        cache.entries.push_back({ContextPtr{nullptr, nullptr}, epoch_number, tick(cache)});
+
+        lock.unlock();
+        ContextPtr context = create(epoch_number);
+        lock.lock();
+
+        // The entry being built is never evicted.
+        it = find_entry(cache, epoch_number);
+        if (context)
+            it->context = std::move(context);
+        else
+        {
+            cache.entries.erase(it);
+            it = cache.entries.end();
+        }
+        cache.built.notify_all();
+    }
+
+    if (it == cache.entries.end())
+    {
+        hazard.store(nullptr, std::memory_order_release);
+        return nullptr;
+    }
+
+    // The prepared context acquired for the first time takes the slot of the context
+    // it replaces, so the cache is trimmed back to the capacity.
+    const bool prepared = it->last_used == 0;
+    const uint64_t now = tick(cache);
+    it->last_used = now;
+    publish(cache, *it, now);
+    auto* const context = it->context.get();
+    if (prepared)
+        evict(cache, cache.capacity);  // Invalidates the iterator.
+
+    // Retiring the context takes the mutex, so the hazard pointer needs no validation.
+    hazard.store(context, std::memory_order_relaxed);
+    reclaim(cache);
+    return context;
+}
+
+/// Builds the context of the epoch if it is not in the cache, see
+/// ethash_prepare_global_epoch_context().
+///
+/// Unlike acquire_shared(), only the contexts above the capacity are retired, so the prepared
+/// context takes an extra slot instead of evicting the context in use. The prepared context has
+/// the time of the use 0, older than any acquisition, and is not published, so its first
+/// acquisition takes the slow path and trims the cache to the capacity.
+template <typename ContextPtr, typename CreateFn>
+void prepare_shared(context_cache<ContextPtr>& cache, int epoch_number, CreateFn create) noexcept
+{
+    std::unique_lock<std::mutex> lock{cache.mutex};
+    if (find_entry(cache, epoch_number) != cache.entries.end())
+        return;
+
+    evict(cache, cache.capacity);
+    reclaim(cache);
+    cache.entries.push_back({ContextPtr{nullptr, nullptr}, epoch_number, 0});
+
+    lock.unlock();
+    ContextPtr context = create(epoch_number);
+    lock.lock();
+
+    // The entry being built is never evicted.
+    const auto it = find_entry(cache, epoch_number);
+    if (context)
+        it->context = std::move(context);
+    else
+        cache.entries.erase(it);
+    cache.built.notify_all();
+}
+
+template <typename Handle, typename ContextPtr, typename CreateFn>
+inline Handle acquire(context_cache<ContextPtr>& cache, int epoch_number, CreateFn create) noexcept
+{
+    auto* hazard = local_hazards.claim();
+    if (hazard == nullptr)
+        return {nullptr, nullptr};
+    auto* context = acquire_published(cache, epoch_number, *hazard);
+    if (context == nullptr)
+        context = acquire_shared(cache, epoch_number, *hazard, create);
+    return {context, context != nullptr ? hazard : nullptr};
+}
+
+/// Resets the hazard pointer of the handle. If any context is retired, possibly the one
+/// of the handle, the retired contexts are reclaimed without waiting for the next use of
+/// the mutex.
+template <typename Handle>
+inline void release(const Handle& handle) noexcept
 {
-    // Release the shared pointer of the obsoleted context.
-    thread_local_context_full.reset();
+    if (handle.internal == nullptr)
+        return;
+
+    static_cast<std::atomic<const void*>*>(handle.internal)
+        ->store(nullptr, std::memory_order_release);
 
-    // Local context invalid, check the shared context.
-    std::lock_guard<std::mutex> lock{shared_context_full_mutex};
+    // Pairs with the fence in reclaim(): either this thread sees the context retired
+    // or the thread retiring it sees the hazard pointer reset.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    if (!shared_context_full || shared_context_full->epoch_number != epoch_number)
+    auto& cache = get_cache(handle);
+    if (cache.num_retired.load(std::memory_order_relaxed) != 0)
     {
-        // Release the shared pointer of the obsoleted context.
-        shared_context_full.reset();
+        std::lock_guard<std::mutex> lock{cache.mutex};
+        reclaim(cache);
+    }
+}
+
+template <typename ContextPtr>
+void set_capacity(context_cache<ContextPtr>& cache, size_t capacity) noexcept
+{
+    std::lock_guard<std::mutex> lock{cache.mutex};
+    cache.capacity = std::max(capacity, size_t{1});
+    evict(cache, cache.capacity);
+    reclaim(cache);
+}
 
-        // Build new context.
-        shared_context_full = create_epoch_context_full(epoch_number);
+template <typename ContextPtr>
+size_t get_resident_epochs(
+    context_cache<ContextPtr>& cache, int epoch_numbers[], size_t capacity) noexcept
+{
+    std::lock_guard<std::mutex> lock{cache.mutex};
+    std::vector<std::pair<uint64_t, int>> residents;
+    for (const auto& e : cache.entries)
+    {
+        if (e.context)
+            residents.emplace_back(get_last_used(cache, e), e.epoch_number);
+    }
+    std::sort(residents.begin(), residents.end(), std::greater<std::pair<uint64_t, int>>{});
+
+    const size_t n = std::min(residents.size(), capacity);
+    for (size_t i = 0; i < n; ++i)
+        epoch_numbers[i] = residents[i].second;
+    return residents.size();
+}
+
+/// The handle of the context the thread has used last, see ethash_get_global_epoch_context().
+template <typename Handle>
+struct local_handle
+{
+    Handle handle;
+
+    ~local_handle() { release(handle); }
+};
+
+thread_local local_handle<ethash_epoch_context_handle> thread_local_context;
+thread_local local_handle<ethash_epoch_context_full_handle> thread_local_context_full;
+
+epoch_context_ptr create_shared_context(int epoch_number) noexcept
+{
+    return create_epoch_context(epoch_number);
+}
+
+epoch_context_full_ptr create_shared_context_full(int epoch_number) noexcept
+{
+    return create_epoch_context_full(epoch_number);
+}
+
+ethash_epoch_context_handle acquire_context(int epoch_number) noexcept
+{
+    return acquire<ethash_epoch_context_handle>(
+        shared_contexts, epoch_number, create_shared_context);
+}
+
+ethash_epoch_context_full_handle acquire_context_full(int epoch_number) noexcept
+{
+    return acquire<ethash_epoch_context_full_handle>(
+        shared_contexts_full, epoch_number, create_shared_context_full);
+}
+
+/// Schedules the prepare_shared() in the build queue.
+///
+/// @return  False if the queue threads cannot be started or the task cannot be allocated.
+template <typename ContextPtr, typename CreateFn>
+bool schedule_prepare(context_cache<ContextPtr>& cache, int epoch_number, CreateFn create) noexcept
+{
+    try
+    {
+        get_build_queue().submit(
+            [&cache, epoch_number, create] { prepare_shared(cache, epoch_number, create); });
+        return true;
     }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+/// Update thread local epoch context.
+///
+/// This function is on the slow path. It's separated to allow inlining the fast
+/// path.
+ATTRIBUTE_NOINLINE
+void update_local_context(int epoch_number)
+{
+    // Release the handle of the obsoleted context.
+    auto& handle = thread_local_context.handle;
+    release(handle);
+    handle = acquire_context(epoch_number);
+}
 
-    thread_local_context_full = shared_context_full;
+ATTRIBUTE_NOINLINE
+void update_local_context_full(int epoch_number)
+{
+    // Release the handle of the obsoleted context.
+    auto& handle = thread_local_context_full.handle;
+    release(handle);
+    handle = acquire_context_full(epoch_number);
 }
 }  // namespace
 
+extern "C" {
+
 const ethash_epoch_context* ethash_get_global_epoch_context(int epoch_number) noexcept
 {
     // Check if local context matches epoch number.
-    if (!thread_local_context || thread_local_context->epoch_number != epoch_number)
+    const auto* context = thread_local_context.handle.context;
+    if (context == nullptr || context->epoch_number != epoch_number)
         update_local_context(epoch_number);
 
-    return thread_local_context.get();
+    return thread_local_context.handle.context;
 }
 
 const ethash_epoch_context_full* ethash_get_global_epoch_context_full(int epoch_number) noexcept
 {
     // Check if local context matches epoch number.
-    if (!thread_local_context_full || thread_local_context_full->epoch_number != epoch_number)
+    const auto* context = thread_local_context_full.handle.context;
+    if (context == nullptr || context->epoch_number != epoch_number)
         update_local_context_full(epoch_number);
 
-    return thread_local_context_full.get();
+    return thread_local_context_full.handle.context;
+}
+
+ethash_epoch_context_handle ethash_acquire_global_epoch_context(int epoch_number) noexcept
+{
+    return acquire_context(epoch_number);
+}
+
+ethash_epoch_context_full_handle ethash_acquire_global_epoch_context_full(
+    int epoch_number) noexcept
+{
+    return acquire_context_full(epoch_number);
 }
+
+bool ethash_prepare_global_epoch_context(int epoch_number) noexcept
+{
+    return schedule_prepare(shared_contexts, epoch_number, create_shared_context);
+}
+
+bool ethash_prepare_global_epoch_context_full(int epoch_number) noexcept
+{
+    return schedule_prepare(shared_contexts_full, epoch_number, create_shared_context_full);
+}
+
+void ethash_release_global_epoch_context(ethash_epoch_context_handle handle) noexcept
+{
+    release(handle);
+}
+
+void ethash_release_global_epoch_context_full(ethash_epoch_context_full_handle handle) noexcept
+{
+    release(handle);
+}
+
+void ethash_set_global_epoch_context_capacity(size_t capacity) noexcept
+{
+    set_capacity(shared_contexts, capacity);
+}
+
+void ethash_set_global_epoch_context_full_capacity(size_t capacity) noexcept
+{
+    set_capacity(shared_contexts_full, capacity);
+}
+
+size_t ethash_get_global_epoch_contexts(int epoch_numbers[], size_t capacity) noexcept
+{
+    return get_resident_epochs(shared_contexts, epoch_numbers, capacity);
+}
+
+size_t ethash_get_global_epoch_contexts_full(int epoch_numbers[], size_t capacity) noexcept
+{
+    return get_resident_epochs(shared_contexts_full, epoch_numbers, capacity);
+}
+
+}  // extern "C"
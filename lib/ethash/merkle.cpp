@@ -0,0 +1,189 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include <ethash/merkle.hpp>
+
+#include "ethash-internal.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace ethash
+{
+namespace
+{
+/// The minimal number of nodes worth processing in a separate thread.
+constexpr size_t min_nodes_per_thread = 1024;
+
+inline hash256 hash_leaf(const hash1024& item) noexcept
+{
+    return keccak256(item.bytes, sizeof(item));
+}
+
+inline hash256 hash_node(const hash256& left, const hash256& right) noexcept
+{
+    uint8_t data[sizeof(left) + sizeof(right)];
+    std::memcpy(&data[0], left.bytes, sizeof(left));
+    std::memcpy(&data[sizeof(left)], right.bytes, sizeof(right));
+    return keccak256(data, sizeof(data));
+}
+
+inline const hash1024& get_item(const epoch_context_full& context, uint32_t index) noexcept
+{
+    hash1024& item = context.full_dataset[index];
+    if (item.word64s[0] == 0)
+        item = calculate_dataset_item_1024(context, index);
+    return item;
+}
+
+/// Executes fn(begin, end) for the chunks of the range [0, size) using up to num_threads threads.
+template <typename Fn>
+void parallel_for(size_t size, unsigned num_threads, const Fn& fn)
+{
+    const size_t max_threads = std::max(size / min_nodes_per_thread, size_t{1});
+    const size_t n = std::min(size_t{num_threads}, max_threads);
+    const size_t chunk_size = (size + n - 1) / n;
+
+    std::vector<std::thread> threads;
+    for (size_t begin = chunk_size; begin < size; begin += chunk_size)
+        threads.emplace_back(fn, begin, std::min(begin + chunk_size, size));
+
+    fn(size_t{0}, std::min(chunk_size, size));
+
+    for (auto& t : threads)
+        t.join();
+}
+}  // namespace
+
+int get_dataset_merkle_depth(int num_items) noexcept
+{
+    int depth = 0;
+    for (int n = num_items; n > 1; n = (n + 1) / 2)
+        ++depth;
+    return depth;
+}
+
+dataset_merkle_tree build_dataset_merkle_tree(
+    const epoch_context_full& context, unsigned num_threads)
+{
+    if (num_threads == 0)
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    dataset_merkle_tree tree;
+    tree.num_items = context.full_dataset_num_items;
+
+    size_t num_nodes = 0;
+    size_t level_size = static_cast<size_t>(tree.num_items);
+    while (true)
+    {
+        tree.level_offsets.push_back(num_nodes);
+        num_nodes += level_size;
+        if (level_size <= 1)
+            break;
+        level_size = (level_size + 1) / 2;
+    }
+    tree.level_offsets.push_back(num_nodes);
+    tree.nodes.resize(num_nodes);
+
+    hash256* const leaves = tree.nodes.data();
+    parallel_for(static_cast<size_t>(tree.num_items), num_threads,
+        [&context, leaves](size_t begin, size_t end) noexcept {
+            for (size_t i = begin; i < end; ++i)
+                leaves[i] = hash_leaf(get_item(context, static_cast<uint32_t>(i)));
+        });
+
+    for (size_t l = 1; l < tree.level_offsets.size() - 1; ++l)
+    {
+        const hash256* const children = &tree.nodes[tree.level_offsets[l - 1]];
+        const size_t num_children = tree.level_offsets[l] - tree.level_offsets[l - 1];
+        hash256* const parents = &tree.nodes[tree.level_offsets[l]];
+        const size_t num_parents = tree.level_offsets[l + 1] - tree.level_offsets[l];
+
+        parallel_for(num_parents, num_threads,
+            [children, num_children, parents](size_t begin, size_t end) noexcept {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const size_t r = 2 * i + 1;
+                    const hash256 right = r < num_children ? children[r] : hash256{};
+                    parents[i] = hash_node(children[2 * i], right);
+                }
+            });
+    }
+
+    return tree;
+}
+
+dataset_proof create_dataset_proof(const epoch_context_full& context,
+    const dataset_merkle_tree& tree, const hash256& header_hash, uint64_t nonce)
+{
+    const auto depth = static_cast<size_t>(get_dataset_merkle_depth(tree.num_items));
+
+    dataset_proof proof;
+    proof.branches.reserve(num_dataset_accesses * depth);
+
+    size_t k = 0;
+    const auto recording_lookup = [&](uint32_t index) noexcept {
+        const hash1024& item = get_item(context, index);
+        proof.items[k++] = item;
+
+        size_t pos = index;
+        for (size_t l = 0; l < depth; ++l)
+        {
+            const size_t level_size = tree.level_offsets[l + 1] - tree.level_offsets[l];
+            const size_t sibling = pos ^ 1;
+            proof.branches.push_back(
+                sibling < level_size ? tree.nodes[tree.level_offsets[l] + sibling] : hash256{});
+            pos /= 2;
+        }
+        return item;
+    };
+
+    const auto num_items = static_cast<uint32_t>(context.full_dataset_num_items);
+    hash_kernel(num_items, hash_seed(header_hash, nonce), recording_lookup);
+    return proof;
+}
+
+bool verify_dataset_proof(const hash256& root, int full_dataset_num_items,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce, const hash256& boundary,
+    const dataset_proof& proof) noexcept
+{
+    return is_full_dataset_num_items(full_dataset_num_items) &&
+           verify_dataset_proof_any_size(
+               root, full_dataset_num_items, header_hash, mix_hash, nonce, boundary, proof);
+}
+
+bool verify_dataset_proof_any_size(const hash256& root, int full_dataset_num_items,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce, const hash256& boundary,
+    const dataset_proof& proof) noexcept
+{
+    if (full_dataset_num_items <= 0)
+        return false;
+
+    const hash512 seed = hash_seed(header_hash, nonce);
+    if (!is_less_or_equal(hash_final(seed, mix_hash), boundary))
+        return false;
+
+    const int depth = get_dataset_merkle_depth(full_dataset_num_items);
+    if (proof.branches.size() != static_cast<size_t>(num_dataset_accesses * depth))
+        return false;
+
+    bool branches_valid = true;
+    size_t k = 0;
+    const auto proof_lookup = [&](uint32_t index) noexcept {
+        const hash1024& item = proof.items[k];
+        const hash256* const branch = proof.branches.data() + k * static_cast<size_t>(depth);
+        ++k;
+
+        hash256 node = hash_leaf(item);
+        for (int l = 0; l < depth; ++l)
+            node = ((index >> l) & 1) ? hash_node(branch[l], node) : hash_node(node, branch[l]);
+        branches_valid &= is_equal(node, root);
+        return item;
+    };
+
+    const auto num_items = static_cast<uint32_t>(full_dataset_num_items);
+    const hash256 expected_mix_hash = hash_kernel(num_items, seed, proof_lookup);
+    return branches_valid && is_equal(expected_mix_hash, mix_hash);
+}
+}  // namespace ethash
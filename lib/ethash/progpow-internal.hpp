@@ -0,0 +1,121 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The decoded ProgPoW program of a period, shared by the interpreter in progpow.cpp
+/// and the JIT compiler in progpow_jit.cpp.
+
+#pragma once
+
+#include <ethash/progpow.hpp>
+
+#include <cstdint>
+#include <memory>
+
+namespace progpow
+{
+/// The random math operations, see random_math().
+enum math_kind : uint8_t
+{
+    math_add,
+    math_mul,
+    math_mul_hi,
+    math_min,
+    math_rotl,
+    math_rotr,
+    math_and,
+    math_or,
+    math_xor,
+    math_clz,
+    math_popcount,
+};
+
+/// The random merge of the data into the mix register, decoded from the merge selector.
+struct merge_op
+{
+    /// The kind of the merge, the selector % 4.
+    uint8_t kind;
+
+    /// The rotation of the kinds 2 and 3, the additional non-zero selector from higher bits.
+    uint8_t rotation;
+};
+
+constexpr size_t num_words_per_lane = sizeof(hash2048) / (sizeof(uint32_t) * num_lanes);
+
+/// The random cache access of the program, see program.
+struct cache_op
+{
+    uint32_t src;
+    uint32_t dst;
+    merge_op merge;
+};
+
+/// The random math operation of the program, see program.
+struct math_op
+{
+    uint32_t src1;
+    uint32_t src2;
+    uint32_t dst;
+    uint8_t kind;
+    merge_op merge;
+};
+
+/// The ProgPoW program of a period.
+///
+/// All 64 rounds of all hashes in the period execute the same sequence of operations
+/// generated by the KISS99 seeded with the period number. The program is this sequence decoded
+/// once: the register indexes and the operation kinds of the cache loads, the random math
+/// and the merges of the full dataset item words. The numbers of the operations are
+/// the parameters of the revision, see revision_params.
+template <typename Revision>
+struct program
+{
+    cache_op cache_ops[Revision::num_cache_accesses];
+    math_op math_ops[Revision::num_math_operations];
+    uint32_t dag_dsts[num_words_per_lane];
+    merge_op dag_merges[num_words_per_lane];
+};
+
+/// The round of a single lane compiled to machine code.
+///
+/// Executes the cache loads, the random math and the merges of the program on the num_regs
+/// registers of the lane, then merges the num_words_per_lane words of the full dataset item
+/// selected for the lane in the round.
+using lane_round_fn = void (*)(
+    uint32_t regs[], const uint32_t* l1_cache, const uint32_t* item_words);
+
+/// The executable memory of the compiled program.
+class jit_kernel
+{
+public:
+    jit_kernel(void* code, size_t size) noexcept;
+    ~jit_kernel();
+
+    jit_kernel(const jit_kernel&) = delete;
+    jit_kernel& operator=(const jit_kernel&) = delete;
+
+    lane_round_fn lane_round() const noexcept { return m_lane_round; }
+
+private:
+    void* const m_code;
+    const size_t m_size;
+    lane_round_fn m_lane_round;
+};
+
+/// Compiles the program operations to the machine code of the lane round.
+///
+/// @return  The compiled program, or null if the JIT compiler is not available for the platform
+///          or the CPU or the executable memory cannot be allocated.
+std::shared_ptr<const jit_kernel> jit_compile(const cache_op cache_ops[], int num_cache_ops,
+    const math_op math_ops[], int num_math_ops, const uint32_t dag_dsts[],
+    const merge_op dag_merges[]) noexcept;
+
+/// Compiles the program of any revision, see jit_compile().
+template <typename Revision>
+inline std::shared_ptr<const jit_kernel> jit_compile(const program<Revision>& prog) noexcept
+{
+    return jit_compile(prog.cache_ops, Revision::num_cache_accesses, prog.math_ops,
+        Revision::num_math_operations, prog.dag_dsts, prog.dag_merges);
+}
+}  // namespace progpow
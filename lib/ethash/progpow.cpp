@@ -4,27 +4,22 @@
 
 #include <ethash/progpow.hpp>
 
+#include "../support/attributes.h"
 #include "bit_manipulation.h"
 #include "endianness.hpp"
 #include "ethash-internal.hpp"
 #include "kiss99.hpp"
+#include "progpow-internal.hpp"
+#include "progpow_simd.hpp"
 #include <ethash/keccak.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <type_traits>
 
 namespace progpow
 {
-namespace
-{
-/// A variant of Keccak hash function for ProgPoW.
-///
-/// This Keccak hash function uses 800-bit permutation (Keccak-f[800]) with 576 bitrate.
-/// It take exactly 576 bits of input (split across 3 arguments) and adds no padding.
-///
-/// @param header_hash  The 256-bit header hash.
-/// @param nonce        The 64-bit nonce.
-/// @param mix_hash     Additional 256-bits of data.
-/// @return             The 256-bit output of the hash function.
 hash256 keccak_progpow_256(
     const hash256& header_hash, uint64_t nonce, const hash256& mix_hash) noexcept
 {
@@ -51,15 +46,14 @@ hash256 keccak_progpow_256(
     return output;
 }
 
-/// The same as keccak_progpow_256() but uses null mix
-/// and returns top 64 bits of the output being a big-endian prefix of the 256-bit hash.
-inline uint64_t keccak_progpow_64(const hash256& header_hash, uint64_t nonce) noexcept
+uint64_t keccak_progpow_64(const hash256& header_hash, uint64_t nonce) noexcept
 {
     const hash256 h = keccak_progpow_256(header_hash, nonce, {});
     return be::uint64(h.word64s[0]);
 }
 
-
+namespace
+{
 /// ProgPoW mix RNG state.
 ///
 /// Encapsulates the state of the random number generator used in computing ProgPoW mix.
@@ -68,10 +62,10 @@ inline uint64_t keccak_progpow_64(const hash256& header_hash, uint64_t nonce) no
 class mix_rng_state
 {
 public:
-    inline explicit mix_rng_state(uint64_t seed) noexcept;
+    inline ALWAYS_INLINE explicit mix_rng_state(uint64_t seed) noexcept;
 
-    uint32_t next_dst() noexcept { return dst_seq[(dst_counter++) % num_regs]; }
-    uint32_t next_src() noexcept { return src_seq[(src_counter++) % num_regs]; }
+    ALWAYS_INLINE uint32_t next_dst() noexcept { return dst_seq[(dst_counter++) % num_regs]; }
+    ALWAYS_INLINE uint32_t next_src() noexcept { return src_seq[(src_counter++) % num_regs]; }
 
     kiss99 rng;
 
@@ -82,7 +76,7 @@ private:
     std::array<uint32_t, num_regs> src_seq;
 };
 
-mix_rng_state::mix_rng_state(uint64_t seed) noexcept
+inline mix_rng_state::mix_rng_state(uint64_t seed) noexcept
 {
     const auto seed_lo = static_cast<uint32_t>(seed);
     const auto seed_hi = static_cast<uint32_t>(seed >> 32);
@@ -110,33 +104,38 @@ mix_rng_state::mix_rng_state(uint64_t seed) noexcept
 }
 
 
+inline merge_op decode_merge(uint32_t selector) noexcept
+{
+    return {static_cast<uint8_t>(selector % 4), static_cast<uint8_t>((selector >> 16) % 31 + 1)};
+}
+
 NO_SANITIZE("unsigned-integer-overflow")
-inline uint32_t random_math(uint32_t a, uint32_t b, uint32_t selector) noexcept
+inline ALWAYS_INLINE uint32_t random_math(uint32_t a, uint32_t b, uint8_t kind) noexcept
 {
-    switch (selector % 11)
+    switch (kind)
     {
     default:
-    case 0:
+    case math_add:
         return a + b;
-    case 1:
+    case math_mul:
         return a * b;
-    case 2:
+    case math_mul_hi:
         return mul_hi32(a, b);
-    case 3:
+    case math_min:
         return std::min(a, b);
-    case 4:
+    case math_rotl:
         return rotl32(a, b);
-    case 5:
+    case math_rotr:
         return rotr32(a, b);
-    case 6:
+    case math_and:
         return a & b;
-    case 7:
+    case math_or:
         return a | b;
-    case 8:
+    case math_xor:
         return a ^ b;
-    case 9:
+    case math_clz:
         return clz32(a) + clz32(b);
-    case 10:
+    case math_popcount:
         return popcount32(a) + popcount32(b);
     }
 }
@@ -145,10 +144,9 @@ inline uint32_t random_math(uint32_t a, uint32_t b, uint32_t selector) noexcept
 /// Assuming `a` has high entropy, only do ops that retain entropy even if `b`
 /// has low entropy (i.e. do not do `a & b`).
 NO_SANITIZE("unsigned-integer-overflow")
-inline void random_merge(uint32_t& a, uint32_t b, uint32_t selector) noexcept
+inline ALWAYS_INLINE void random_merge(uint32_t& a, uint32_t b, merge_op op) noexcept
 {
-    const auto x = (selector >> 16) % 31 + 1;  // Additional non-zero selector from higher bits.
-    switch (selector % 4)
+    switch (op.kind)
     {
     case 0:
         a = (a * 33) + b;
@@ -157,74 +155,222 @@ inline void random_merge(uint32_t& a, uint32_t b, uint32_t selector) noexcept
         a = (a ^ b) * 33;
         break;
     case 2:
-        a = rotl32(a, x) ^ b;
+        a = rotl32(a, op.rotation) ^ b;
         break;
     case 3:
-        a = rotr32(a, x) ^ b;
+        a = rotr32(a, op.rotation) ^ b;
         break;
     }
 }
 
-using lookup_fn = hash2048 (*)(const epoch_context&, uint32_t);
+/// The larger of the numbers of the cache accesses and the math operations of the revision.
+template <typename Revision>
+constexpr int max_operations() noexcept
+{
+    return Revision::num_cache_accesses > Revision::num_math_operations ?
+               Revision::num_cache_accesses :
+               Revision::num_math_operations;
+}
+
+/// Generates the program of the period by replaying the mix RNG sequence of a round.
+template <typename Revision>
+program<Revision> generate_program(uint64_t period) noexcept
+{
+    program<Revision> prog;
+    mix_rng_state state{period};
+    for (int i = 0; i < max_operations<Revision>(); ++i)
+    {
+        if (i < Revision::num_cache_accesses)
+        {
+            auto& op = prog.cache_ops[i];
+            op.src = state.next_src();
+            op.dst = state.next_dst();
+            op.merge = decode_merge(state.rng());
+        }
+        if (i < Revision::num_math_operations)
+        {
+            // Generate 2 unique source indexes.
+            auto& op = prog.math_ops[i];
+            const auto src_rnd = state.rng() % (num_regs * (num_regs - 1));
+            op.src1 = src_rnd % num_regs;  // O <= src1 < num_regs
+            op.src2 = src_rnd / num_regs;  // 0 <= src2 < num_regs - 1
+            if (op.src2 >= op.src1)
+                ++op.src2;
+
+            op.kind = static_cast<uint8_t>(state.rng() % 11);
+            op.dst = state.next_dst();
+            op.merge = decode_merge(state.rng());
+        }
+    }
+
+    for (size_t i = 0; i < num_words_per_lane; ++i)
+    {
+        prog.dag_dsts[i] = i == 0 ? 0 : state.next_dst();
+        prog.dag_merges[i] = decode_merge(state.rng());
+    }
+    return prog;
+}
+
+/// Enables the JIT compiled lane rounds in the scalar kernels, see set_jit_enabled().
+/// Only the flag is shared between threads, the relaxed ordering is enough.
+std::atomic<bool> jit_enabled{true};
+
+/// The program of a period with its compiled lane round.
+template <typename Revision>
+struct compiled_program
+{
+    program<Revision> prog;
+
+    /// The compiled lane round, null if the JIT compiler is disabled or not available.
+    std::shared_ptr<const jit_kernel> kernel;
+};
+
+/// Returns the program of the period of the block from the cache of the thread.
+///
+/// The lane round is compiled on request, only the scalar kernels use it.
+/// The reference is valid until the next call by the same thread.
+template <typename Revision>
+const compiled_program<Revision>& get_program(int block_number, bool compile) noexcept
+{
+    struct cache_entry
+    {
+        int period;
+        bool compiled;
+        compiled_program<Revision> program;
+    };
+    thread_local cache_entry cache{-1, false, {}};
+
+    const int period = block_number / Revision::period_length;
+    if (cache.period != period)
+    {
+        cache.program.prog = generate_program<Revision>(static_cast<uint64_t>(period));
+        cache.program.kernel = nullptr;
+        cache.period = period;
+        cache.compiled = false;
+    }
+
+    if (!jit_enabled.load(std::memory_order_relaxed))
+    {
+        cache.program.kernel = nullptr;
+        cache.compiled = false;
+    }
+    else if (compile && !cache.compiled)
+    {
+        // Compiled once per period, the interpreter is used if it fails.
+        cache.program.kernel = jit_compile(cache.program.prog);
+        cache.compiled = true;
+    }
+    return cache.program;
+}
+
+// The 2048-bit full dataset item lookup policies of hash_mix(). The full context ones return
+// references to the items in the full dataset to avoid copying them.
+
+/// Computes the full dataset items from the light cache.
+struct light_lookup
+{
+    const epoch_context& context;
+
+    ALWAYS_INLINE hash2048 operator()(uint32_t index) const noexcept
+    {
+        telemetry::add(telemetry::light_items_computed, 2);
+        return calculate_dataset_item_2048(context, index);
+    }
+};
+
+/// Reads the full dataset items provided by the page fault handler.
+struct direct_lookup
+{
+    const hash2048* const full_dataset;
+
+    explicit direct_lookup(const epoch_context_full& context) noexcept
+      : full_dataset{reinterpret_cast<const hash2048*>(context.full_dataset)}
+    {}
+
+    ALWAYS_INLINE const hash2048& operator()(uint32_t index) const noexcept
+    {
+        telemetry::add(telemetry::dataset_items_cached, 2);
+        return full_dataset[index];
+    }
+};
+
+/// Reads the full dataset items generating the missing ones.
+struct lazy_lookup
+{
+    const epoch_context& context;
+    hash2048* const full_dataset;
+
+    explicit lazy_lookup(const epoch_context_full& ctx) noexcept
+      : context{ctx}, full_dataset{reinterpret_cast<hash2048*>(ctx.full_dataset)}
+    {}
+
+    ALWAYS_INLINE const hash2048& operator()(uint32_t index) const noexcept
+    {
+        hash2048& item = full_dataset[index];
+        if (item.word64s[0] == 0)
+        {
+            // TODO: Copy elision here makes it thread-safe?
+            item = calculate_dataset_item_2048(context, index);
+            telemetry::add(telemetry::dataset_items_generated, 2);
+        }
+        else
+            telemetry::add(telemetry::dataset_items_cached, 2);
+
+        return item;
+    }
+};
 
 using mix_array = std::array<std::array<uint32_t, num_regs>, num_lanes>;
 
-void round(
-    const epoch_context& context, uint32_t r, mix_array& mix, mix_rng_state state, lookup_fn lookup)
+inline uint32_t mix_word(const mix_array& mix, size_t lane, size_t reg) noexcept
+{
+    return mix[lane][reg];
+}
+
+template <typename Revision, typename Lookup>
+inline ALWAYS_INLINE void round(isa::generic, const epoch_context& context, uint32_t r,
+    mix_array& mix, const compiled_program<Revision>& compiled, const Lookup& lookup) noexcept
 {
     const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
     const uint32_t item_index = mix[r % num_lanes][0] % num_items;
-    const hash2048 item = lookup(context, item_index);
+    const auto& item = lookup(item_index);
 
-    constexpr size_t num_words_per_lane = sizeof(item) / (sizeof(uint32_t) * num_lanes);
-    constexpr int max_operations =
-        num_cache_accesses > num_math_operations ? num_cache_accesses : num_math_operations;
+    if (compiled.kernel)
+    {
+        const lane_round_fn lane_round = compiled.kernel->lane_round();
+        for (size_t l = 0; l < num_lanes; ++l)
+        {
+            const auto offset = ((l ^ r) % num_lanes) * num_words_per_lane;
+            lane_round(mix[l].data(), context.l1_cache, &item.word32s[offset]);
+        }
+        return;
+    }
+
+    const program<Revision>& prog = compiled.prog;
 
     // Process lanes.
-    for (int i = 0; i < max_operations; ++i)
+    for (int i = 0; i < max_operations<Revision>(); ++i)
     {
-        if (i < num_cache_accesses)  // Random access to cached memory.
+        if (i < Revision::num_cache_accesses)  // Random access to cached memory.
         {
-            const auto src = state.next_src();
-            const auto dst = state.next_dst();
-            const auto sel = state.rng();
-
+            const auto& op = prog.cache_ops[i];
             for (size_t l = 0; l < num_lanes; ++l)
             {
-                const size_t offset = mix[l][src] % l1_cache_num_items;
-                random_merge(mix[l][dst], le::uint32(context.l1_cache[offset]), sel);
+                const size_t offset = mix[l][op.src] % l1_cache_num_items;
+                random_merge(mix[l][op.dst], le::uint32(context.l1_cache[offset]), op.merge);
             }
         }
-        if (i < num_math_operations)  // Random math.
+        if (i < Revision::num_math_operations)  // Random math.
         {
-            // Generate 2 unique source indexes.
-            const auto src_rnd = state.rng() % (num_regs * (num_regs - 1));
-            const auto src1 = src_rnd % num_regs;  // O <= src1 < num_regs
-            auto src2 = src_rnd / num_regs;        // 0 <= src2 < num_regs - 1
-            if (src2 >= src1)
-                ++src2;
-
-            const auto sel1 = state.rng();
-            const auto dst = state.next_dst();
-            const auto sel2 = state.rng();
-
+            const auto& op = prog.math_ops[i];
             for (size_t l = 0; l < num_lanes; ++l)
             {
-                const uint32_t data = random_math(mix[l][src1], mix[l][src2], sel1);
-                random_merge(mix[l][dst], data, sel2);
+                const uint32_t data = random_math(mix[l][op.src1], mix[l][op.src2], op.kind);
+                random_merge(mix[l][op.dst], data, op.merge);
             }
         }
     }
 
-    // DAG access pattern.
-    uint32_t dsts[num_words_per_lane];
-    uint32_t sels[num_words_per_lane];
-    for (size_t i = 0; i < num_words_per_lane; ++i)
-    {
-        dsts[i] = i == 0 ? 0 : state.next_dst();
-        sels[i] = state.rng();
-    }
-
     // DAG access.
     for (size_t l = 0; l < num_lanes; ++l)
     {
@@ -232,12 +378,12 @@ void round(
         for (size_t i = 0; i < num_words_per_lane; ++i)
         {
             const auto word = le::uint32(item.word32s[offset + i]);
-            random_merge(mix[l][dsts[i]], word, sels[i]);
+            random_merge(mix[l][prog.dag_dsts[i]], word, prog.dag_merges[i]);
         }
     }
 }
 
-mix_array init_mix(uint64_t seed)
+inline ALWAYS_INLINE mix_array init_mix(isa::generic, uint64_t seed) noexcept
 {
     const uint32_t z = fnv1a(fnv_offset_basis, static_cast<uint32_t>(seed));
     const uint32_t w = fnv1a(z, static_cast<uint32_t>(seed >> 32));
@@ -255,15 +401,21 @@ mix_array init_mix(uint64_t seed)
     return mix;
 }
 
-hash256 hash_mix(
-    const epoch_context& context, int block_number, uint64_t seed, lookup_fn lookup) noexcept
+/// Reduces the per-lane FNV-1a hashes of the mix registers to the 256-bit mix hash.
+inline ALWAYS_INLINE hash256 reduce_lane_hashes(const uint32_t (&lane_hash)[num_lanes]) noexcept
 {
-    auto mix = init_mix(seed);
-    mix_rng_state state{uint64_t(block_number / period_length)};
-
-    for (uint32_t i = 0; i < 64; ++i)
-        round(context, i, mix, state, lookup);
+    static constexpr size_t num_words = sizeof(hash256) / sizeof(uint32_t);
+    hash256 mix_hash;
+    for (uint32_t& w : mix_hash.word32s)
+        w = fnv_offset_basis;
+    for (size_t l = 0; l < num_lanes; ++l)
+        mix_hash.word32s[l % num_words] = fnv1a(mix_hash.word32s[l % num_words], lane_hash[l]);
+    return le::uint32s(mix_hash);
+}
 
+/// Reduces the mix data to the 256-bit mix hash.
+inline ALWAYS_INLINE hash256 reduce_mix(isa::generic, const mix_array& mix) noexcept
+{
     // Reduce mix data to a single per-lane result.
     uint32_t lane_hash[num_lanes];
     for (size_t l = 0; l < num_lanes; ++l)
@@ -274,48 +426,715 @@ hash256 hash_mix(
     }
 
     // Reduce all lanes to a single 256-bit result.
-    static constexpr size_t num_words = sizeof(hash256) / sizeof(uint32_t);
-    hash256 mix_hash;
-    for (uint32_t& w : mix_hash.word32s)
-        w = fnv_offset_basis;
-    for (size_t l = 0; l < num_lanes; ++l)
-        mix_hash.word32s[l % num_words] = fnv1a(mix_hash.word32s[l % num_words], lane_hash[l]);
-    return le::uint32s(mix_hash);
+    return reduce_lane_hashes(lane_hash);
+}
+
+#if ETHASH_X86_64_SIMD
+// The vectors are not passed to functions other than the inlined ones of progpow_simd.hpp,
+// the ABI of passing them without the instruction set enabled does not matter.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/// The mix transposed for the vectorized rounds.
+///
+/// The words of a register of all lanes are contiguous, so the register of the consecutive
+/// lanes is a single vector. The vectorized code reads the little-endian words of the caches
+/// directly as it is compiled only for x86-64.
+struct alignas(64) lane_mix
+{
+    uint32_t regs[num_regs][num_lanes];
+};
+
+/// The vector of the consecutive lanes of the instruction set, see progpow_simd.hpp.
+template <typename Isa>
+using lanes = decltype(broadcast(Isa{}, 0));
+
+inline uint32_t mix_word(const lane_mix& mix, size_t lane, size_t reg) noexcept
+{
+    return mix.regs[reg][lane];
+}
+
+/// Merges the data into the register `dst` of the lanes, see the scalar random_merge().
+template <typename Isa>
+inline ALWAYS_INLINE void random_merge(
+    Isa, uint32_t* dst, const lanes<Isa>& data, merge_op op) noexcept
+{
+    const auto a = load_lanes(Isa{}, dst);
+    switch (op.kind)
+    {
+    default:
+    case 0:
+        store_lanes(dst, add(add(shl(a, 5), a), data));  // a * 33 + data
+        break;
+    case 1:
+    {
+        const auto x = bitwise_xor(a, data);
+        store_lanes(dst, add(shl(x, 5), x));  // (a ^ data) * 33
+        break;
+    }
+    case 2:
+        store_lanes(dst, bitwise_xor(rotl(a, unsigned{op.rotation}), data));
+        break;
+    case 3:
+        store_lanes(dst, bitwise_xor(rotr(a, unsigned{op.rotation}), data));
+        break;
+    }
+}
+
+/// Computes the random math of the registers `src1` and `src2` of the lanes,
+/// see the scalar random_math().
+template <typename Isa>
+inline ALWAYS_INLINE void random_math(Isa, lanes<Isa>& data, const uint32_t* src1,
+    const uint32_t* src2, uint8_t kind) noexcept
+{
+    const auto a = load_lanes(Isa{}, src1);
+    const auto b = load_lanes(Isa{}, src2);
+    switch (kind)
+    {
+    default:
+    case math_add:
+        data = add(a, b);
+        break;
+    case math_mul:
+        data = mul(a, b);
+        break;
+    case math_mul_hi:
+        data = mul_hi(a, b);
+        break;
+    case math_min:
+        data = minimum(a, b);
+        break;
+    case math_rotl:
+        data = rotl(a, b);
+        break;
+    case math_rotr:
+        data = rotr(a, b);
+        break;
+    case math_and:
+        data = bitwise_and(a, b);
+        break;
+    case math_or:
+        data = bitwise_or(a, b);
+        break;
+    case math_xor:
+        data = bitwise_xor(a, b);
+        break;
+    case math_clz:
+        data = add(clz(a), clz(b));
+        break;
+    case math_popcount:
+        data = add(popcount(a), popcount(b));
+        break;
+    }
+}
+
+/// The round with every operation applied to the vectors of lanes, the same as the scalar one.
+template <typename Isa, typename Revision, typename Lookup>
+inline ALWAYS_INLINE void round(Isa, const epoch_context& context, uint32_t r, lane_mix& mix,
+    const compiled_program<Revision>& compiled, const Lookup& lookup) noexcept
+{
+    const program<Revision>& prog = compiled.prog;
+    static_assert((l1_cache_num_items & (l1_cache_num_items - 1)) == 0, "");
+    static_assert(num_words_per_lane == 4, "");
+    constexpr size_t width = sizeof(lanes<Isa>) / sizeof(uint32_t);
+
+    const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
+    const uint32_t item_index = mix.regs[0][r % num_lanes] % num_items;
+    const auto& item = lookup(item_index);
+
+    const auto l1_cache_mask = broadcast(Isa{}, l1_cache_num_items - 1);
+    for (int i = 0; i < max_operations<Revision>(); ++i)
+    {
+        if (i < Revision::num_cache_accesses)
+        {
+            const auto& op = prog.cache_ops[i];
+            for (size_t l = 0; l < num_lanes; l += width)
+            {
+                const auto src = load_lanes(Isa{}, &mix.regs[op.src][l]);
+                const auto data = gather(context.l1_cache, bitwise_and(src, l1_cache_mask));
+                random_merge(Isa{}, &mix.regs[op.dst][l], data, op.merge);
+            }
+        }
+        if (i < Revision::num_math_operations)
+        {
+            const auto& op = prog.math_ops[i];
+            for (size_t l = 0; l < num_lanes; l += width)
+            {
+                lanes<Isa> data;
+                random_math(Isa{}, data, &mix.regs[op.src1][l], &mix.regs[op.src2][l], op.kind);
+                random_merge(Isa{}, &mix.regs[op.dst][l], data, op.merge);
+            }
+        }
+    }
+
+    // DAG access: the lane l merges the words of the lane (l ^ r) % num_lanes of the item.
+    for (size_t l = 0; l < num_lanes; l += width)
+    {
+        const auto lane_ids = add(lane_indexes(Isa{}), broadcast(Isa{}, static_cast<uint32_t>(l)));
+        const auto offsets = shl(bitwise_and(bitwise_xor(lane_ids, broadcast(Isa{}, r)),
+                                     broadcast(Isa{}, num_lanes - 1)),
+            2);
+        for (size_t i = 0; i < num_words_per_lane; ++i)
+        {
+            const auto word_offsets = add(offsets, broadcast(Isa{}, static_cast<uint32_t>(i)));
+            const auto data = gather(item.word32s, word_offsets);
+            random_merge(Isa{}, &mix.regs[prog.dag_dsts[i]][l], data, prog.dag_merges[i]);
+        }
+    }
+}
+
+/// Seeds the KISS99 of all lanes at once.
+///
+/// The z and w parts of the KISS99 state are the same in all lanes, so only the jsr and jcong
+/// parts are vectors.
+template <typename Isa>
+NO_SANITIZE("unsigned-integer-overflow")
+inline ALWAYS_INLINE lane_mix init_mix(Isa, uint64_t seed) noexcept
+{
+    constexpr size_t width = sizeof(lanes<Isa>) / sizeof(uint32_t);
+
+    uint32_t z = fnv1a(fnv_offset_basis, static_cast<uint32_t>(seed));
+    uint32_t w = fnv1a(z, static_cast<uint32_t>(seed >> 32));
+    const auto prime = broadcast(Isa{}, fnv_prime);
+    const auto w_lanes = broadcast(Isa{}, w);
+
+    uint32_t zw[num_regs];
+    for (auto& x : zw)
+    {
+        z = 36969 * (z & 0xffff) + (z >> 16);
+        w = 18000 * (w & 0xffff) + (w >> 16);
+        x = (z << 16) + w;
+    }
+
+    lane_mix mix;
+    for (size_t l = 0; l < num_lanes; l += width)
+    {
+        const auto lane_ids = add(lane_indexes(Isa{}), broadcast(Isa{}, static_cast<uint32_t>(l)));
+        auto jsr = mul(bitwise_xor(w_lanes, lane_ids), prime);
+        auto jcong = mul(bitwise_xor(jsr, lane_ids), prime);
+        for (size_t i = 0; i < num_regs; ++i)
+        {
+            jcong = add(mul(jcong, broadcast(Isa{}, 69069)), broadcast(Isa{}, 1234567));
+            jsr = bitwise_xor(jsr, shl(jsr, 17));
+            jsr = bitwise_xor(jsr, shr(jsr, 13));
+            jsr = bitwise_xor(jsr, shl(jsr, 5));
+            store_lanes(&mix.regs[i][l], add(bitwise_xor(broadcast(Isa{}, zw[i]), jcong), jsr));
+        }
+    }
+    return mix;
+}
+
+template <typename Isa>
+inline ALWAYS_INLINE hash256 reduce_mix(Isa, const lane_mix& mix) noexcept
+{
+    constexpr size_t width = sizeof(lanes<Isa>) / sizeof(uint32_t);
+
+    const auto prime = broadcast(Isa{}, fnv_prime);
+    alignas(64) uint32_t lane_hash[num_lanes];
+    for (size_t l = 0; l < num_lanes; l += width)
+    {
+        auto h = broadcast(Isa{}, fnv_offset_basis);
+        for (size_t i = 0; i < num_regs; ++i)
+            h = mul(bitwise_xor(h, load_lanes(Isa{}, &mix.regs[i][l])), prime);
+        store_lanes(&lane_hash[l], h);
+    }
+    return reduce_lane_hashes(lane_hash);
+}
+
+#pragma GCC diagnostic pop
+#endif
+
+/// The JIT compiled lane rounds only replace the scalar round, the vectorized ones are faster.
+template <typename Isa>
+constexpr bool uses_jit() noexcept
+{
+    return std::is_same<Isa, isa::generic>::value;
+}
+
+template <typename Revision, typename Isa, typename Lookup>
+inline ALWAYS_INLINE hash256 hash_mix(Isa, const epoch_context& context, int block_number,
+    uint64_t seed, const Lookup& lookup) noexcept
+{
+    auto mix = init_mix(Isa{}, seed);
+    const auto& prog = get_program<Revision>(block_number, uses_jit<Isa>());
+
+    for (uint32_t i = 0; i < 64; ++i)
+        round(Isa{}, context, i, mix, prog, lookup);
+    telemetry::add(telemetry::hashes, 1);
+
+    return reduce_mix(Isa{}, mix);
+}
+
+/// Reads the full dataset item computed in advance.
+struct precomputed_lookup
+{
+    const hash2048& item;
+
+    ALWAYS_INLINE const hash2048& operator()(uint32_t) const noexcept { return item; }
+};
+
+/// The number of nonces the light cache batch hashing processes in lock-step.
+constexpr size_t light_batch_size = 2;
+
+/// The ProgPoW main loop computing N mix hashes with the light cache in lock-step.
+///
+/// The full dataset items of all N nonces in a round are computed together,
+/// see ethash::calculate_dataset_items_2048().
+template <typename Revision, typename Isa, size_t N>
+inline ALWAYS_INLINE void hash_mix_light_multi(Isa, const epoch_context& context,
+    const int (&block_numbers)[N], const uint64_t (&seeds)[N], hash256 (&mix_hashes)[N]) noexcept
+{
+    const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
+
+    // The block numbers of the same period share the program. The cached program is replaced
+    // by the next get_program() call, so it is copied out only if another period follows.
+    decltype(init_mix(Isa{}, 0)) mix[N];
+    const compiled_program<Revision>* programs[N];
+    compiled_program<Revision> copies[N];
+    const compiled_program<Revision>* cached = nullptr;
+    for (size_t n = 0; n < N; ++n)
+    {
+        mix[n] = init_mix(Isa{}, seeds[n]);
+
+        const int period = block_numbers[n] / Revision::period_length;
+        size_t same = 0;
+        while (same != n && block_numbers[same] / Revision::period_length != period)
+            ++same;
+        if (same != n)
+        {
+            programs[n] = programs[same];
+            continue;
+        }
+
+        if (cached != nullptr)
+        {
+            copies[n] = *cached;
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (programs[i] == cached)
+                    programs[i] = &copies[n];
+            }
+        }
+        cached = programs[n] = &get_program<Revision>(block_numbers[n], uses_jit<Isa>());
+    }
+
+    for (uint32_t r = 0; r < 64; ++r)
+    {
+        uint32_t item_indexes[N];
+        for (size_t n = 0; n < N; ++n)
+            item_indexes[n] = mix_word(mix[n], r % num_lanes, 0) % num_items;
+
+        hash2048 items[N];
+        calculate_dataset_items_2048(context, item_indexes, items, N);
+
+        for (size_t n = 0; n < N; ++n)
+            round(Isa{}, context, r, mix[n], *programs[n], precomputed_lookup{items[n]});
+    }
+
+    for (size_t n = 0; n < N; ++n)
+        mix_hashes[n] = reduce_mix(Isa{}, mix[n]);
+    telemetry::add(telemetry::hashes, N);
+    telemetry::add(telemetry::light_items_computed, N * 64 * 2);
+}
+
+/// Computes the mix hashes of the seeds with the light cache, light_batch_size at a time.
+template <typename Revision, typename Isa>
+inline ALWAYS_INLINE void hash_mix_light_seeds(Isa, const epoch_context& context,
+    const int block_numbers[], const uint64_t seeds[], hash256 mix_hashes[],
+    size_t num_hashes) noexcept
+{
+    size_t i = 0;
+    for (; num_hashes - i >= light_batch_size; i += light_batch_size)
+    {
+        int batch_block_numbers[light_batch_size];
+        uint64_t batch_seeds[light_batch_size];
+        hash256 batch_mix_hashes[light_batch_size];
+        std::copy_n(&block_numbers[i], light_batch_size, batch_block_numbers);
+        std::copy_n(&seeds[i], light_batch_size, batch_seeds);
+        hash_mix_light_multi<Revision>(
+            Isa{}, context, batch_block_numbers, batch_seeds, batch_mix_hashes);
+        std::copy_n(batch_mix_hashes, light_batch_size, &mix_hashes[i]);
+    }
+
+    for (; i < num_hashes; ++i)
+        mix_hashes[i] = hash_mix<Revision>(
+            Isa{}, context, block_numbers[i], seeds[i], light_lookup{context});
+}
+
+/// The number of nonces the full dataset search hashes in lock-step.
+constexpr size_t search_batch_size = 8;
+
+/// Issues the prefetch of all 4 cache lines of the full dataset item.
+inline void prefetch_item(const hash2048* item) noexcept
+{
+    for (const auto& part : item->hash512s)
+        __builtin_prefetch(&part);
+}
+
+/// The ProgPoW main loop computing N mix hashes of the block with the full dataset in lock-step.
+///
+/// The full dataset item of a round is selected by the mix of the previous round,
+/// so the single-nonce loop waits for one memory load at a time. Here the rounds of N nonces
+/// are interleaved like in the Ethash search: the item for the next round of a nonce is
+/// prefetched as soon as its round is done, and is read only after the cache and math phases
+/// of the rounds of the other N - 1 nonces. This keeps N memory loads in flight.
+template <typename Revision, typename Isa, size_t N, typename Lookup>
+inline ALWAYS_INLINE void hash_mix_full_multi(Isa, const epoch_context_full& context,
+    int block_number, const uint64_t (&seeds)[N], hash256 (&mix_hashes)[N],
+    const Lookup& lookup) noexcept
+{
+    const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
+    const auto full_dataset = reinterpret_cast<const hash2048*>(context.full_dataset);
+    const auto& prog = get_program<Revision>(block_number, uses_jit<Isa>());
+
+    decltype(init_mix(Isa{}, 0)) mix[N];
+    uint32_t item_indexes[N];
+    for (size_t n = 0; n < N; ++n)
+    {
+        mix[n] = init_mix(Isa{}, seeds[n]);
+        item_indexes[n] = mix_word(mix[n], 0, 0) % num_items;
+        prefetch_item(&full_dataset[item_indexes[n]]);
+    }
+
+    for (uint32_t r = 0; r < 64; ++r)
+    {
+        const uint32_t next = r + 1;
+        for (size_t n = 0; n < N; ++n)
+        {
+            const auto& item = lookup(item_indexes[n]);
+            round(Isa{}, context, r, mix[n], prog, precomputed_lookup{item});
+
+            if (next < 64)
+            {
+                item_indexes[n] = mix_word(mix[n], next % num_lanes, 0) % num_items;
+                prefetch_item(&full_dataset[item_indexes[n]]);
+            }
+        }
+    }
+
+    for (size_t n = 0; n < N; ++n)
+        mix_hashes[n] = reduce_mix(Isa{}, mix[n]);
+    telemetry::add(telemetry::hashes, N);
+}
+
+/// Computes the mix hashes of the seeds with the full dataset. The runs of search_batch_size
+/// hashes of the same period share the program and are computed in lock-step.
+template <typename Revision, typename Isa, typename Lookup>
+inline ALWAYS_INLINE void hash_mix_full_seeds(Isa, const epoch_context_full& context,
+    const int block_numbers[], const uint64_t seeds[], hash256 mix_hashes[], size_t num_hashes,
+    const Lookup& lookup) noexcept
+{
+    size_t i = 0;
+    while (i < num_hashes)
+    {
+        const int period = block_numbers[i] / Revision::period_length;
+        size_t run_size = 1;
+        while (run_size < search_batch_size && i + run_size < num_hashes &&
+               block_numbers[i + run_size] / Revision::period_length == period)
+            ++run_size;
+
+        if (run_size == search_batch_size)
+        {
+            uint64_t batch_seeds[search_batch_size];
+            hash256 batch_mix_hashes[search_batch_size];
+            std::copy_n(&seeds[i], search_batch_size, batch_seeds);
+            hash_mix_full_multi<Revision>(
+                Isa{}, context, block_numbers[i], batch_seeds, batch_mix_hashes, lookup);
+            std::copy_n(batch_mix_hashes, search_batch_size, &mix_hashes[i]);
+            i += search_batch_size;
+            continue;
+        }
+
+        for (const size_t end = i + run_size; i < end; ++i)
+            mix_hashes[i] =
+                hash_mix<Revision>(Isa{}, context, block_numbers[i], seeds[i], lookup);
+    }
+}
+
+/// Hashes the nonces with the full dataset and calls visit(nonce, final_hash, mix_hash)
+/// for them in order until it returns false.
+template <typename Revision, typename Isa, typename Lookup, typename Visitor>
+inline ALWAYS_INLINE void search_full_nonces(Isa, const epoch_context_full& context,
+    int block_number, const hash256& header_hash, uint64_t start_nonce, size_t iterations,
+    const Lookup& lookup, Visitor& visit) noexcept
+{
+    const uint64_t end_nonce = start_nonce + iterations;
+    uint64_t nonce = start_nonce;
+
+    for (; end_nonce - nonce >= search_batch_size; nonce += search_batch_size)
+    {
+        uint64_t seeds[search_batch_size];
+        hash256 mix_hashes[search_batch_size];
+        for (size_t n = 0; n < search_batch_size; ++n)
+            seeds[n] = keccak_progpow_64(header_hash, nonce + n);
+
+        hash_mix_full_multi<Revision>(Isa{}, context, block_number, seeds, mix_hashes, lookup);
+
+        for (size_t n = 0; n < search_batch_size; ++n)
+        {
+            const hash256 final_hash = keccak_progpow_256(header_hash, seeds[n], mix_hashes[n]);
+            if (!visit(nonce + n, final_hash, mix_hashes[n]))
+                return;
+        }
+    }
+
+    for (; nonce < end_nonce; ++nonce)
+    {
+        const uint64_t seed = keccak_progpow_64(header_hash, nonce);
+        const hash256 mix_hash = hash_mix<Revision>(Isa{}, context, block_number, seed, lookup);
+        if (!visit(nonce, keccak_progpow_256(header_hash, seed, mix_hash), mix_hash))
+            return;
+    }
+}
+
+/// The search visitor stopping at the first solution.
+struct solution_visitor
+{
+    const hash256& boundary;
+    search_result solution;
+
+    bool operator()(uint64_t nonce, const hash256& final_hash, const hash256& mix_hash) noexcept
+    {
+        if (!is_less_or_equal(final_hash, boundary))
+            return true;
+        solution = {{final_hash, mix_hash}, nonce};
+        return false;
+    }
+};
+
+/// The search visitor recording all the shares until the output array is full.
+struct share_visitor
+{
+    const hash256& share_boundary;
+    const hash256& block_boundary;
+    share* const shares;
+    const size_t capacity;
+    size_t num_shares;
+
+    bool operator()(uint64_t nonce, const hash256& final_hash, const hash256& mix_hash) noexcept
+    {
+        if (!is_less_or_equal(final_hash, share_boundary))
+            return true;
+        shares[num_shares++] = {
+            nonce, final_hash, mix_hash, is_less_or_equal(final_hash, block_boundary)};
+        return num_shares != capacity;
+    }
+};
+
+/// The hot functions compiled for a specific instruction set, see ethash::kernel_table.
+struct kernel_table
+{
+    hash256 (*hash_mix_light)(
+        const epoch_context& context, int block_number, uint64_t seed) noexcept;
+    hash256 (*hash_mix_full)(
+        const epoch_context_full& context, int block_number, uint64_t seed) noexcept;
+    void (*hash_mix_light_batch)(const epoch_context& context, const int block_numbers[],
+        const uint64_t seeds[], hash256 mix_hashes[], size_t num_hashes) noexcept;
+    void (*hash_mix_full_batch)(const epoch_context_full& context, const int block_numbers[],
+        const uint64_t seeds[], hash256 mix_hashes[], size_t num_hashes) noexcept;
+    search_result (*search_full)(const epoch_context_full& context, int block_number,
+        const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+        size_t iterations) noexcept;
+    size_t (*search_shares_full)(const epoch_context_full& context, int block_number,
+        const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+        uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept;
+};
+
+/// Defines the kernel table of the instruction set NAME in the namespace NAME_kernels.
+///
+/// The ISA selects the scalar or the vectorized ProgPoW round, see progpow_simd.hpp.
+/// The x86-64-v2 level only benefits from the bit manipulation instructions in the scalar one.
+#define DEFINE_KERNELS(NAME, ISA, ATTRIBUTES)                                                      \
+    namespace NAME##_kernels                                                                       \
+    {                                                                                              \
+    template <typename Revision>                                                                   \
+    ATTRIBUTES hash256 hash_mix_light(                                                             \
+        const epoch_context& context, int block_number, uint64_t seed) noexcept                    \
+    {                                                                                              \
+        return hash_mix<Revision>(isa::ISA{}, context, block_number, seed, light_lookup{context}); \
+    }                                                                                              \
+    template <typename Revision>                                                                   \
+    ATTRIBUTES hash256 hash_mix_full(                                                              \
+        const epoch_context_full& context, int block_number, uint64_t seed) noexcept               \
+    {                                                                                              \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            return hash_mix<Revision>(                                                             \
+                isa::ISA{}, context, block_number, seed, direct_lookup{context});                  \
+        }                                                                                          \
+        return hash_mix<Revision>(isa::ISA{}, context, block_number, seed, lazy_lookup{context});  \
+    }                                                                                              \
+    template <typename Revision>                                                                   \
+    ATTRIBUTES void hash_mix_light_batch(const epoch_context& context, const int block_numbers[],  \
+        const uint64_t seeds[], hash256 mix_hashes[], size_t num_hashes) noexcept                  \
+    {                                                                                              \
+        hash_mix_light_seeds<Revision>(                                                            \
+            isa::ISA{}, context, block_numbers, seeds, mix_hashes, num_hashes);                    \
+    }                                                                                              \
+    template <typename Revision>                                                                   \
+    ATTRIBUTES void hash_mix_full_batch(const epoch_context_full& context,                         \
+        const int block_numbers[], const uint64_t seeds[], hash256 mix_hashes[],                   \
+        size_t num_hashes) noexcept                                                                \
+    {                                                                                              \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            hash_mix_full_seeds<Revision>(isa::ISA{}, context, block_numbers, seeds, mix_hashes,   \
+                num_hashes, direct_lookup{context});                                               \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            hash_mix_full_seeds<Revision>(isa::ISA{}, context, block_numbers, seeds, mix_hashes,   \
+                num_hashes, lazy_lookup{context});                                                 \
+        }                                                                                          \
+    }                                                                                              \
+    template <typename Revision>                                                                   \
+    ATTRIBUTES search_result search_full(const epoch_context_full& context, int block_number,      \
+        const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,                 \
+        size_t iterations) noexcept                                                                \
+    {                                                                                              \
+        solution_visitor visitor{boundary, {}};                                                    \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            search_full_nonces<Revision>(isa::ISA{}, context, block_number, header_hash,           \
+                start_nonce, iterations, direct_lookup{context}, visitor);                         \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            search_full_nonces<Revision>(isa::ISA{}, context, block_number, header_hash,           \
+                start_nonce, iterations, lazy_lookup{context}, visitor);                           \
+        }                                                                                          \
+        return visitor.solution;                                                                   \
+    }                                                                                              \
+    template <typename Revision>                                                                   \
+    ATTRIBUTES size_t search_shares_full(const epoch_context_full& context, int block_number,      \
+        const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,  \
+        uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept          \
+    {                                                                                              \
+        if (capacity == 0)                                                                         \
+            return 0;                                                                              \
+        share_visitor visitor{share_boundary, block_boundary, shares, capacity, 0};                \
+        if (context.full_dataset_pager)                                                            \
+        {                                                                                          \
+            search_full_nonces<Revision>(isa::ISA{}, context, block_number, header_hash,           \
+                start_nonce, iterations, direct_lookup{context}, visitor);                         \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            search_full_nonces<Revision>(isa::ISA{}, context, block_number, header_hash,           \
+                start_nonce, iterations, lazy_lookup{context}, visitor);                           \
+        }                                                                                          \
+        return visitor.num_shares;                                                                 \
+    }                                                                                              \
+    template <typename Revision>                                                                   \
+    struct revision_kernels                                                                        \
+    {                                                                                              \
+        static constexpr kernel_table table = {hash_mix_light<Revision>,                           \
+            hash_mix_full<Revision>, hash_mix_light_batch<Revision>,                               \
+            hash_mix_full_batch<Revision>, search_full<Revision>, search_shares_full<Revision>};   \
+    };                                                                                             \
+    template <typename Revision>                                                                   \
+    constexpr kernel_table revision_kernels<Revision>::table;                                      \
+    }
+
+DEFINE_KERNELS(generic, generic, )
+#if ETHASH_X86_64_SIMD
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12 reports the _mm512_undefined_epi32() in the AVX-512 intrinsics as uninitialized.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+DEFINE_KERNELS(x86_64_v2, generic, TARGET_X86_64_V2)
+DEFINE_KERNELS(x86_64_v3, avx2, TARGET_X86_64_V3)
+DEFINE_KERNELS(x86_64_v4, avx512, TARGET_X86_64_V4)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+#undef DEFINE_KERNELS
+
+/// The kernels of the revision in use, selected by ethash::set_instruction_set()
+/// when the library is loaded.
+template <typename Revision>
+struct kernels
+{
+    static const kernel_table* selected;
+};
+
+template <typename Revision>
+const kernel_table* kernels<Revision>::selected =
+    &generic_kernels::revision_kernels<Revision>::table;
+
+template <typename Revision>
+void select_revision_kernels(ethash::instruction_set set) noexcept
+{
+    auto& selected = kernels<Revision>::selected;
+    switch (set)
+    {
+    case ethash::instruction_set::generic:
+        selected = &generic_kernels::revision_kernels<Revision>::table;
+        break;
+#if ETHASH_X86_64_SIMD
+    case ethash::instruction_set::x86_64_v2:
+        selected = &x86_64_v2_kernels::revision_kernels<Revision>::table;
+        break;
+    case ethash::instruction_set::x86_64_v3:
+        selected = &x86_64_v3_kernels::revision_kernels<Revision>::table;
+        break;
+    case ethash::instruction_set::x86_64_v4:
+        selected = &x86_64_v4_kernels::revision_kernels<Revision>::table;
+        break;
+#endif
+    default:
+        break;
+    }
 }
 }  // namespace
 
+void select_kernels(ethash::instruction_set set) noexcept
+{
+    select_revision_kernels<revision_0_9_2>(set);
+    select_revision_kernels<revision_0_9_3>(set);
+}
+
+bool set_jit_enabled(bool enabled) noexcept
+{
+    const bool enable = enabled && jit_compile(generate_program<default_revision>(0)) != nullptr;
+    jit_enabled.store(enable, std::memory_order_relaxed);
+    return enable == enabled;
+}
+
+void hash_mix_light_batch(const epoch_context& context, const int block_numbers[],
+    const uint64_t seeds[], hash256 mix_hashes[], size_t num_hashes) noexcept
+{
+    kernels<default_revision>::selected->hash_mix_light_batch(
+        context, block_numbers, seeds, mix_hashes, num_hashes);
+}
+
+template <typename Revision>
 result hash(const epoch_context& context, int block_number, const hash256& header_hash,
     uint64_t nonce) noexcept
 {
     const uint64_t seed = keccak_progpow_64(header_hash, nonce);
-    const hash256 mix_hash = hash_mix(context, block_number, seed, calculate_dataset_item_2048);
+    const hash256 mix_hash =
+        kernels<Revision>::selected->hash_mix_light(context, block_number, seed);
     const hash256 final_hash = keccak_progpow_256(header_hash, seed, mix_hash);
     return {final_hash, mix_hash};
 }
 
+template <typename Revision>
 result hash(const epoch_context_full& context, int block_number, const hash256& header_hash,
     uint64_t nonce) noexcept
 {
-    static const auto lazy_lookup = [](const epoch_context& ctx, uint32_t index) noexcept
-    {
-        auto* full_dataset_1024 = static_cast<const epoch_context_full&>(ctx).full_dataset;
-        auto* full_dataset_2048 = reinterpret_cast<hash2048*>(full_dataset_1024);
-        hash2048& item = full_dataset_2048[index];
-        if (item.word64s[0] == 0)
-        {
-            // TODO: Copy elision here makes it thread-safe?
-            item = calculate_dataset_item_2048(ctx, index);
-        }
-
-        return item;
-    };
-
     const uint64_t seed = keccak_progpow_64(header_hash, nonce);
-    const hash256 mix_hash = hash_mix(context, block_number, seed, lazy_lookup);
+    const hash256 mix_hash =
+        kernels<Revision>::selected->hash_mix_full(context, block_number, seed);
     const hash256 final_hash = keccak_progpow_256(header_hash, seed, mix_hash);
     return {final_hash, mix_hash};
 }
 
+template <typename Revision>
 bool verify(const epoch_context& context, int block_number, const hash256& header_hash,
     const hash256& mix_hash, uint64_t nonce, const hash256& boundary) noexcept
 {
@@ -325,10 +1144,26 @@ bool verify(const epoch_context& context, int block_number, const hash256& heade
         return false;
 
     const hash256 expected_mix_hash =
-        hash_mix(context, block_number, seed, calculate_dataset_item_2048);
+        kernels<Revision>::selected->hash_mix_light(context, block_number, seed);
+    return is_equal(expected_mix_hash, mix_hash);
+}
+
+template <typename Revision>
+bool verify_against_difficulty(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,
+    const hash256& difficulty) noexcept
+{
+    const uint64_t seed = keccak_progpow_64(header_hash, nonce);
+    const hash256 final_hash = keccak_progpow_256(header_hash, seed, mix_hash);
+    if (!check_against_difficulty(final_hash, difficulty))
+        return false;
+
+    const hash256 expected_mix_hash =
+        kernels<Revision>::selected->hash_mix_light(context, block_number, seed);
     return is_equal(expected_mix_hash, mix_hash);
 }
 
+template <typename Revision>
 search_result search_light(const epoch_context& context, int block_number,
     const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
     size_t iterations) noexcept
@@ -336,25 +1171,255 @@ search_result search_light(const epoch_context& context, int block_number,
     const uint64_t end_nonce = start_nonce + iterations;
     for (uint64_t nonce = start_nonce; nonce < end_nonce; ++nonce)
     {
-        result r = hash(context, block_number, header_hash, nonce);
+        result r = hash<Revision>(context, block_number, header_hash, nonce);
         if (is_less_or_equal(r.final_hash, boundary))
             return {r, nonce};
     }
     return {};
 }
 
+template <typename Revision>
 search_result search(const epoch_context_full& context, int block_number,
     const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
     size_t iterations) noexcept
 {
+    return kernels<Revision>::selected->search_full(
+        context, block_number, header_hash, boundary, start_nonce, iterations);
+}
+
+template <typename Revision>
+size_t search_shares(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept
+{
+    return kernels<Revision>::selected->search_shares_full(context, block_number, header_hash,
+        share_boundary, block_boundary, start_nonce, iterations, shares, capacity);
+}
+
+template <typename Revision>
+size_t search_light_shares(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept
+{
+    size_t num_shares = 0;
     const uint64_t end_nonce = start_nonce + iterations;
-    for (uint64_t nonce = start_nonce; nonce < end_nonce; ++nonce)
+    for (uint64_t nonce = start_nonce; nonce < end_nonce && num_shares != capacity; ++nonce)
     {
-        result r = hash(context, block_number, header_hash, nonce);
-        if (is_less_or_equal(r.final_hash, boundary))
-            return {r, nonce};
+        const result r = hash<Revision>(context, block_number, header_hash, nonce);
+        if (is_less_or_equal(r.final_hash, share_boundary))
+        {
+            shares[num_shares++] = {nonce, r.final_hash, r.mix_hash,
+                is_less_or_equal(r.final_hash, block_boundary)};
+        }
     }
-    return {};
+    return num_shares;
+}
+
+#define INSTANTIATE_REVISION(REVISION)                                                             \
+    template result hash<REVISION>(const epoch_context& context, int block_number,                 \
+        const hash256& header_hash, uint64_t nonce) noexcept;                                      \
+    template result hash<REVISION>(const epoch_context_full& context, int block_number,            \
+        const hash256& header_hash, uint64_t nonce) noexcept;                                      \
+    template bool verify<REVISION>(const epoch_context& context, int block_number,                 \
+        const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,                       \
+        const hash256& boundary) noexcept;                                                         \
+    template bool verify_against_difficulty<REVISION>(const epoch_context& context,                \
+        int block_number, const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,     \
+        const hash256& difficulty) noexcept;                                                       \
+    template search_result search_light<REVISION>(const epoch_context& context, int block_number,  \
+        const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,                 \
+        size_t iterations) noexcept;                                                               \
+    template search_result search<REVISION>(const epoch_context_full& context, int block_number,   \
+        const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,                 \
+        size_t iterations) noexcept;                                                               \
+    template size_t search_shares<REVISION>(const epoch_context_full& context, int block_number,   \
+        const hash256& header_hash, const hash256& share_boundary,                                 \
+        const hash256& block_boundary, uint64_t start_nonce, size_t iterations, share* shares,     \
+        size_t capacity) noexcept;                                                                 \
+    template size_t search_light_shares<REVISION>(const epoch_context& context, int block_number,  \
+        const hash256& header_hash, const hash256& share_boundary,                                 \
+        const hash256& block_boundary, uint64_t start_nonce, size_t iterations, share* shares,     \
+        size_t capacity) noexcept;
+
+INSTANTIATE_REVISION(revision_0_9_2)
+INSTANTIATE_REVISION(revision_0_9_3)
+
+#undef INSTANTIATE_REVISION
+
+result hash(const epoch_context& context, int block_number, const hash256& header_hash,
+    uint64_t nonce) noexcept
+{
+    return hash<default_revision>(context, block_number, header_hash, nonce);
+}
+
+result hash(const epoch_context_full& context, int block_number, const hash256& header_hash,
+    uint64_t nonce) noexcept
+{
+    return hash<default_revision>(context, block_number, header_hash, nonce);
+}
+
+bool verify(const epoch_context& context, int block_number, const hash256& header_hash,
+    const hash256& mix_hash, uint64_t nonce, const hash256& boundary) noexcept
+{
+    return verify<default_revision>(context, block_number, header_hash, mix_hash, nonce, boundary);
+}
+
+bool verify_against_difficulty(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,
+    const hash256& difficulty) noexcept
+{
+    return verify_against_difficulty<default_revision>(
+        context, block_number, header_hash, mix_hash, nonce, difficulty);
+}
+
+bool verify_header_rlp(const epoch_context& context, int block_number, const uint8_t* header,
+    size_t header_size) noexcept
+{
+    header_seal seal;
+    if (!decode_header_seal(header, header_size, seal) ||
+        seal.number != static_cast<uint64_t>(block_number) ||
+        get_epoch_number(block_number) != context.epoch_number ||
+        is_equal(seal.difficulty, hash256{}))
+        return false;
+
+    return verify_against_difficulty(
+        context, block_number, seal.seal_hash, seal.mix_hash, seal.nonce, seal.difficulty);
+}
+
+search_result search_light(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations) noexcept
+{
+    return search_light<default_revision>(
+        context, block_number, header_hash, boundary, start_nonce, iterations);
+}
+
+size_t search_light_shares(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept
+{
+    return search_light_shares<default_revision>(context, block_number, header_hash,
+        share_boundary, block_boundary, start_nonce, iterations, shares, capacity);
+}
+
+size_t search_shares(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& share_boundary, const hash256& block_boundary,
+    uint64_t start_nonce, size_t iterations, share* shares, size_t capacity) noexcept
+{
+    return search_shares<default_revision>(context, block_number, header_hash, share_boundary,
+        block_boundary, start_nonce, iterations, shares, capacity);
+}
+
+search_result search(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations) noexcept
+{
+    return search<default_revision>(
+        context, block_number, header_hash, boundary, start_nonce, iterations);
 }
 
 }  // namespace progpow
+
+using namespace progpow;
+
+extern "C" {
+
+ethash_result ethash_progpow_hash(const epoch_context* context, int block_number,
+    const hash256* header_hash, uint64_t nonce) noexcept
+{
+    return hash(*context, block_number, *header_hash, nonce);
+}
+
+ethash_result ethash_progpow_hash_full(const epoch_context_full* context, int block_number,
+    const hash256* header_hash, uint64_t nonce) noexcept
+{
+    return hash(*context, block_number, *header_hash, nonce);
+}
+
+void ethash_progpow_hash_batch(const epoch_context* context, const int block_numbers[],
+    const hash256 header_hashes[], const uint64_t nonces[], size_t num_hashes,
+    ethash_result results[]) noexcept
+{
+    // The hashes are computed in chunks with the seeds and the mix hashes on the stack.
+    constexpr size_t chunk_size = 64;
+    uint64_t seeds[chunk_size];
+    hash256 mix_hashes[chunk_size];
+    for (size_t i = 0; i < num_hashes; i += chunk_size)
+    {
+        const size_t n = std::min(chunk_size, num_hashes - i);
+        for (size_t j = 0; j < n; ++j)
+            seeds[j] = keccak_progpow_64(header_hashes[i + j], nonces[i + j]);
+        hash_mix_light_batch(*context, &block_numbers[i], seeds, mix_hashes, n);
+        for (size_t j = 0; j < n; ++j)
+        {
+            results[i + j] = {
+                keccak_progpow_256(header_hashes[i + j], seeds[j], mix_hashes[j]), mix_hashes[j]};
+        }
+    }
+}
+
+void ethash_progpow_hash_full_batch(const epoch_context_full* context, const int block_numbers[],
+    const hash256 header_hashes[], const uint64_t nonces[], size_t num_hashes,
+    ethash_result results[]) noexcept
+{
+    // Like ethash_progpow_hash_batch(), with the full dataset loads of the nonces interleaved.
+    constexpr size_t chunk_size = 64;
+    uint64_t seeds[chunk_size];
+    hash256 mix_hashes[chunk_size];
+    for (size_t i = 0; i < num_hashes; i += chunk_size)
+    {
+        const size_t n = std::min(chunk_size, num_hashes - i);
+        for (size_t j = 0; j < n; ++j)
+            seeds[j] = keccak_progpow_64(header_hashes[i + j], nonces[i + j]);
+        kernels<default_revision>::selected->hash_mix_full_batch(
+            *context, &block_numbers[i], seeds, mix_hashes, n);
+        for (size_t j = 0; j < n; ++j)
+        {
+            results[i + j] = {
+                keccak_progpow_256(header_hashes[i + j], seeds[j], mix_hashes[j]), mix_hashes[j]};
+        }
+    }
+}
+
+bool ethash_progpow_verify(const epoch_context* context, int block_number,
+    const hash256* header_hash, const hash256* mix_hash, uint64_t nonce,
+    const hash256* boundary) noexcept
+{
+    return verify(*context, block_number, *header_hash, *mix_hash, nonce, *boundary);
+}
+
+bool ethash_progpow_verify_against_difficulty(const epoch_context* context, int block_number,
+    const hash256* header_hash, const hash256* mix_hash, uint64_t nonce,
+    const hash256* difficulty) noexcept
+{
+    return verify_against_difficulty(
+        *context, block_number, *header_hash, *mix_hash, nonce, *difficulty);
+}
+
+void ethash_progpow_search_light(const epoch_context* context, int block_number,
+    const hash256* header_hash, const hash256* boundary, uint64_t start_nonce, size_t iterations,
+    ethash_search_result* result) noexcept
+{
+    const search_result r =
+        search_light(*context, block_number, *header_hash, *boundary, start_nonce, iterations);
+    *result = {r.solution_found, r.nonce, r.final_hash, r.mix_hash};
+}
+
+void ethash_progpow_search(const epoch_context_full* context, int block_number,
+    const hash256* header_hash, const hash256* boundary, uint64_t start_nonce, size_t iterations,
+    ethash_search_result* result) noexcept
+{
+    const search_result r =
+        search(*context, block_number, *header_hash, *boundary, start_nonce, iterations);
+    *result = {r.solution_found, r.nonce, r.final_hash, r.mix_hash};
+}
+
+size_t ethash_progpow_search_shares(const epoch_context_full* context, int block_number,
+    const hash256* header_hash, const hash256* share_boundary, const hash256* block_boundary,
+    uint64_t start_nonce, size_t iterations, ethash_share shares[], size_t capacity) noexcept
+{
+    return search_shares(*context, block_number, *header_hash, *share_boundary, *block_boundary,
+        start_nonce, iterations, shares, capacity);
+}
+
+}  // extern "C"
@@ -0,0 +1,523 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The JIT compiler of the ProgPoW programs to the x86-64 machine code.
+///
+/// The lane round of the period program is emitted as straight-line code with the operation
+/// kinds, the register indexes and the merge rotations of the program as immediates, so nothing
+/// is decoded nor dispatched at run time. The most used mix registers are kept in the host
+/// registers for the whole round, the remaining ones are accessed in the memory.
+
+#include "progpow-internal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+#if ETHASH_PROGPOW_JIT && defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define ETHASH_PROGPOW_JIT_X86_64 1
+#else
+#define ETHASH_PROGPOW_JIT_X86_64 0
+#endif
+
+namespace progpow
+{
+jit_kernel::jit_kernel(void* code, size_t size) noexcept : m_code{code}, m_size{size}
+{
+    // ISO C++ does not allow casting the object pointer to the function pointer.
+    static_assert(sizeof(m_lane_round) == sizeof(m_code), "");
+    std::memcpy(&m_lane_round, &m_code, sizeof(m_lane_round));
+}
+
+#if ETHASH_PROGPOW_JIT_X86_64
+
+jit_kernel::~jit_kernel()
+{
+    munmap(m_code, m_size);
+}
+
+namespace
+{
+/// The x86-64 general purpose registers in the encoding order.
+enum reg : uint8_t
+{
+    rax,
+    rcx,
+    rdx,
+    rbx,
+    rsp,
+    rbp,
+    rsi,
+    rdi,
+    r8,
+    r9,
+    r10,
+    r11,
+    r12,
+    r13,
+    r14,
+    r15,
+};
+
+// The System V calling convention of lane_round_fn passes the arguments in rdi, rsi and rdx.
+constexpr reg regs_base = rdi;
+constexpr reg l1_cache_base = rsi;
+constexpr reg item_words_base = rdx;
+
+// The scratch registers: rax for the data merged, rcx for the shift counts and the second
+// operands, r11 for the mix registers kept in the memory.
+constexpr reg data_reg = rax;
+constexpr reg count_reg = rcx;
+constexpr reg scratch_reg = r11;
+
+/// The host registers for the mix registers, the callee-saved ones are saved when used.
+constexpr reg allocatable_regs[] = {r8, r9, r10, rbx, rbp, r12, r13, r14, r15};
+constexpr size_t num_allocatable_regs = sizeof(allocatable_regs) / sizeof(allocatable_regs[0]);
+
+inline bool is_callee_saved(reg r) noexcept
+{
+    return r == rbx || r == rbp || r >= r12;
+}
+
+/// The location of the mix register: the host register or the memory at [rdi + 4 * index].
+struct operand
+{
+    bool is_reg;
+    reg r;
+    uint8_t index;
+};
+
+inline operand host(reg r) noexcept
+{
+    return {true, r, 0};
+}
+
+/// The emitter of the instructions of the 32-bit operations on the registers and the mix
+/// registers in the memory, the subset of x86-64 used by the ProgPoW round.
+class assembler
+{
+public:
+    assembler(uint8_t* code, size_t capacity) noexcept : m_code{code}, m_capacity{capacity} {}
+
+    size_t size() const noexcept { return m_size; }
+    bool overflow() const noexcept { return m_size > m_capacity; }
+
+    /// Emits the instruction with the ModRM byte addressing the operand m.
+    void emit_rm(std::initializer_list<uint8_t> opcode, unsigned r, const operand& m,
+        bool wide = false, uint8_t prefix = 0) noexcept
+    {
+        if (prefix != 0)
+            emit(prefix);
+        const unsigned b = m.is_reg ? m.r : regs_base;
+        const auto rex = static_cast<uint8_t>(
+            0x40 | (wide ? 0x08 : 0) | ((r & 8) != 0 ? 0x04 : 0) | ((b & 8) != 0 ? 0x01 : 0));
+        if (rex != 0x40)
+            emit(rex);
+        for (const auto byte : opcode)
+            emit(byte);
+        if (m.is_reg)
+            emit(static_cast<uint8_t>(0xc0 | (r & 7) << 3 | (b & 7)));
+        else
+        {
+            emit(static_cast<uint8_t>(0x40 | (r & 7) << 3 | (b & 7)));
+            emit(static_cast<uint8_t>(4 * m.index));
+        }
+    }
+
+    void emit(uint8_t byte) noexcept
+    {
+        if (m_size < m_capacity)
+            m_code[m_size] = byte;
+        ++m_size;
+    }
+
+    void emit32(uint32_t x) noexcept
+    {
+        for (int i = 0; i < 4; ++i)
+            emit(static_cast<uint8_t>(x >> (8 * i)));
+    }
+
+    void mov(reg r, const operand& m) noexcept { emit_rm({0x8b}, r, m); }
+    void store(const operand& m, reg r) noexcept { emit_rm({0x89}, r, m); }
+    void add(reg r, const operand& m) noexcept { emit_rm({0x03}, r, m); }
+    void bitwise_or(reg r, const operand& m) noexcept { emit_rm({0x0b}, r, m); }
+    void bitwise_and(reg r, const operand& m) noexcept { emit_rm({0x23}, r, m); }
+    void bitwise_xor(reg r, const operand& m) noexcept { emit_rm({0x33}, r, m); }
+    void cmp(reg r, const operand& m) noexcept { emit_rm({0x3b}, r, m); }
+    void imul(reg r, const operand& m) noexcept { emit_rm({0x0f, 0xaf}, r, m); }
+    void imul64(reg r, const operand& m) noexcept { emit_rm({0x0f, 0xaf}, r, m, true); }
+    void cmova(reg r, const operand& m) noexcept { emit_rm({0x0f, 0x47}, r, m); }
+    void cmovz(reg r, const operand& m) noexcept { emit_rm({0x0f, 0x44}, r, m); }
+    void bsr(reg r, const operand& m) noexcept { emit_rm({0x0f, 0xbd}, r, m); }
+    void popcnt(reg r, const operand& m) noexcept { emit_rm({0x0f, 0xb8}, r, m, false, 0xf3); }
+    void neg(const operand& m) noexcept { emit_rm({0xf7}, 3, m); }
+
+    void imul_imm8(reg r, const operand& m, uint8_t imm) noexcept
+    {
+        emit_rm({0x6b}, r, m);
+        emit(imm);
+    }
+
+    void add_imm8(const operand& m, uint8_t imm) noexcept
+    {
+        emit_rm({0x83}, 0, m);
+        emit(imm);
+    }
+
+    void and_imm32(const operand& m, uint32_t imm) noexcept
+    {
+        emit_rm({0x81}, 4, m);
+        emit32(imm);
+    }
+
+    void shr64_imm8(const operand& m, uint8_t imm) noexcept
+    {
+        emit_rm({0xc1}, 5, m, true);
+        emit(imm);
+    }
+
+    /// Rotates by the count in cl.
+    void rotate_cl(const operand& m, bool left) noexcept { emit_rm({0xd3}, left ? 0 : 1, m); }
+
+    void rotate_imm8(const operand& m, bool left, uint8_t imm) noexcept
+    {
+        emit_rm({0xc1}, left ? 0 : 1, m);
+        emit(imm);
+    }
+
+    void mov_imm32(reg r, uint32_t imm) noexcept
+    {
+        if (r >= r8)
+            emit(0x41);
+        emit(static_cast<uint8_t>(0xb8 + (r & 7)));
+        emit32(imm);
+    }
+
+    /// Loads the word of the L1 cache: mov eax, [rsi + rcx * 4].
+    void load_l1_cache_word() noexcept
+    {
+        static_assert(data_reg == rax && count_reg == rcx && l1_cache_base == rsi, "");
+        emit(0x8b);
+        emit(0x04);
+        emit(0x8e);
+    }
+
+    /// Loads the word of the full dataset item: mov eax, [rdx + 4 * index].
+    void load_item_word(size_t index) noexcept
+    {
+        static_assert(data_reg == rax && item_words_base == rdx, "");
+        emit(0x8b);
+        emit(0x42);
+        emit(static_cast<uint8_t>(4 * index));
+    }
+
+    void push(reg r) noexcept
+    {
+        if (r >= r8)
+            emit(0x41);
+        emit(static_cast<uint8_t>(0x50 + (r & 7)));
+    }
+
+    void pop(reg r) noexcept
+    {
+        if (r >= r8)
+            emit(0x41);
+        emit(static_cast<uint8_t>(0x58 + (r & 7)));
+    }
+
+    void ret() noexcept { emit(0xc3); }
+
+private:
+    uint8_t* const m_code;
+    const size_t m_capacity;
+    size_t m_size = 0;
+};
+
+/// The operations of the program of any revision.
+struct program_ops
+{
+    const cache_op* cache_ops;
+    int num_cache_ops;
+    const math_op* math_ops;
+    int num_math_ops;
+    const uint32_t* dag_dsts;
+    const merge_op* dag_merges;
+};
+
+/// The compiler of the lane round with the mix registers allocated to the host registers.
+class compiler
+{
+public:
+    compiler(const program_ops& prog, uint8_t* code, size_t capacity) noexcept;
+
+    /// Emits the lane round. Returns the size of the code or 0 if the capacity is too small.
+    size_t compile() noexcept;
+
+private:
+    operand mix(uint32_t index) const noexcept
+    {
+        return m_alloc[index] != no_reg ? host(static_cast<reg>(m_alloc[index])) :
+                                          operand{false, rax, static_cast<uint8_t>(index)};
+    }
+
+    void random_math(const math_op& op) noexcept;
+    void random_merge(uint32_t dst, merge_op op) noexcept;
+
+    static constexpr uint8_t no_reg = 0xff;
+
+    const program_ops& m_prog;
+    assembler m_asm;
+    uint8_t m_alloc[num_regs];
+};
+
+compiler::compiler(const program_ops& prog, uint8_t* code, size_t capacity) noexcept
+  : m_prog{prog}, m_asm{code, capacity}
+{
+    // Keep the most used mix registers in the host registers.
+    unsigned uses[num_regs] = {};
+    for (int i = 0; i < prog.num_cache_ops; ++i)
+    {
+        ++uses[prog.cache_ops[i].src];
+        ++uses[prog.cache_ops[i].dst];
+    }
+    for (int i = 0; i < prog.num_math_ops; ++i)
+    {
+        ++uses[prog.math_ops[i].src1];
+        ++uses[prog.math_ops[i].src2];
+        ++uses[prog.math_ops[i].dst];
+    }
+    for (size_t i = 0; i < num_words_per_lane; ++i)
+        ++uses[prog.dag_dsts[i]];
+
+    std::memset(m_alloc, no_reg, sizeof(m_alloc));
+    for (const auto r : allocatable_regs)
+    {
+        size_t best = num_regs;
+        for (size_t i = 0; i < num_regs; ++i)
+        {
+            if (m_alloc[i] == no_reg && (best == num_regs || uses[i] > uses[best]))
+                best = i;
+        }
+        if (best == num_regs || uses[best] == 0)
+            break;
+        m_alloc[best] = r;
+    }
+}
+
+void compiler::random_math(const math_op& op) noexcept
+{
+    // Computes the data in eax.
+    const operand a = mix(op.src1);
+    const operand b = mix(op.src2);
+    switch (op.kind)
+    {
+    default:
+    case math_add:
+        m_asm.mov(data_reg, a);
+        m_asm.add(data_reg, b);
+        break;
+    case math_mul:
+        m_asm.mov(data_reg, a);
+        m_asm.imul(data_reg, b);
+        break;
+    case math_mul_hi:
+        // The 32-bit moves zero the high halves of the 64-bit registers.
+        m_asm.mov(data_reg, a);
+        m_asm.mov(count_reg, b);
+        m_asm.imul64(data_reg, host(count_reg));
+        m_asm.shr64_imm8(host(data_reg), 32);
+        break;
+    case math_min:
+        m_asm.mov(data_reg, a);
+        m_asm.cmp(data_reg, b);
+        m_asm.cmova(data_reg, b);
+        break;
+    case math_rotl:
+    case math_rotr:
+        // The rotations take the count modulo 32 like rotl32() and rotr32().
+        m_asm.mov(data_reg, a);
+        m_asm.mov(count_reg, b);
+        m_asm.rotate_cl(host(data_reg), op.kind == math_rotl);
+        break;
+    case math_and:
+        m_asm.mov(data_reg, a);
+        m_asm.bitwise_and(data_reg, b);
+        break;
+    case math_or:
+        m_asm.mov(data_reg, a);
+        m_asm.bitwise_or(data_reg, b);
+        break;
+    case math_xor:
+        m_asm.mov(data_reg, a);
+        m_asm.bitwise_xor(data_reg, b);
+        break;
+    case math_clz:
+        // The clz(x) is 31 - bsr(x), and bsr(0) is replaced with -1 to get 32.
+        // So clz(a) + clz(b) = 62 - (bsr(a) + bsr(b)).
+        m_asm.mov_imm32(count_reg, 0xffffffff);
+        m_asm.bsr(data_reg, a);
+        m_asm.cmovz(data_reg, host(count_reg));
+        m_asm.bsr(scratch_reg, b);
+        m_asm.cmovz(scratch_reg, host(count_reg));
+        m_asm.add(data_reg, host(scratch_reg));
+        m_asm.neg(host(data_reg));
+        m_asm.add_imm8(host(data_reg), 62);
+        break;
+    case math_popcount:
+        m_asm.popcnt(data_reg, a);
+        m_asm.popcnt(count_reg, b);
+        m_asm.add(data_reg, host(count_reg));
+        break;
+    }
+}
+
+void compiler::random_merge(uint32_t dst, merge_op op) noexcept
+{
+    // Merges the data in eax into the mix register.
+    const operand m = mix(dst);
+    const reg r = m.is_reg ? m.r : scratch_reg;
+    if (!m.is_reg)
+        m_asm.mov(r, m);
+
+    switch (op.kind)
+    {
+    default:
+    case 0:
+        m_asm.imul_imm8(r, host(r), 33);
+        m_asm.add(r, host(data_reg));
+        break;
+    case 1:
+        m_asm.bitwise_xor(r, host(data_reg));
+        m_asm.imul_imm8(r, host(r), 33);
+        break;
+    case 2:
+    case 3:
+        m_asm.rotate_imm8(host(r), op.kind == 2, op.rotation);
+        m_asm.bitwise_xor(r, host(data_reg));
+        break;
+    }
+
+    if (!m.is_reg)
+        m_asm.store(m, r);
+}
+
+size_t compiler::compile() noexcept
+{
+    reg saved[num_allocatable_regs];
+    size_t num_saved = 0;
+    for (size_t i = 0; i < num_regs; ++i)
+    {
+        if (m_alloc[i] == no_reg)
+            continue;
+        const auto r = static_cast<reg>(m_alloc[i]);
+        if (is_callee_saved(r))
+        {
+            m_asm.push(r);
+            saved[num_saved++] = r;
+        }
+        m_asm.mov(r, operand{false, rax, static_cast<uint8_t>(i)});
+    }
+
+    const int max_operations = std::max(m_prog.num_cache_ops, m_prog.num_math_ops);
+    for (int i = 0; i < max_operations; ++i)
+    {
+        if (i < m_prog.num_cache_ops)
+        {
+            const auto& op = m_prog.cache_ops[i];
+            m_asm.mov(count_reg, mix(op.src));
+            m_asm.and_imm32(host(count_reg), l1_cache_num_items - 1);
+            m_asm.load_l1_cache_word();
+            random_merge(op.dst, op.merge);
+        }
+        if (i < m_prog.num_math_ops)
+        {
+            const auto& op = m_prog.math_ops[i];
+            random_math(op);
+            random_merge(op.dst, op.merge);
+        }
+    }
+
+    for (size_t i = 0; i < num_words_per_lane; ++i)
+    {
+        m_asm.load_item_word(i);
+        random_merge(m_prog.dag_dsts[i], m_prog.dag_merges[i]);
+    }
+
+    for (size_t i = 0; i < num_regs; ++i)
+    {
+        if (m_alloc[i] != no_reg)
+            m_asm.store(operand{false, rax, static_cast<uint8_t>(i)}, static_cast<reg>(m_alloc[i]));
+    }
+    while (num_saved != 0)
+        m_asm.pop(saved[--num_saved]);
+    m_asm.ret();
+
+    return m_asm.overflow() ? 0 : m_asm.size();
+}
+
+/// The upper bound of the code size: the longest sequences are the clz math (30 bytes)
+/// and the merge into the mix register in the memory (14 bytes).
+inline size_t max_code_size(const program_ops& prog) noexcept
+{
+    return 64 * static_cast<size_t>(prog.num_cache_ops + prog.num_math_ops) +
+           32 * num_words_per_lane + 16 * num_regs + 64;
+}
+}  // namespace
+
+std::shared_ptr<const jit_kernel> jit_compile(const cache_op cache_ops[], int num_cache_ops,
+    const math_op math_ops[], int num_math_ops, const uint32_t dag_dsts[],
+    const merge_op dag_merges[]) noexcept
+{
+    static_assert((l1_cache_num_items & (l1_cache_num_items - 1)) == 0, "");
+    static_assert(num_regs * 4 <= 128, "the mix registers must be addressable with 8-bit offsets");
+
+    // The popcnt is the only instruction beyond the baseline x86-64.
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("popcnt"))
+        return nullptr;
+
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const program_ops prog{
+        cache_ops, num_cache_ops, math_ops, num_math_ops, dag_dsts, dag_merges};
+    const size_t size = (max_code_size(prog) + page_size - 1) / page_size * page_size;
+    void* const code =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return nullptr;
+
+    // The memory is never writable and executable at the same time.
+    compiler c{prog, static_cast<uint8_t*>(code), size};
+    if (c.compile() == 0 || mprotect(code, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, size);
+        return nullptr;
+    }
+
+    try
+    {
+        return std::make_shared<const jit_kernel>(code, size);
+    }
+    catch (...)
+    {
+        // The kernel has not taken the ownership of the code.
+        munmap(code, size);
+        return nullptr;
+    }
+}
+
+#else
+
+jit_kernel::~jit_kernel() = default;
+
+std::shared_ptr<const jit_kernel> jit_compile(const cache_op[], int, const math_op[], int,
+    const uint32_t[], const merge_op[]) noexcept
+{
+    return nullptr;
+}
+
+#endif
+}  // namespace progpow
@@ -0,0 +1,270 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The 32-bit operations on the vectors of ProgPoW lanes.
+///
+/// The ProgPoW round applies every operation identically to the same register of all lanes,
+/// so a vector holds a register of 8 (AVX2) or 16 (AVX-512) consecutive lanes. The operations
+/// are the random math, merge and gather primitives, overloaded for __m256i and __m512i.
+/// The same rules as for simd.hpp apply: these must only be executed after checking the CPU
+/// supports the instruction set and called from functions with the matching target attribute.
+
+#pragma once
+
+#include "simd.hpp"
+
+#if ETHASH_X86_64_SIMD
+
+namespace progpow
+{
+using namespace ethash;
+
+TARGET_AVX2 inline __m256i load_lanes(isa::avx2, const uint32_t* p) noexcept
+{
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 inline void store_lanes(uint32_t* p, __m256i x) noexcept
+{
+    _mm256_store_si256(reinterpret_cast<__m256i*>(p), x);
+}
+
+TARGET_AVX2 inline __m256i broadcast(isa::avx2, uint32_t x) noexcept
+{
+    return _mm256_set1_epi32(static_cast<int>(x));
+}
+
+/// Returns the vector of the lane indexes 0, 1, 2, ...
+TARGET_AVX2 inline __m256i lane_indexes(isa::avx2) noexcept
+{
+    return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+}
+
+TARGET_AVX2 inline __m256i add(__m256i a, __m256i b) noexcept
+{
+    return _mm256_add_epi32(a, b);
+}
+
+TARGET_AVX2 inline __m256i mul(__m256i a, __m256i b) noexcept
+{
+    return _mm256_mullo_epi32(a, b);
+}
+
+TARGET_AVX2 inline __m256i mul_hi(__m256i a, __m256i b) noexcept
+{
+    // The 64-bit products of the even and the odd words, the high halves blended together.
+    const __m256i even = _mm256_mul_epu32(a, b);
+    const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+}
+
+TARGET_AVX2 inline __m256i minimum(__m256i a, __m256i b) noexcept
+{
+    return _mm256_min_epu32(a, b);
+}
+
+TARGET_AVX2 inline __m256i bitwise_and(__m256i a, __m256i b) noexcept
+{
+    return _mm256_and_si256(a, b);
+}
+
+TARGET_AVX2 inline __m256i bitwise_or(__m256i a, __m256i b) noexcept
+{
+    return _mm256_or_si256(a, b);
+}
+
+TARGET_AVX2 inline __m256i bitwise_xor(__m256i a, __m256i b) noexcept
+{
+    return _mm256_xor_si256(a, b);
+}
+
+TARGET_AVX2 inline __m256i shl(__m256i x, unsigned n) noexcept
+{
+    return _mm256_sll_epi32(x, _mm_cvtsi32_si128(static_cast<int>(n)));
+}
+
+TARGET_AVX2 inline __m256i shr(__m256i x, unsigned n) noexcept
+{
+    return _mm256_srl_epi32(x, _mm_cvtsi32_si128(static_cast<int>(n)));
+}
+
+/// Rotates left by the same number of bits in 1-31 in all lanes.
+TARGET_AVX2 inline __m256i rotl(__m256i x, unsigned n) noexcept
+{
+    return _mm256_or_si256(shl(x, n), shr(x, 32 - n));
+}
+
+/// Rotates right by the same number of bits in 1-31 in all lanes.
+TARGET_AVX2 inline __m256i rotr(__m256i x, unsigned n) noexcept
+{
+    return _mm256_or_si256(shr(x, n), shl(x, 32 - n));
+}
+
+/// Rotates left by the numbers of bits in n modulo 32, like rotl32().
+TARGET_AVX2 inline __m256i rotl(__m256i x, __m256i n) noexcept
+{
+    // The variable shifts by 32 give 0, so n % 32 == 0 leaves x unchanged.
+    n = _mm256_and_si256(n, _mm256_set1_epi32(31));
+    const __m256i m = _mm256_sub_epi32(_mm256_set1_epi32(32), n);
+    return _mm256_or_si256(_mm256_sllv_epi32(x, n), _mm256_srlv_epi32(x, m));
+}
+
+/// Rotates right by the numbers of bits in n modulo 32, like rotr32().
+TARGET_AVX2 inline __m256i rotr(__m256i x, __m256i n) noexcept
+{
+    n = _mm256_and_si256(n, _mm256_set1_epi32(31));
+    const __m256i m = _mm256_sub_epi32(_mm256_set1_epi32(32), n);
+    return _mm256_or_si256(_mm256_srlv_epi32(x, n), _mm256_sllv_epi32(x, m));
+}
+
+TARGET_AVX2 inline __m256i popcount(__m256i x) noexcept
+{
+    // Count the bits of the nibbles with the lookup table and sum the bytes of each word
+    // into the top byte with the multiplication.
+    const __m256i table =
+        _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,  //
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_and_si256(x, nibble_mask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble_mask);
+    const __m256i counts =
+        _mm256_add_epi8(_mm256_shuffle_epi8(table, lo), _mm256_shuffle_epi8(table, hi));
+    return _mm256_srli_epi32(_mm256_mullo_epi32(counts, _mm256_set1_epi32(0x01010101)), 24);
+}
+
+/// Counts the leading zero bits, 32 for 0, like clz32().
+TARGET_AVX2 inline __m256i clz(__m256i x) noexcept
+{
+    // AVX2 has no lzcnt: set all the bits below the highest one and count the bits left clear.
+    x = _mm256_or_si256(x, _mm256_srli_epi32(x, 1));
+    x = _mm256_or_si256(x, _mm256_srli_epi32(x, 2));
+    x = _mm256_or_si256(x, _mm256_srli_epi32(x, 4));
+    x = _mm256_or_si256(x, _mm256_srli_epi32(x, 8));
+    x = _mm256_or_si256(x, _mm256_srli_epi32(x, 16));
+    return _mm256_sub_epi32(_mm256_set1_epi32(32), popcount(x));
+}
+
+/// Loads the words base[indexes[i]].
+TARGET_AVX2 inline __m256i gather(const uint32_t* base, __m256i indexes) noexcept
+{
+    return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), indexes, 4);
+}
+
+
+// The AVX-512 variants also require the AVX-512BW byte shuffles and the AVX-512CD lzcnt,
+// so they are compiled for the whole x86-64-v4 level.
+
+TARGET_X86_64_V4 inline __m512i load_lanes(isa::avx512, const uint32_t* p) noexcept
+{
+    return _mm512_load_si512(p);
+}
+
+TARGET_X86_64_V4 inline void store_lanes(uint32_t* p, __m512i x) noexcept
+{
+    _mm512_store_si512(p, x);
+}
+
+TARGET_X86_64_V4 inline __m512i broadcast(isa::avx512, uint32_t x) noexcept
+{
+    return _mm512_set1_epi32(static_cast<int>(x));
+}
+
+TARGET_X86_64_V4 inline __m512i lane_indexes(isa::avx512) noexcept
+{
+    return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+TARGET_X86_64_V4 inline __m512i add(__m512i a, __m512i b) noexcept
+{
+    return _mm512_add_epi32(a, b);
+}
+
+TARGET_X86_64_V4 inline __m512i mul(__m512i a, __m512i b) noexcept
+{
+    return _mm512_mullo_epi32(a, b);
+}
+
+TARGET_X86_64_V4 inline __m512i mul_hi(__m512i a, __m512i b) noexcept
+{
+    const __m512i even = _mm512_mul_epu32(a, b);
+    const __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+    return _mm512_mask_blend_epi32(0xaaaa, _mm512_srli_epi64(even, 32), odd);
+}
+
+TARGET_X86_64_V4 inline __m512i minimum(__m512i a, __m512i b) noexcept
+{
+    return _mm512_min_epu32(a, b);
+}
+
+TARGET_X86_64_V4 inline __m512i bitwise_and(__m512i a, __m512i b) noexcept
+{
+    return _mm512_and_si512(a, b);
+}
+
+TARGET_X86_64_V4 inline __m512i bitwise_or(__m512i a, __m512i b) noexcept
+{
+    return _mm512_or_si512(a, b);
+}
+
+TARGET_X86_64_V4 inline __m512i bitwise_xor(__m512i a, __m512i b) noexcept
+{
+    return _mm512_xor_si512(a, b);
+}
+
+TARGET_X86_64_V4 inline __m512i shl(__m512i x, unsigned n) noexcept
+{
+    return _mm512_sll_epi32(x, _mm_cvtsi32_si128(static_cast<int>(n)));
+}
+
+TARGET_X86_64_V4 inline __m512i shr(__m512i x, unsigned n) noexcept
+{
+    return _mm512_srl_epi32(x, _mm_cvtsi32_si128(static_cast<int>(n)));
+}
+
+TARGET_X86_64_V4 inline __m512i rotl(__m512i x, unsigned n) noexcept
+{
+    return _mm512_rolv_epi32(x, _mm512_set1_epi32(static_cast<int>(n)));
+}
+
+TARGET_X86_64_V4 inline __m512i rotr(__m512i x, unsigned n) noexcept
+{
+    return _mm512_rorv_epi32(x, _mm512_set1_epi32(static_cast<int>(n)));
+}
+
+/// The rotations of AVX-512F take the numbers of bits modulo 32 already.
+TARGET_X86_64_V4 inline __m512i rotl(__m512i x, __m512i n) noexcept
+{
+    return _mm512_rolv_epi32(x, n);
+}
+
+TARGET_X86_64_V4 inline __m512i rotr(__m512i x, __m512i n) noexcept
+{
+    return _mm512_rorv_epi32(x, n);
+}
+
+TARGET_X86_64_V4 inline __m512i popcount(__m512i x) noexcept
+{
+    const __m512i table = _mm512_broadcast_i32x4(
+        _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i nibble_mask = _mm512_set1_epi8(0x0f);
+    const __m512i lo = _mm512_and_si512(x, nibble_mask);
+    const __m512i hi = _mm512_and_si512(_mm512_srli_epi16(x, 4), nibble_mask);
+    const __m512i counts =
+        _mm512_add_epi8(_mm512_shuffle_epi8(table, lo), _mm512_shuffle_epi8(table, hi));
+    return _mm512_srli_epi32(_mm512_mullo_epi32(counts, _mm512_set1_epi32(0x01010101)), 24);
+}
+
+TARGET_X86_64_V4 inline __m512i clz(__m512i x) noexcept
+{
+    return _mm512_lzcnt_epi32(x);
+}
+
+TARGET_X86_64_V4 inline __m512i gather(const uint32_t* base, __m512i indexes) noexcept
+{
+    return _mm512_i32gather_epi32(indexes, base, 4);
+}
+}  // namespace progpow
+
+#endif
@@ -0,0 +1,287 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The multithreaded nonce search with work stealing and the preemptible search.
+
+#include "ethash-internal.hpp"
+#include "thread_pool.hpp"
+#include <ethash/progpow.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace ethash
+{
+namespace
+{
+/// The minimal number of nonces taken at once. This is the batch size of the full search.
+constexpr uint64_t min_chunk_size = 8;
+
+/// The maximal number of nonces taken at once. Limits the delay of stopping the search.
+constexpr uint64_t max_chunk_size = 1 << 16;
+
+/// The duration of hashing a chunk the chunk size is adjusted to.
+constexpr std::chrono::microseconds target_chunk_duration{1000};
+
+/// The part of the nonce range not yet taken by the owning thread.
+struct nonce_range
+{
+    std::mutex mutex;
+    uint64_t begin = 0;
+    uint64_t end = 0;
+};
+
+/// Moves the upper half of the largest remaining range of other threads to the range
+/// of the thread t. Returns false if all the ranges are empty.
+bool steal(nonce_range ranges[], unsigned num_threads, unsigned t) noexcept
+{
+    unsigned victim = t;
+    uint64_t max_remaining = 0;
+    for (unsigned v = 0; v < num_threads; ++v)
+    {
+        if (v == t)
+            continue;
+
+        std::lock_guard<std::mutex> lock{ranges[v].mutex};
+        const uint64_t remaining = ranges[v].end - ranges[v].begin;
+        if (remaining > max_remaining)
+        {
+            max_remaining = remaining;
+            victim = v;
+        }
+    }
+
+    if (max_remaining == 0)
+        return false;
+
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    {
+        // The victim could have taken more nonces in the meantime, so check again.
+        std::lock_guard<std::mutex> lock{ranges[victim].mutex};
+        const uint64_t remaining = ranges[victim].end - ranges[victim].begin;
+        end = ranges[victim].end;
+        ranges[victim].end -= remaining - remaining / 2;
+        begin = ranges[victim].end;
+    }
+
+    std::lock_guard<std::mutex> lock{ranges[t].mutex};
+    ranges[t].begin = begin;
+    ranges[t].end = end;
+    return true;
+}
+
+/// Takes up to chunk_size nonces from the range of the thread t, stealing from other threads
+/// if the range is empty. Returns false if there are no nonces left.
+bool take_chunk(nonce_range ranges[], unsigned num_threads, unsigned t, uint64_t chunk_size,
+    uint64_t& begin, uint64_t& size) noexcept
+{
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock{ranges[t].mutex};
+            if (ranges[t].begin != ranges[t].end)
+            {
+                begin = ranges[t].begin;
+                size = std::min(chunk_size, ranges[t].end - ranges[t].begin);
+                ranges[t].begin += size;
+                return true;
+            }
+        }
+
+        if (!steal(ranges, num_threads, t))
+            return false;
+    }
+}
+
+/// Searches the nonce range with search_fn(start_nonce, iterations) executed
+/// by the thread pool threads.
+template <typename SearchFn>
+parallel_search_result parallel_search(
+    uint64_t start_nonce, size_t iterations, unsigned num_threads, const SearchFn& search_fn)
+{
+    using clock = std::chrono::steady_clock;
+
+    thread_pool& pool = get_thread_pool();
+    if (num_threads == 0 || num_threads > pool.num_threads())
+        num_threads = pool.num_threads();
+    if (num_threads > iterations)
+        num_threads = std::max(static_cast<unsigned>(iterations), 1u);
+
+    std::unique_ptr<nonce_range[]> ranges{new nonce_range[num_threads]};
+    const uint64_t part_size = iterations / num_threads;
+    const uint64_t num_larger_parts = iterations % num_threads;
+    uint64_t nonce = start_nonce;
+    for (unsigned t = 0; t < num_threads; ++t)
+    {
+        ranges[t].begin = nonce;
+        nonce += part_size + (t < num_larger_parts ? 1 : 0);
+        ranges[t].end = nonce;
+    }
+
+    parallel_search_result result;
+    result.hash_counts.resize(num_threads);
+    std::atomic<bool> found{false};
+    std::mutex result_mutex;
+
+    pool.run(num_threads, [&](unsigned t) noexcept {
+        uint64_t chunk_size = min_chunk_size;
+        uint64_t num_hashes = 0;
+        uint64_t begin = 0;
+        uint64_t size = 0;
+        while (!found.load(std::memory_order_relaxed) &&
+               take_chunk(ranges.get(), num_threads, t, chunk_size, begin, size))
+        {
+            const auto start_time = clock::now();
+            const search_result r = search_fn(begin, static_cast<size_t>(size));
+            const auto duration = clock::now() - start_time;
+
+            if (r.solution_found)
+            {
+                num_hashes += r.nonce - begin + 1;
+                std::lock_guard<std::mutex> lock{result_mutex};
+                if (!found.load(std::memory_order_relaxed))
+                {
+                    result.solution = r;
+                    found.store(true, std::memory_order_relaxed);
+                }
+                break;
+            }
+            num_hashes += size;
+
+            if (duration < target_chunk_duration / 2 && chunk_size < max_chunk_size)
+                chunk_size *= 2;
+            else if (duration > target_chunk_duration && chunk_size > min_chunk_size)
+                chunk_size /= 2;
+        }
+        result.hash_counts[t] = num_hashes;
+    });
+
+    return result;
+}
+
+/// The number of nonces the full dataset search hashes between the job generation checks.
+/// This is the batch size of the full search.
+constexpr size_t full_preemption_interval = 8;
+
+/// The number of nonces the light cache search hashes between the job generation checks.
+constexpr size_t light_preemption_interval = 1;
+
+/// Searches the nonce range with search_fn(start_nonce, iterations) in chunks of Interval nonces
+/// checking the job generation before each chunk.
+template <size_t Interval, typename SearchFn>
+preemptible_search_result preemptible_search(uint64_t start_nonce, size_t iterations,
+    const std::atomic<uint64_t>& generation, uint64_t job_generation,
+    const SearchFn& search_fn) noexcept
+{
+    preemptible_search_result result;
+    while (result.num_hashes < iterations)
+    {
+        if (generation.load(std::memory_order_relaxed) != job_generation)
+        {
+            result.status = search_status::preempted;
+            return result;
+        }
+
+        const uint64_t nonce = start_nonce + result.num_hashes;
+        const size_t n = std::min(Interval, static_cast<size_t>(iterations - result.num_hashes));
+        const search_result r = search_fn(nonce, n);
+        if (r.solution_found)
+        {
+            result.status = search_status::solution_found;
+            result.solution = r;
+            result.num_hashes += r.nonce - nonce + 1;
+            return result;
+        }
+        result.num_hashes += n;
+    }
+    return result;
+}
+}  // namespace
+
+parallel_search_result search_parallel(const epoch_context_full& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads)
+{
+    return parallel_search(
+        start_nonce, iterations, num_threads, [&](uint64_t nonce, size_t n) noexcept {
+            return search(context, header_hash, boundary, nonce, n);
+        });
+}
+
+parallel_search_result search_light_parallel(const epoch_context& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads)
+{
+    return parallel_search(
+        start_nonce, iterations, num_threads, [&](uint64_t nonce, size_t n) noexcept {
+            return search_light(context, header_hash, boundary, nonce, n);
+        });
+}
+
+preemptible_search_result search_preemptible(const epoch_context_full& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept
+{
+    return preemptible_search<full_preemption_interval>(start_nonce, iterations, generation,
+        job_generation, [&](uint64_t nonce, size_t n) noexcept {
+            return search(context, header_hash, boundary, nonce, n);
+        });
+}
+
+preemptible_search_result search_light_preemptible(const epoch_context& context,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept
+{
+    return preemptible_search<light_preemption_interval>(start_nonce, iterations, generation,
+        job_generation, [&](uint64_t nonce, size_t n) noexcept {
+            return search_light(context, header_hash, boundary, nonce, n);
+        });
+}
+}  // namespace ethash
+
+namespace progpow
+{
+parallel_search_result search_parallel(const epoch_context_full& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads)
+{
+    return ethash::parallel_search(
+        start_nonce, iterations, num_threads, [&](uint64_t nonce, size_t n) noexcept {
+            return search(context, block_number, header_hash, boundary, nonce, n);
+        });
+}
+
+parallel_search_result search_light_parallel(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    unsigned num_threads)
+{
+    return ethash::parallel_search(
+        start_nonce, iterations, num_threads, [&](uint64_t nonce, size_t n) noexcept {
+            return search_light(context, block_number, header_hash, boundary, nonce, n);
+        });
+}
+
+preemptible_search_result search_preemptible(const epoch_context_full& context,
+    int block_number, const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations, const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept
+{
+    return ethash::preemptible_search<ethash::full_preemption_interval>(start_nonce, iterations,
+        generation, job_generation, [&](uint64_t nonce, size_t n) noexcept {
+            return search(context, block_number, header_hash, boundary, nonce, n);
+        });
+}
+
+preemptible_search_result search_light_preemptible(const epoch_context& context,
+    int block_number, const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations, const std::atomic<uint64_t>& generation, uint64_t job_generation) noexcept
+{
+    return ethash::preemptible_search<ethash::light_preemption_interval>(start_nonce, iterations,
+        generation, job_generation, [&](uint64_t nonce, size_t n) noexcept {
+            return search_light(context, block_number, header_hash, boundary, nonce, n);
+        });
+}
+}  // namespace progpow
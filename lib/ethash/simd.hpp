@@ -0,0 +1,216 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The FNV mixing and XOR operations on whole hashes with explicitly vectorized
+/// implementations.
+///
+/// Every operation is overloaded for the instruction set tags from the isa namespace.
+/// The AVX2 and AVX-512 variants are compiled with the function target attribute so they
+/// can be used in a binary built for the baseline x86-64 instruction set. They must only be
+/// executed after checking the CPU supports the instruction set, and to be inlined they must
+/// be called from functions having the matching target attribute.
+
+#pragma once
+
+#include "../support/attributes.h"
+#include "bit_manipulation.h"
+#include <ethash/hash_types.hpp>
+
+#if defined(__x86_64__) && __has_attribute(target)
+#define ETHASH_X86_64_SIMD 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+// The x86-64 micro-architecture levels as explicit feature lists, understood also by compilers
+// not knowing the level names. The CPU is checked for every feature of the list before
+// the kernels of the level are selected, see get_target_features().
+#define ETHASH_X86_64_V2_FEATURES "popcnt,sse3,ssse3,sse4.1,sse4.2,cx16"
+#define ETHASH_X86_64_V3_FEATURES \
+    ETHASH_X86_64_V2_FEATURES ",avx,avx2,bmi,bmi2,f16c,fma,lzcnt,movbe,xsave"
+#define ETHASH_X86_64_V4_FEATURES \
+    ETHASH_X86_64_V3_FEATURES ",avx512f,avx512bw,avx512cd,avx512dq,avx512vl"
+#define TARGET_X86_64_V2 __attribute__((target(ETHASH_X86_64_V2_FEATURES)))
+#define TARGET_X86_64_V3 __attribute__((target(ETHASH_X86_64_V3_FEATURES)))
+#define TARGET_X86_64_V4 __attribute__((target(ETHASH_X86_64_V4_FEATURES)))
+#else
+#define ETHASH_X86_64_SIMD 0
+#endif
+
+namespace ethash
+{
+namespace isa
+{
+/// Portable C++ implementation.
+struct generic
+{};
+
+/// The x86-64 AVX2 implementation.
+struct avx2
+{};
+
+/// The x86-64 AVX-512F implementation.
+struct avx512
+{};
+}  // namespace isa
+
+using ::fnv1;
+
+inline hash512 fnv1(isa::generic, const hash512& u, const hash512& v) noexcept
+{
+    hash512 r;
+    for (size_t i = 0; i < sizeof(r) / sizeof(r.word32s[0]); ++i)
+        r.word32s[i] = fnv1(u.word32s[i], v.word32s[i]);
+    return r;
+}
+
+inline hash512 bitwise_xor(isa::generic, const hash512& x, const hash512& y) noexcept
+{
+    hash512 z;
+    for (size_t i = 0; i < sizeof(z) / sizeof(z.word64s[0]); ++i)
+        z.word64s[i] = x.word64s[i] ^ y.word64s[i];
+    return z;
+}
+
+/// Mixes the data into the mix word by word with FNV-1: mix[i] = fnv1(mix[i], data[i]).
+inline void fnv1_mix(isa::generic, hash1024& mix, const hash1024& data) noexcept
+{
+    for (size_t i = 0; i < sizeof(mix) / sizeof(mix.word32s[0]); ++i)
+        mix.word32s[i] = fnv1(mix.word32s[i], data.word32s[i]);
+}
+
+/// Reduces each 4 consecutive words of the mix to a single word with FNV-1.
+inline hash256 fnv1_reduce(isa::generic, const hash1024& mix) noexcept
+{
+    static constexpr size_t num_words = sizeof(hash1024) / sizeof(uint32_t);
+
+    hash256 r;
+    for (size_t i = 0; i < num_words; i += 4)
+    {
+        const uint32_t h1 = fnv1(mix.word32s[i], mix.word32s[i + 1]);
+        const uint32_t h2 = fnv1(h1, mix.word32s[i + 2]);
+        const uint32_t h3 = fnv1(h2, mix.word32s[i + 3]);
+        r.word32s[i / 4] = h3;
+    }
+    return r;
+}
+
+
+#if ETHASH_X86_64_SIMD
+
+TARGET_AVX2 inline __m256i fnv1_avx2(__m256i u, __m256i v) noexcept
+{
+    return _mm256_xor_si256(_mm256_mullo_epi32(u, _mm256_set1_epi32(int(fnv_prime))), v);
+}
+
+TARGET_AVX2 inline __m256i load_avx2(const void* p) noexcept
+{
+    return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 inline void store_avx2(void* p, __m256i x) noexcept
+{
+    _mm256_storeu_si256(static_cast<__m256i*>(p), x);
+}
+
+TARGET_AVX2 inline hash512 fnv1(isa::avx2, const hash512& u, const hash512& v) noexcept
+{
+    hash512 r;
+    store_avx2(&r.word32s[0], fnv1_avx2(load_avx2(&u.word32s[0]), load_avx2(&v.word32s[0])));
+    store_avx2(&r.word32s[8], fnv1_avx2(load_avx2(&u.word32s[8]), load_avx2(&v.word32s[8])));
+    return r;
+}
+
+TARGET_AVX2 inline hash512 bitwise_xor(isa::avx2, const hash512& x, const hash512& y) noexcept
+{
+    hash512 z;
+    for (size_t i = 0; i < 16; i += 8)
+    {
+        const __m256i a = load_avx2(&x.word32s[i]);
+        const __m256i b = load_avx2(&y.word32s[i]);
+        store_avx2(&z.word32s[i], _mm256_xor_si256(a, b));
+    }
+    return z;
+}
+
+TARGET_AVX2 inline void fnv1_mix(isa::avx2, hash1024& mix, const hash1024& data) noexcept
+{
+    for (size_t i = 0; i < 32; i += 8)
+    {
+        const __m256i m = load_avx2(&mix.word32s[i]);
+        const __m256i d = load_avx2(&data.word32s[i]);
+        store_avx2(&mix.word32s[i], fnv1_avx2(m, d));
+    }
+}
+
+TARGET_AVX2 inline hash256 fnv1_reduce(isa::avx2, const hash1024& mix) noexcept
+{
+    // The mix is 8 rows of 4 words. Place rows r and r + 4 in the lanes of 4 vectors
+    // and transpose the rows in each lane to get the 4 columns of all the 8 rows.
+    const __m256i v0 = load_avx2(&mix.word32s[0]);
+    const __m256i v1 = load_avx2(&mix.word32s[8]);
+    const __m256i v2 = load_avx2(&mix.word32s[16]);
+    const __m256i v3 = load_avx2(&mix.word32s[24]);
+
+    const __m256i r04 = _mm256_permute2x128_si256(v0, v2, 0x20);
+    const __m256i r15 = _mm256_permute2x128_si256(v0, v2, 0x31);
+    const __m256i r26 = _mm256_permute2x128_si256(v1, v3, 0x20);
+    const __m256i r37 = _mm256_permute2x128_si256(v1, v3, 0x31);
+
+    const __m256i t0 = _mm256_unpacklo_epi32(r04, r15);
+    const __m256i t1 = _mm256_unpackhi_epi32(r04, r15);
+    const __m256i t2 = _mm256_unpacklo_epi32(r26, r37);
+    const __m256i t3 = _mm256_unpackhi_epi32(r26, r37);
+
+    const __m256i c0 = _mm256_unpacklo_epi64(t0, t2);
+    const __m256i c1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i c2 = _mm256_unpacklo_epi64(t1, t3);
+    const __m256i c3 = _mm256_unpackhi_epi64(t1, t3);
+
+    hash256 r;
+    store_avx2(&r.word32s[0], fnv1_avx2(fnv1_avx2(fnv1_avx2(c0, c1), c2), c3));
+    return r;
+}
+
+
+TARGET_AVX512 inline __m512i fnv1_avx512(__m512i u, __m512i v) noexcept
+{
+    return _mm512_xor_si512(_mm512_mullo_epi32(u, _mm512_set1_epi32(int(fnv_prime))), v);
+}
+
+TARGET_AVX512 inline hash512 fnv1(isa::avx512, const hash512& u, const hash512& v) noexcept
+{
+    hash512 r;
+    _mm512_storeu_si512(r.word32s,
+        fnv1_avx512(_mm512_loadu_si512(u.word32s), _mm512_loadu_si512(v.word32s)));
+    return r;
+}
+
+TARGET_AVX512 inline hash512 bitwise_xor(isa::avx512, const hash512& x, const hash512& y) noexcept
+{
+    hash512 z;
+    _mm512_storeu_si512(
+        z.word32s, _mm512_xor_si512(_mm512_loadu_si512(x.word32s), _mm512_loadu_si512(y.word32s)));
+    return z;
+}
+
+TARGET_AVX512 inline void fnv1_mix(isa::avx512, hash1024& mix, const hash1024& data) noexcept
+{
+    for (size_t i = 0; i < 32; i += 16)
+    {
+        const __m512i m = _mm512_loadu_si512(&mix.word32s[i]);
+        const __m512i d = _mm512_loadu_si512(&data.word32s[i]);
+        _mm512_storeu_si512(&mix.word32s[i], fnv1_avx512(m, d));
+    }
+}
+
+TARGET_AVX512 inline hash256 fnv1_reduce(isa::avx512, const hash1024& mix) noexcept
+{
+    // AVX-512F implies AVX2, the 256-bit transposition is the best fit here.
+    return fnv1_reduce(isa::avx2{}, mix);
+}
+
+#endif
+}  // namespace ethash
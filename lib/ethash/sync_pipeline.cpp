@@ -0,0 +1,295 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include <ethash/sync_pipeline.hpp>
+
+#include "verify-internal.hpp"
+
+#include <algorithm>
+
+namespace ethash
+{
+namespace
+{
+sync_pipeline_options sanitize(sync_pipeline_options options) noexcept
+{
+    options.max_resident_contexts = std::max<size_t>(options.max_resident_contexts, 1);
+    options.num_build_threads = std::max(options.num_build_threads, 1u);
+    if (options.num_verify_threads == 0)
+        options.num_verify_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    options.max_pending = std::max<size_t>(options.max_pending, 1);
+    return options;
+}
+
+/// Computes the validity of at most verification_chunk_size seals of the same epoch
+/// in lock-step.
+template <typename Algorithm>
+void verify_chunk(const epoch_context& context, const verification_request* const requests[],
+    bool valid[], size_t n) noexcept
+{
+    typename Algorithm::seed_type seeds[verification_chunk_size];
+    bool final_valid[verification_chunk_size];
+    for (size_t i = 0; i < n; ++i)
+    {
+        seeds[i] = Algorithm::seed(*requests[i]);
+        final_valid[i] = Algorithm::verify_final_hash(*requests[i], seeds[i]);
+    }
+
+    Algorithm::verify_mix_hashes(context, requests, seeds, n, valid);
+
+    for (size_t i = 0; i < n; ++i)
+        valid[i] = valid[i] && final_valid[i];
+}
+}  // namespace
+
+sync_pipeline::sync_pipeline(const sync_pipeline_options& opts) : options{sanitize(opts)}
+{
+    try
+    {
+        for (unsigned i = 0; i < options.num_build_threads; ++i)
+            threads.emplace_back(&sync_pipeline::build, this);
+        for (unsigned i = 0; i < options.num_verify_threads; ++i)
+            threads.emplace_back(&sync_pipeline::verify, this);
+    }
+    catch (...)
+    {
+        // The destructor is not run for the partially constructed pipeline.
+        stop();
+        throw;
+    }
+}
+
+sync_pipeline::~sync_pipeline()
+{
+    stop();
+}
+
+void sync_pipeline::stop() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    build_needed.notify_all();
+    work_available.notify_all();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+bool sync_pipeline::can_push() const noexcept
+{
+    return entries.size() < options.max_pending;
+}
+
+void sync_pipeline::push_locked(const verification_request& request)
+{
+    entry e{request, 0, false, false, false, false};
+    if (request.block_number < 0)
+    {
+        e.claimed = true;
+        e.done = true;
+    }
+    else
+        e.epoch_number = get_epoch_number(request.block_number);
+    entries.push_back(e);
+
+    if (e.done)
+    {
+        while (first_unclaimed != entries.size() && entries[first_unclaimed].claimed)
+            ++first_unclaimed;
+        result_ready.notify_one();
+        return;
+    }
+
+    build_needed.notify_one();
+    work_available.notify_one();
+}
+
+void sync_pipeline::push(const verification_request& request)
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    space_available.wait(lock, [this] { return can_push(); });
+    push_locked(request);
+}
+
+bool sync_pipeline::try_push(const verification_request& request)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    if (!can_push())
+        return false;
+    push_locked(request);
+    return true;
+}
+
+void sync_pipeline::close()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        closed = true;
+    }
+    result_ready.notify_all();
+}
+
+bool sync_pipeline::pop(sync_result& out)
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    result_ready.wait(lock, [this] {
+        return entries.empty() ? closed : entries.front().done;
+    });
+    if (entries.empty())
+        return false;
+
+    const entry& e = entries.front();
+    out = {e.request, e.valid, e.error};
+    entries.pop_front();
+    --first_unclaimed;
+    space_available.notify_one();
+    return true;
+}
+
+sync_pipeline::stats sync_pipeline::get_stats() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return counters;
+}
+
+sync_pipeline::resident_context* sync_pipeline::find_context(int epoch_number) noexcept
+{
+    for (auto& c : contexts)
+    {
+        if (c.epoch_number == epoch_number)
+            return &c;
+    }
+    return nullptr;
+}
+
+bool sync_pipeline::reserve_context(int& epoch_number) noexcept
+{
+    auto it = entries.begin() + static_cast<std::ptrdiff_t>(first_unclaimed);
+    for (; it != entries.end(); ++it)
+    {
+        if (!it->claimed && find_context(it->epoch_number) == nullptr)
+            break;
+    }
+    if (it == entries.end())
+        return false;
+
+    if (contexts.size() >= options.max_resident_contexts)
+    {
+        // Evict a built context without unverified seals.
+        const auto unused = std::find_if(contexts.begin(), contexts.end(),
+            [this](const resident_context& c) {
+                return !c.building && std::none_of(entries.begin(), entries.end(),
+                                          [&c](const entry& e) {
+                                              return !e.done && e.epoch_number == c.epoch_number;
+                                          });
+            });
+        if (unused == contexts.end())
+            return false;
+        contexts.erase(unused);
+    }
+
+    epoch_number = it->epoch_number;
+    contexts.push_back({epoch_number, nullptr, true});
+    counters.peak_resident_contexts = std::max(counters.peak_resident_contexts, contexts.size());
+    return true;
+}
+
+size_t sync_pipeline::claim(entry* claimed[], const epoch_context*& context) noexcept
+{
+    size_t n = 0;
+    for (size_t i = first_unclaimed; i != entries.size() && n != verification_chunk_size; ++i)
+    {
+        entry& e = entries[i];
+        if (e.claimed)
+            continue;
+
+        if (n == 0)
+        {
+            const resident_context* const c = find_context(e.epoch_number);
+            if (c == nullptr || c->building)
+                continue;
+            context = c->context.get();
+        }
+        else if (e.epoch_number != claimed[0]->epoch_number)
+            continue;
+
+        e.claimed = true;
+        claimed[n++] = &e;
+    }
+
+    while (first_unclaimed != entries.size() && entries[first_unclaimed].claimed)
+        ++first_unclaimed;
+    return n;
+}
+
+void sync_pipeline::build() noexcept
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true)
+    {
+        int epoch_number = 0;
+        build_needed.wait(lock, [&] { return stopping || reserve_context(epoch_number); });
+        if (stopping)
+            return;
+
+        lock.unlock();
+        std::shared_ptr<const epoch_context> context = create_epoch_context(epoch_number);
+        lock.lock();
+
+        resident_context* const c = find_context(epoch_number);
+        c->context = std::move(context);
+        c->building = false;
+        if (c->context)
+            ++counters.contexts_built;
+        else
+            ++counters.build_failures;
+        work_available.notify_all();
+    }
+}
+
+void sync_pipeline::verify() noexcept
+{
+    entry* claimed[verification_chunk_size];
+    const verification_request* requests[verification_chunk_size];
+    bool valid[verification_chunk_size];
+
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true)
+    {
+        // The context stays resident while the claimed seals are not done.
+        const epoch_context* context = nullptr;
+        size_t n = 0;
+        work_available.wait(lock, [&] { return stopping || (n = claim(claimed, context)) != 0; });
+        if (stopping)
+            return;
+
+        // The entries keep their addresses while other entries are added and taken.
+        for (size_t i = 0; i < n; ++i)
+            requests[i] = &claimed[i]->request;
+
+        lock.unlock();
+        if (context == nullptr)
+            std::fill_n(valid, n, false);
+        else if (options.progpow)
+            verify_chunk<progpow_algorithm>(*context, requests, valid, n);
+        else
+            verify_chunk<ethash_algorithm>(*context, requests, valid, n);
+        lock.lock();
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            claimed[i]->valid = valid[i];
+            claimed[i]->error = context == nullptr;
+            claimed[i]->done = true;
+        }
+        if (entries.front().done)
+            result_ready.notify_one();
+
+        // Finished epochs may release context slots.
+        build_needed.notify_all();
+    }
+}
+}  // namespace ethash
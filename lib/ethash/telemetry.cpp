@@ -0,0 +1,110 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include "telemetry.hpp"
+#include <ethash/ethash.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace ethash
+{
+namespace telemetry
+{
+thread_local shard* current_shard = nullptr;
+
+namespace
+{
+/// Set when the shard of the thread is retired at the thread exit.
+thread_local bool shard_retired = false;
+}  // namespace
+
+namespace
+{
+/// The shards of the live threads and the sums of the shards of the exited threads.
+struct registry
+{
+    std::mutex mutex;
+    std::vector<const shard*> shards;
+    uint64_t retired[num_counters] = {};
+
+    /// Counts the additions of the threads during their exit, after their shards are gone.
+    /// Shared by the exiting threads, so updated with atomic additions.
+    shard orphan{};
+};
+
+/// Returns the registry, never destroyed: the threads of the static thread pools retire
+/// their shards at the exit, possibly after the destruction of the other statics.
+registry& get_registry() noexcept
+{
+    static registry& r = *new registry;
+    return r;
+}
+
+/// The owner of the thread's shard, retiring it on thread exit.
+struct shard_owner
+{
+    shard counters{};
+
+    ~shard_owner()
+    {
+        auto& r = get_registry();
+        std::lock_guard<std::mutex> lock{r.mutex};
+        for (size_t i = 0; i < num_counters; ++i)
+            r.retired[i] += counters.values[i].load(std::memory_order_relaxed);
+        r.shards.erase(std::find(r.shards.begin(), r.shards.end(), &counters));
+        current_shard = nullptr;
+        shard_retired = true;
+    }
+};
+}  // namespace
+
+void add_without_shard(counter c, uint64_t n) noexcept
+{
+    if (shard_retired)
+    {
+        get_registry().orphan.values[c].fetch_add(n, std::memory_order_relaxed);
+        return;
+    }
+
+    thread_local shard_owner owner;
+    {
+        auto& r = get_registry();
+        std::lock_guard<std::mutex> lock{r.mutex};
+        r.shards.push_back(&owner.counters);
+    }
+    current_shard = &owner.counters;
+    owner.counters.values[c].store(n, std::memory_order_relaxed);
+}
+}  // namespace telemetry
+
+telemetry_snapshot get_telemetry() noexcept
+{
+    using namespace telemetry;
+
+    telemetry_snapshot snapshot;
+    if (!enabled)
+        return snapshot;
+
+    uint64_t values[num_counters] = {};
+    auto& r = get_registry();
+    {
+        std::lock_guard<std::mutex> lock{r.mutex};
+        for (size_t i = 0; i < num_counters; ++i)
+        {
+            values[i] = r.retired[i] + r.orphan.values[i].load(std::memory_order_relaxed);
+            for (const shard* s : r.shards)
+                values[i] += s->values[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    snapshot.enabled = true;
+    snapshot.num_hashes = values[hashes];
+    snapshot.dataset_items_generated = values[dataset_items_generated];
+    snapshot.dataset_items_cached = values[dataset_items_cached];
+    snapshot.light_items_computed = values[light_items_computed];
+    return snapshot;
+}
+}  // namespace ethash
@@ -0,0 +1,69 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The telemetry counters, see ethash::get_telemetry().
+///
+/// The counters are compiled in only if the library is built with ETHASH_TELEMETRY,
+/// otherwise add() does nothing.
+
+#pragma once
+
+#include "../support/attributes.h"
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef ETHASH_TELEMETRY
+#define ETHASH_TELEMETRY 0
+#endif
+
+namespace ethash
+{
+namespace telemetry
+{
+constexpr bool enabled = ETHASH_TELEMETRY;
+
+enum counter
+{
+    hashes,
+    dataset_items_generated,
+    dataset_items_cached,
+    light_items_computed,
+    num_counters
+};
+
+/// The counters of a single thread.
+///
+/// Only the owning thread modifies the counters so incrementing them is a plain load and store,
+/// the atomics only make reading them from the other threads well-defined.
+struct shard
+{
+    std::atomic<uint64_t> values[num_counters];
+};
+
+/// The shard of the current thread, null until the thread counts something
+/// and again after the shard is retired at the thread exit.
+extern thread_local shard* current_shard;
+
+/// Adds n to the counter c of the current thread having no shard.
+///
+/// Registers the shard of the thread. During the thread exit, after the shard is retired,
+/// adds to the counters shared by the exiting threads instead.
+void add_without_shard(counter c, uint64_t n) noexcept;
+
+/// Adds n to the counter c of the current thread.
+inline ALWAYS_INLINE void add(counter c, uint64_t n) noexcept
+{
+    if (!enabled)
+        return;
+
+    shard* s = current_shard;
+    if (s == nullptr)
+        return add_without_shard(c, n);
+    auto& value = s->values[c];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+}  // namespace telemetry
+}  // namespace ethash
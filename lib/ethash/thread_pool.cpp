@@ -0,0 +1,161 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace ethash
+{
+thread_pool::thread_pool(unsigned num_threads)
+{
+    try
+    {
+        for (unsigned i = 1; i < num_threads; ++i)
+            threads.emplace_back(&thread_pool::work, this);
+    }
+    catch (...)
+    {
+        // Continue with the threads already started, in the worst case with the thread
+        // calling run() only.
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    job_available.notify_all();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+void thread_pool::run(unsigned num_tasks, const std::function<void(unsigned)>& task)
+{
+    if (num_tasks == 0)
+        return;
+
+    job j{&task, num_tasks, 0, num_tasks};
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        jobs.push_back(&j);
+    }
+    if (num_tasks > 1)
+        job_available.notify_all();
+
+    // Execute the tasks not taken by the pool threads.
+    std::unique_lock<std::mutex> lock{mutex};
+    while (j.next_task != j.num_tasks)
+    {
+        const unsigned index = take_task(j);
+        lock.unlock();
+        task(index);
+        lock.lock();
+        --j.num_pending_tasks;
+    }
+
+    job_done.wait(lock, [&j] { return j.num_pending_tasks == 0; });
+}
+
+unsigned thread_pool::take_task(job& j) noexcept
+{
+    const unsigned index = j.next_task++;
+    if (j.next_task == j.num_tasks)
+        jobs.erase(std::find(jobs.begin(), jobs.end(), &j));
+    return index;
+}
+
+void thread_pool::work() noexcept
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true)
+    {
+        job_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping)
+            return;
+
+        job& j = *jobs.front();
+        const unsigned index = take_task(j);
+        lock.unlock();
+        (*j.task)(index);
+        lock.lock();
+        if (--j.num_pending_tasks == 0)
+            job_done.notify_all();
+    }
+}
+
+task_queue::task_queue(unsigned num_threads)
+{
+    try
+    {
+        for (unsigned i = 0; i < num_threads; ++i)
+            threads.emplace_back(&task_queue::work, this);
+    }
+    catch (...)
+    {
+        // Stop the threads already started, the destructor is not called.
+        stop();
+        throw;
+    }
+}
+
+task_queue::~task_queue()
+{
+    stop();
+}
+
+void task_queue::stop() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    task_available.notify_all();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+void task_queue::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        tasks.push_back(std::move(task));
+    }
+    task_available.notify_one();
+}
+
+void task_queue::work() noexcept
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            task_available.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping)
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+thread_pool& get_thread_pool()
+{
+    static thread_pool pool{std::max(std::thread::hardware_concurrency(), 1u)};
+    return pool;
+}
+
+task_queue& get_build_queue()
+{
+    static task_queue queue{2};
+    return queue;
+}
+}  // namespace ethash
@@ -0,0 +1,121 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The internal thread pool executing parallel jobs.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ethash
+{
+/// The fixed set of threads executing jobs split into indexed tasks.
+///
+/// A job is executed by the pool threads together with the thread calling run().
+/// The jobs of concurrent run() calls share the pool threads, which take the tasks of
+/// the jobs in the order the jobs were started. The thread calling run() executes the tasks
+/// of its own job until all are taken, so run() may also be called from inside a task.
+class thread_pool
+{
+public:
+    /// Creates the pool of num_threads threads including the thread calling run(),
+    /// i.e. num_threads - 1 threads are started. If starting a thread fails, the pool uses
+    /// the threads started before, see num_threads().
+    explicit thread_pool(unsigned num_threads);
+
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /// The number of threads executing a job, including the thread calling run().
+    unsigned num_threads() const noexcept { return static_cast<unsigned>(threads.size()) + 1; }
+
+    /// Executes task(i) for all i in [0, num_tasks) and waits for all the tasks to finish.
+    ///
+    /// The tasks are distributed to the threads in the order of the indexes, the task 0 is
+    /// executed first. If there are more tasks than free threads, the remaining tasks start when
+    /// some threads have finished their previous tasks, in the worst case all the tasks are
+    /// executed by the calling thread. The task must not throw exceptions.
+    void run(unsigned num_tasks, const std::function<void(unsigned)>& task);
+
+private:
+    /// The state of the job of a run() call, kept on the stack of the calling thread.
+    struct job
+    {
+        const std::function<void(unsigned)>* task;
+        unsigned num_tasks;
+        unsigned next_task;
+        unsigned num_pending_tasks;
+    };
+
+    void work() noexcept;
+
+    /// Takes the next task of the job, removes the job from the queue when all are taken.
+    /// Must be called with the mutex locked.
+    unsigned take_task(job& j) noexcept;
+
+    std::vector<std::thread> threads;
+
+    /// Protects the jobs and the state of the jobs.
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable job_done;
+
+    /// The jobs with tasks not taken yet, in the order of the run() calls.
+    std::deque<job*> jobs;
+    bool stopping = false;
+};
+
+/// The fixed set of threads executing independent tasks in the order of submission.
+///
+/// Unlike with thread_pool, the thread submitting a task does not wait for it. The tasks
+/// pending when the queue is destroyed are not executed, but the destructor waits for
+/// the tasks being executed. For the build queue destroyed at the process exit this may
+/// take as long as building the full dataset; the build cannot be abandoned as it uses
+/// the global context caches, destroyed after the queue.
+class task_queue
+{
+public:
+    /// Starts the threads, throws std::system_error if any of them cannot be started.
+    explicit task_queue(unsigned num_threads);
+
+    ~task_queue();
+
+    task_queue(const task_queue&) = delete;
+    task_queue& operator=(const task_queue&) = delete;
+
+    /// Schedules the task. The task must not throw exceptions.
+    void submit(std::function<void()> task);
+
+private:
+    void work() noexcept;
+
+    /// Stops and joins the threads.
+    void stop() noexcept;
+
+    std::vector<std::thread> threads;
+
+    /// Protects the tasks and the stopping flag.
+    std::mutex mutex;
+    std::condition_variable task_available;
+
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+};
+
+/// Returns the thread pool shared by the library with the number of threads matching
+/// the hardware concurrency. The pool is created on first use.
+thread_pool& get_thread_pool();
+
+/// Returns the task queue building the global epoch contexts in the background, with 2 threads
+/// so the contexts of different epochs are built in parallel. The queue is created on first use.
+task_queue& get_build_queue();
+}  // namespace ethash
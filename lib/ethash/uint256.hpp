@@ -0,0 +1,261 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The minimal 256-bit unsigned integer arithmetic needed for difficulty conversions.
+///
+/// The numbers are stored as 4 64-bit words, the least significant word first.
+/// Everything works on fixed-size arrays, nothing allocates.
+
+#pragma once
+
+#include "bit_manipulation.h"
+#include "endianness.hpp"
+
+#include <cstdint>
+
+namespace ethash
+{
+struct uint256
+{
+    uint64_t words[4];
+};
+
+inline uint256 uint256_from_be(const hash256& h) noexcept
+{
+    return {{be::uint64(h.word64s[3]), be::uint64(h.word64s[2]), be::uint64(h.word64s[1]),
+        be::uint64(h.word64s[0])}};
+}
+
+inline hash256 uint256_to_be(const uint256& x) noexcept
+{
+    hash256 h;
+    for (size_t i = 0; i < 4; ++i)
+        h.word64s[3 - i] = be::uint64(x.words[i]);
+    return h;
+}
+
+inline bool is_zero(const uint256& x) noexcept
+{
+    return (x.words[0] | x.words[1] | x.words[2] | x.words[3]) == 0;
+}
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 uint128;
+#endif
+
+/// Returns the number of leading 0-bits in x, 64 if x is 0.
+inline unsigned clz64(uint64_t x) noexcept
+{
+    const auto hi = static_cast<uint32_t>(x >> 32);
+    return hi != 0 ? clz32(hi) : 32 + clz32(static_cast<uint32_t>(x));
+}
+
+/// Returns the low word of the 128-bit product a * b and stores the high word in hi.
+inline uint64_t umul(uint64_t a, uint64_t b, uint64_t& hi) noexcept
+{
+#ifdef __SIZEOF_INT128__
+    const uint128 p = static_cast<uint128>(a) * b;
+    hi = static_cast<uint64_t>(p >> 64);
+    return static_cast<uint64_t>(p);
+#else
+    const uint64_t al = a & 0xffffffff;
+    const uint64_t ah = a >> 32;
+    const uint64_t bl = b & 0xffffffff;
+    const uint64_t bh = b >> 32;
+
+    const uint64_t ll = al * bl;
+    const uint64_t lh = al * bh;
+    const uint64_t hl = ah * bl;
+    const uint64_t hh = ah * bh;
+
+    const uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+    hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return (mid << 32) | (ll & 0xffffffff);
+#endif
+}
+
+/// Divides the 128-bit number (hi, lo) by d and stores the remainder in rem.
+/// Requires hi < d so the quotient fits 64 bits.
+inline uint64_t udivrem_2by1(uint64_t hi, uint64_t lo, uint64_t d, uint64_t& rem) noexcept
+{
+#ifdef __SIZEOF_INT128__
+    const uint128 u = (static_cast<uint128>(hi) << 64) | lo;
+    rem = static_cast<uint64_t>(u % d);
+    return static_cast<uint64_t>(u / d);
+#else
+    // The bit-by-bit long division, for compilers without 128-bit integers.
+    uint64_t q = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        const bool overflow = (hi >> 63) != 0;
+        hi = (hi << 1) | (lo >> 63);
+        lo <<= 1;
+        q <<= 1;
+        if (overflow || hi >= d)
+        {
+            hi -= d;
+            q |= 1;
+        }
+    }
+    rem = hi;
+    return q;
+#endif
+}
+
+/// Returns true if the 512-bit product a * b is at most 2^256.
+///
+/// This is the check final_hash <= 2^256 / difficulty without the division: for the integer
+/// final_hash it is equivalent to final_hash * difficulty <= 2^256.
+inline bool is_product_at_most_2pow256(const uint256& a, const uint256& b) noexcept
+{
+    uint64_t p[8] = {};
+    for (size_t i = 0; i < 4; ++i)
+    {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < 4; ++j)
+        {
+            uint64_t hi;
+            uint64_t lo = umul(a.words[i], b.words[j], hi);
+            lo += carry;
+            hi += lo < carry;
+            p[i + j] += lo;
+            hi += p[i + j] < lo;
+            carry = hi;
+        }
+        p[i + 4] = carry;
+    }
+
+    if ((p[5] | p[6] | p[7]) != 0 || p[4] > 1)
+        return false;
+    return p[4] == 0 || (p[0] | p[1] | p[2] | p[3]) == 0;
+}
+
+/// The quotient and the remainder of the division.
+struct uint256_divrem
+{
+    uint256 quot;
+    uint256 rem;
+};
+
+/// Divides u by v using the Knuth's Algorithm D with 64-bit digits. Requires v != 0.
+inline uint256_divrem udivrem(const uint256& u, const uint256& v) noexcept
+{
+    uint256_divrem r{};
+
+    size_t n = 4;
+    while (v.words[n - 1] == 0)
+        --n;
+    size_t m = 4;
+    while (m != 0 && u.words[m - 1] == 0)
+        --m;
+
+    if (m < n)
+    {
+        r.rem = u;
+        return r;
+    }
+
+    if (n == 1)
+    {
+        uint64_t rem = 0;
+        for (size_t j = m; j-- != 0;)
+            r.quot.words[j] = udivrem_2by1(rem, u.words[j], v.words[0], rem);
+        r.rem.words[0] = rem;
+        return r;
+    }
+
+    // Normalize so the most significant bit of the divisor is set.
+    const unsigned shift = clz64(v.words[n - 1]);
+    uint64_t vn[4] = {};
+    uint64_t un[5] = {};
+    for (size_t i = n; i-- != 0;)
+    {
+        vn[i] = v.words[i] << shift;
+        if (shift != 0 && i != 0)
+            vn[i] |= v.words[i - 1] >> (64 - shift);
+    }
+    un[m] = shift != 0 ? u.words[m - 1] >> (64 - shift) : 0;
+    for (size_t i = m; i-- != 0;)
+    {
+        un[i] = u.words[i] << shift;
+        if (shift != 0 && i != 0)
+            un[i] |= u.words[i - 1] >> (64 - shift);
+    }
+
+    const uint64_t d1 = vn[n - 1];
+    const uint64_t d0 = vn[n - 2];
+    for (size_t j = m - n + 1; j-- != 0;)
+    {
+        // Estimate the quotient digit from the top 2 digits of the remainder, the estimate
+        // is at most 2 too big.
+        uint64_t qhat;
+        uint64_t rhat;
+        bool rhat_overflow = false;
+        if (un[j + n] >= d1)
+        {
+            qhat = ~uint64_t{0};
+            rhat = un[j + n - 1] + d1;
+            rhat_overflow = rhat < d1;
+        }
+        else
+            qhat = udivrem_2by1(un[j + n], un[j + n - 1], d1, rhat);
+
+        while (!rhat_overflow)
+        {
+            uint64_t phi;
+            const uint64_t plo = umul(qhat, d0, phi);
+            if (phi < rhat || (phi == rhat && plo <= un[j + n - 2]))
+                break;
+            --qhat;
+            rhat += d1;
+            rhat_overflow = rhat < d1;
+        }
+
+        // Multiply and subtract.
+        uint64_t carry = 0;
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint64_t hi;
+            uint64_t lo = umul(qhat, vn[i], hi);
+            lo += carry;
+            carry = hi + (lo < carry);
+            const uint64_t t = un[i + j] - lo;
+            const uint64_t b = un[i + j] < lo;
+            un[i + j] = t - borrow;
+            borrow = b + (t < borrow);
+        }
+        const uint64_t t = un[j + n] - carry;
+        const bool negative = un[j + n] < carry || t < borrow;
+        un[j + n] = t - borrow;
+
+        // The estimate was still 1 too big, add the divisor back.
+        if (negative)
+        {
+            --qhat;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                const uint64_t s = un[i + j] + c;
+                c = s < c;
+                un[i + j] = s + vn[i];
+                c += un[i + j] < vn[i];
+            }
+            un[j + n] += c;
+        }
+
+        r.quot.words[j] = qhat;
+    }
+
+    // Denormalize the remainder.
+    for (size_t i = 0; i < n; ++i)
+    {
+        r.rem.words[i] = un[i] >> shift;
+        if (shift != 0)
+            r.rem.words[i] |= un[i + 1] << (64 - shift);
+    }
+    return r;
+}
+}  // namespace ethash
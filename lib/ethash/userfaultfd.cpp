@@ -0,0 +1,283 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The full dataset generated on demand by the userfaultfd page fault handler (Linux only).
+///
+/// The full dataset memory is reserved with MAP_NORESERVE and registered with userfaultfd
+/// in the "missing" mode. When a page is touched for the first time the faulting thread is
+/// suspended and the handler threads generate all the items of the page and install it
+/// with UFFDIO_COPY. Pages never touched are never allocated. If the handler threads cannot
+/// be started the context is not created and the caller falls back to the lazily generated
+/// full dataset.
+
+#include "ethash-internal.hpp"
+#include "telemetry.hpp"
+
+#if __linux__
+
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <thread>
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+namespace ethash
+{
+struct dataset_pager
+{
+    const epoch_context& context;
+    const int uffd;
+    const int stop_fd;
+    char* const region;
+    const size_t region_size;
+    const size_t page_size;
+    std::vector<std::thread> handlers;
+
+    void handle_page_faults() const noexcept;
+    void fill_page(char* page_addr, hash1024* page) const noexcept;
+
+    /// Installs the page at the address and wakes up the threads waiting for it.
+    void install_page(uintptr_t addr, const hash1024* page) const noexcept;
+};
+
+namespace
+{
+/// Opens the userfaultfd and performs the API handshake.
+///
+/// The user-mode-only faults are requested first as this is what unprivileged processes
+/// are allowed to do. Older kernels not supporting this flag are tried without it.
+int open_userfaultfd() noexcept
+{
+    int fd = static_cast<int>(
+        syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+    if (fd < 0 && errno == EINVAL)
+        fd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+    if (fd < 0)
+        return -1;
+
+    uffdio_api api{};
+    api.api = UFFD_API;
+    if (ioctl(fd, UFFDIO_API, &api) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+}  // namespace
+
+void dataset_pager::fill_page(char* page_addr, hash1024* page) const noexcept
+{
+    const size_t num_page_items = page_size / sizeof(hash1024);
+    const auto first_index = static_cast<size_t>(page_addr - region) / sizeof(hash1024);
+    const auto num_items = static_cast<size_t>(context.full_dataset_num_items);
+
+    for (size_t i = 0; i < num_page_items; ++i)
+    {
+        const size_t index = first_index + i;
+        if (index < num_items)
+            page[i] = calculate_dataset_item_1024(context, static_cast<uint32_t>(index));
+        else
+            page[i] = hash1024{};
+    }
+    telemetry::add(telemetry::dataset_items_generated,
+        std::min(num_page_items, num_items - std::min(first_index, num_items)));
+}
+
+void dataset_pager::handle_page_faults() const noexcept
+{
+    std::vector<hash1024> page(page_size / sizeof(hash1024));
+
+    pollfd fds[2] = {{uffd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        if (fds[1].revents != 0)
+            return;
+
+        uffd_msg msg;
+        if (read(uffd, &msg, sizeof(msg)) != sizeof(msg))
+            continue;  // Other handler thread has taken the message.
+
+        if (msg.event != UFFD_EVENT_PAGEFAULT)
+            continue;
+
+        const auto addr = static_cast<uintptr_t>(msg.arg.pagefault.address) & ~(page_size - 1);
+        char* const page_addr = region + (addr - reinterpret_cast<uintptr_t>(region));
+        fill_page(page_addr, page.data());
+
+        install_page(addr, page.data());
+    }
+}
+
+void dataset_pager::install_page(uintptr_t addr, const hash1024* page) const noexcept
+{
+    while (true)
+    {
+        uffdio_copy copy{};
+        copy.dst = addr;
+        copy.src = reinterpret_cast<uintptr_t>(page);
+        copy.len = page_size;
+        if (ioctl(uffd, UFFDIO_COPY, &copy) == 0)
+            return;  // The faulting threads are woken up.
+
+        // The copy has been interrupted, e.g. by a change of the memory layout, try again.
+        if (errno == EAGAIN || errno == EINTR)
+            continue;
+        break;
+    }
+
+    // The kernel wakes up the faulting threads only on the successful copy. On EEXIST the page
+    // has been installed by other handler thread in the meantime. On other errors, e.g. ENOMEM,
+    // the woken up threads fault again and the page is generated by the next attempt.
+    uffdio_range range{};
+    range.start = addr;
+    range.len = page_size;
+    ioctl(uffd, UFFDIO_WAKE, &range);
+}
+
+namespace generic
+{
+/// The maximum number of the page fault handler threads of a context. The handlers only
+/// work when the dataset pages are touched for the first time, so a few are enough to keep up
+/// with the faulting threads without keeping many idle threads for every context.
+constexpr unsigned max_num_handlers = 4;
+
+epoch_context_full* create_epoch_context_on_demand(build_light_cache_fn build_fn,
+    int epoch_number, const ethash_allocator& allocator, bool& out_of_memory) noexcept
+{
+    out_of_memory = false;
+
+    const int uffd = open_userfaultfd();
+    if (uffd < 0)
+        return nullptr;
+
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const int full_dataset_num_items = calculate_full_dataset_num_items(epoch_number);
+    const auto full_dataset_size =
+        static_cast<size_t>(get_full_dataset_size(full_dataset_num_items));
+    const size_t region_size = (full_dataset_size + page_size - 1) / page_size * page_size;
+
+    void* const region = mmap(nullptr, region_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        close(uffd);
+        out_of_memory = true;
+        return nullptr;
+    }
+
+    uffdio_register reg{};
+    reg.range.start = reinterpret_cast<uintptr_t>(region);
+    reg.range.len = region_size;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    const int stop_fd = ioctl(uffd, UFFDIO_REGISTER, &reg) == 0 ? eventfd(0, EFD_CLOEXEC) : -1;
+    if (stop_fd < 0)
+    {
+        munmap(region, region_size);
+        close(uffd);
+        return nullptr;
+    }
+
+    // The light context layout is used, the ProgPoW L1 cache follows the light cache.
+    epoch_context_full* const context =
+        create_epoch_context(build_fn, epoch_number, false, allocator);
+    if (!context)
+    {
+        close(stop_fd);
+        munmap(region, region_size);
+        close(uffd);
+        out_of_memory = true;
+        return nullptr;
+    }
+
+    auto* const pager = new (std::nothrow) dataset_pager{
+        *context, uffd, stop_fd, static_cast<char*>(region), region_size, page_size, {}};
+    if (!pager)
+    {
+        ethash_destroy_epoch_context(context);
+        close(stop_fd);
+        munmap(region, region_size);
+        close(uffd);
+        out_of_memory = true;
+        return nullptr;
+    }
+
+    const unsigned num_handlers =
+        std::min(std::max(std::thread::hardware_concurrency(), 1u), max_num_handlers);
+    try
+    {
+        pager->handlers.reserve(num_handlers);
+        for (unsigned i = 0; i < num_handlers; ++i)
+            pager->handlers.emplace_back(&dataset_pager::handle_page_faults, pager);
+    }
+    catch (...)
+    {
+        // The threads cannot be started, stop the ones already running and let the caller
+        // fall back to the other full dataset.
+        destroy_dataset_pager(pager);
+        ethash_destroy_epoch_context(context);
+        return nullptr;
+    }
+
+    context->full_dataset = static_cast<hash1024*>(region);
+    context->full_dataset_pager = pager;
+    return context;
+}
+}  // namespace generic
+
+void destroy_dataset_pager(dataset_pager* pager) noexcept
+{
+    // The eventfd stays readable after the write so all the handlers are notified.
+    const uint64_t stop = 1;
+    const auto written = write(pager->stop_fd, &stop, sizeof(stop));
+    (void)written;
+
+    for (auto& handler : pager->handlers)
+        handler.join();
+
+    munmap(pager->region, pager->region_size);
+    close(pager->stop_fd);
+    close(pager->uffd);
+    delete pager;
+}
+}  // namespace ethash
+
+#else
+
+namespace ethash
+{
+namespace generic
+{
+epoch_context_full* create_epoch_context_on_demand(
+    build_light_cache_fn, int, const ethash_allocator&, bool& out_of_memory) noexcept
+{
+    out_of_memory = false;
+    return nullptr;
+}
+}  // namespace generic
+
+void destroy_dataset_pager(dataset_pager*) noexcept {}
+}  // namespace ethash
+
+#endif
@@ -0,0 +1,339 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include <ethash/verification_cache.hpp>
+
+#include "verify-internal.hpp"
+#include <ethash/keccak.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+namespace ethash
+{
+namespace
+{
+hash256 make_hash_seed()
+{
+    std::random_device rd;
+    hash256 seed;
+    for (auto& w : seed.word32s)
+        w = rd();
+    return seed;
+}
+
+/// The per-process random seed of the key hash.
+///
+/// The nonce and the mix hash are chosen by the seal submitter, without the secret seed
+/// the keys could be chosen to fall into the same hash table bucket and shard.
+const hash256& get_hash_seed()
+{
+    static const hash256 seed = make_hash_seed();
+    return seed;
+}
+}  // namespace
+
+struct verification_cache::key
+{
+    /// The epoch number for Ethash, the period number for ProgPoW.
+    int number;
+    bool progpow;
+    hash256 header_hash;
+    uint64_t nonce;
+    hash256 mix_hash;
+
+    /// Creates the key of the seal using Algorithm::number() and Algorithm::is_progpow.
+    template <typename Algorithm>
+    static key of(const verification_request& r) noexcept
+    {
+        return {Algorithm::number(r.block_number), Algorithm::is_progpow, r.header_hash, r.nonce,
+            r.mix_hash};
+    }
+
+    bool operator==(const key& other) const noexcept
+    {
+        return number == other.number && progpow == other.progpow && nonce == other.nonce &&
+               is_equal(header_hash, other.header_hash) && is_equal(mix_hash, other.mix_hash);
+    }
+
+    /// Hashes all the key fields with the seed from get_hash_seed().
+    size_t hash() const noexcept
+    {
+        const hash256& seed = get_hash_seed();
+        const uint8_t flags = progpow ? 1 : 0;
+        keccak256_hasher hasher;
+        hasher.update(seed.bytes, sizeof(seed));
+        hasher.update(reinterpret_cast<const uint8_t*>(&number), sizeof(number));
+        hasher.update(&flags, sizeof(flags));
+        hasher.update(header_hash.bytes, sizeof(header_hash));
+        hasher.update(reinterpret_cast<const uint8_t*>(&nonce), sizeof(nonce));
+        hasher.update(mix_hash.bytes, sizeof(mix_hash));
+        return static_cast<size_t>(hasher.final().word64s[0]);
+    }
+};
+
+namespace
+{
+struct key_hasher
+{
+    template <typename Key>
+    size_t operator()(const Key& k) const noexcept
+    {
+        return k.hash();
+    }
+};
+
+enum class outcome
+{
+    pending,
+    valid,
+    invalid,
+};
+}  // namespace
+
+struct verification_cache::shard
+{
+    std::mutex mutex;
+    std::condition_variable outcome_published;
+    std::unordered_map<key, outcome, key_hasher> entries;
+
+    /// The keys of the published outcomes, the oldest first.
+    std::deque<key> published_keys;
+};
+
+verification_cache::verification_cache(size_t capacity)
+  : num_shards{std::max<size_t>(std::min<size_t>(capacity, 16), 1)},
+    shard_capacity{std::max<size_t>(capacity / num_shards, 1)},
+    shards{new shard[num_shards]}
+{
+    // Initialize the seed here where failures can be reported.
+    get_hash_seed();
+}
+
+verification_cache::~verification_cache() = default;
+
+verification_cache::status verification_cache::lookup(const key& k, bool wait)
+{
+    shard& s = shards[k.hash() % num_shards];
+    std::unique_lock<std::mutex> lock{s.mutex};
+    while (true)
+    {
+        const auto it = s.entries.find(k);
+        if (it == s.entries.end())
+        {
+            s.entries.emplace(k, outcome::pending);
+            num_misses.fetch_add(1, std::memory_order_relaxed);
+            return status::claimed;
+        }
+
+        if (it->second != outcome::pending)
+        {
+            num_hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second == outcome::valid ? status::valid : status::invalid;
+        }
+
+        if (!wait)
+            return status::pending;
+
+        // The entry may be evicted after being published, then the key is claimed again.
+        s.outcome_published.wait(lock);
+    }
+}
+
+void verification_cache::publish(const key& k, bool valid)
+{
+    shard& s = shards[k.hash() % num_shards];
+    {
+        std::lock_guard<std::mutex> lock{s.mutex};
+        s.entries[k] = valid ? outcome::valid : outcome::invalid;
+        s.published_keys.push_back(k);
+        while (s.published_keys.size() > shard_capacity)
+        {
+            s.entries.erase(s.published_keys.front());
+            s.published_keys.pop_front();
+        }
+    }
+    s.outcome_published.notify_all();
+}
+
+void verification_cache::release(const key& k) noexcept
+{
+    shard& s = shards[k.hash() % num_shards];
+    {
+        std::lock_guard<std::mutex> lock{s.mutex};
+        s.entries.erase(k);
+    }
+    s.outcome_published.notify_all();
+}
+
+/// Releases the claimed keys left unpublished, e.g. when the verification throws,
+/// so that the calls waiting for their outcomes do not block forever.
+class verification_cache::claim_guard
+{
+public:
+    claim_guard(verification_cache& c, const key* ks, size_t n) noexcept
+      : cache{c}, keys{ks}, num_keys{n}
+    {}
+
+    ~claim_guard()
+    {
+        for (size_t i = num_published; i < num_keys; ++i)
+            cache.release(keys[i]);
+    }
+
+    claim_guard(const claim_guard&) = delete;
+    claim_guard& operator=(const claim_guard&) = delete;
+
+    /// Publishes the outcome of the next claimed key.
+    void publish(bool valid)
+    {
+        cache.publish(keys[num_published], valid);
+        ++num_published;
+    }
+
+private:
+    verification_cache& cache;
+    const key* keys;
+    size_t num_keys;
+    size_t num_published = 0;
+};
+
+template <typename Algorithm>
+bool verification_cache::verify_seal(
+    const epoch_context& context, const verification_request& request)
+{
+    if (!Algorithm::verify_final_hash(request))
+        return false;
+
+    const key k = key::of<Algorithm>(request);
+    const status st = lookup(k, true);
+    if (st != status::claimed)
+        return st == status::valid;
+
+    const bool valid = Algorithm::verify(context, request);
+    publish(k, valid);
+    return valid;
+}
+
+template <typename Algorithm>
+std::vector<bool> verification_cache::verify_seals(
+    const verification_request requests[], size_t num_requests)
+{
+    std::vector<bool> results(num_requests);
+    std::vector<verification_request> claimed;
+    std::vector<key> claimed_keys;
+    std::vector<size_t> claimed_indexes;
+    std::vector<size_t> pending_indexes;
+
+    for (size_t i = 0; i < num_requests; ++i)
+    {
+        const verification_request& r = requests[i];
+        if (r.block_number < 0 || !Algorithm::verify_final_hash(r))
+            continue;
+
+        const key k = key::of<Algorithm>(r);
+        switch (lookup(k, false))
+        {
+        case status::valid:
+            results[i] = true;
+            break;
+        case status::invalid:
+            break;
+        case status::claimed:
+            claimed.push_back(r);
+            claimed_keys.push_back(k);
+            claimed_indexes.push_back(i);
+            break;
+        case status::pending:
+            pending_indexes.push_back(i);
+            break;
+        }
+    }
+
+    // Publish the claimed outcomes before waiting for the others, including the duplicates
+    // in this batch, to avoid deadlocks.
+    {
+        claim_guard guard{*this, claimed_keys.data(), claimed_keys.size()};
+        const std::vector<bool> claimed_results =
+            Algorithm::verify_batch(claimed.data(), claimed.size());
+        for (size_t j = 0; j < claimed.size(); ++j)
+        {
+            guard.publish(claimed_results[j]);
+            results[claimed_indexes[j]] = claimed_results[j];
+        }
+    }
+
+    for (const size_t i : pending_indexes)
+    {
+        const verification_request& r = requests[i];
+        const key k = key::of<Algorithm>(r);
+        const status st = lookup(k, true);
+        if (st != status::claimed)
+        {
+            results[i] = st == status::valid;
+            continue;
+        }
+
+        // The outcome has been evicted in the meantime.
+        claim_guard guard{*this, &k, 1};
+        const scoped_global_epoch_context context{get_epoch_number(r.block_number)};
+        results[i] = Algorithm::verify(context.get(), r);
+        guard.publish(results[i]);
+    }
+
+    return results;
+}
+
+bool verification_cache::verify(const epoch_context& context, const hash256& header_hash,
+    const hash256& mix_hash, uint64_t nonce, const hash256& boundary)
+{
+    // The block number is only used to get the epoch number.
+    const int block_number = context.epoch_number * epoch_length;
+    return verify_seal<ethash_algorithm>(
+        context, {block_number, header_hash, mix_hash, nonce, boundary});
+}
+
+bool verification_cache::verify_progpow(const epoch_context& context, int block_number,
+    const hash256& header_hash, const hash256& mix_hash, uint64_t nonce,
+    const hash256& boundary)
+{
+    return verify_seal<progpow_algorithm>(
+        context, {block_number, header_hash, mix_hash, nonce, boundary});
+}
+
+std::vector<bool> verification_cache::verify_batch(
+    const verification_request requests[], size_t num_requests)
+{
+    return verify_seals<ethash_algorithm>(requests, num_requests);
+}
+
+std::vector<bool> verification_cache::verify_batch_progpow(
+    const verification_request requests[], size_t num_requests)
+{
+    return verify_seals<progpow_algorithm>(requests, num_requests);
+}
+
+size_t verification_cache::size() const noexcept
+{
+    size_t n = 0;
+    for (size_t i = 0; i < num_shards; ++i)
+    {
+        std::lock_guard<std::mutex> lock{shards[i].mutex};
+        n += shards[i].published_keys.size();
+    }
+    return n;
+}
+
+verification_cache::stats verification_cache::get_stats() const noexcept
+{
+    stats s;
+    s.hits = num_hits.load(std::memory_order_relaxed);
+    s.misses = num_misses.load(std::memory_order_relaxed);
+    return s;
+}
+}  // namespace ethash
@@ -0,0 +1,124 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The Ethash and ProgPoW traits shared by the seal verifiers: the batch verification,
+/// the verification cache and the sync pipeline.
+
+#pragma once
+
+#include "ethash-internal.hpp"
+#include <ethash/progpow.hpp>
+
+#include <vector>
+
+namespace ethash
+{
+/// The number of seals of the same epoch the verifiers hash together.
+/// The multiple of the lock-step batch sizes of the Ethash and ProgPoW light hashing.
+constexpr size_t verification_chunk_size = 8;
+
+struct ethash_algorithm
+{
+    static constexpr bool is_progpow = false;
+
+    using seed_type = hash512;
+
+    /// The number keying the cached outcomes, the epoch number.
+    static int number(int block_number) noexcept { return get_epoch_number(block_number); }
+
+    static hash512 seed(const verification_request& r) noexcept
+    {
+        return hash_seed(r.header_hash, r.nonce);
+    }
+
+    static bool verify_final_hash(const verification_request& r, const hash512& s) noexcept
+    {
+        return is_less_or_equal(hash_final(s, r.mix_hash), r.boundary);
+    }
+
+    static bool verify_final_hash(const verification_request& r) noexcept
+    {
+        return ethash::verify_final_hash(r.header_hash, r.mix_hash, r.nonce, r.boundary);
+    }
+
+    /// Checks the mix hashes of at most verification_chunk_size seals of the context's epoch,
+    /// computed in lock-step from their seeds.
+    static void verify_mix_hashes(const epoch_context& context,
+        const verification_request* const requests[], const hash512 seeds[], size_t n,
+        bool valid[]) noexcept
+    {
+        hash256 mix_hashes[verification_chunk_size];
+        hash_mix_light_batch(context, seeds, mix_hashes, n);
+
+        for (size_t i = 0; i < n; ++i)
+            valid[i] = is_equal(mix_hashes[i], requests[i]->mix_hash);
+    }
+
+    static bool verify(const epoch_context& context, const verification_request& r) noexcept
+    {
+        return ethash::verify(context, r.header_hash, r.mix_hash, r.nonce, r.boundary);
+    }
+
+    static std::vector<bool> verify_batch(
+        const verification_request requests[], size_t num_requests)
+    {
+        return ethash::verify_batch(requests, num_requests);
+    }
+};
+
+struct progpow_algorithm
+{
+    static constexpr bool is_progpow = true;
+
+    using seed_type = uint64_t;
+
+    /// The number keying the cached outcomes, the ProgPoW period number.
+    static int number(int block_number) noexcept { return block_number / progpow::period_length; }
+
+    static uint64_t seed(const verification_request& r) noexcept
+    {
+        return progpow::keccak_progpow_64(r.header_hash, r.nonce);
+    }
+
+    static bool verify_final_hash(const verification_request& r, uint64_t s) noexcept
+    {
+        return is_less_or_equal(
+            progpow::keccak_progpow_256(r.header_hash, s, r.mix_hash), r.boundary);
+    }
+
+    static bool verify_final_hash(const verification_request& r) noexcept
+    {
+        return verify_final_hash(r, seed(r));
+    }
+
+    /// See ethash_algorithm::verify_mix_hashes(), the block numbers may differ.
+    static void verify_mix_hashes(const epoch_context& context,
+        const verification_request* const requests[], const uint64_t seeds[], size_t n,
+        bool valid[]) noexcept
+    {
+        int block_numbers[verification_chunk_size] = {};
+        hash256 mix_hashes[verification_chunk_size];
+        for (size_t i = 0; i < n; ++i)
+            block_numbers[i] = requests[i]->block_number;
+
+        progpow::hash_mix_light_batch(context, block_numbers, seeds, mix_hashes, n);
+
+        for (size_t i = 0; i < n; ++i)
+            valid[i] = is_equal(mix_hashes[i], requests[i]->mix_hash);
+    }
+
+    static bool verify(const epoch_context& context, const verification_request& r) noexcept
+    {
+        return progpow::verify(
+            context, r.block_number, r.header_hash, r.mix_hash, r.nonce, r.boundary);
+    }
+
+    static std::vector<bool> verify_batch(
+        const verification_request requests[], size_t num_requests)
+    {
+        return progpow::verify_batch(requests, num_requests);
+    }
+};
+}  // namespace ethash
@@ -0,0 +1,140 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The batch verification of Ethash and ProgPoW seals.
+
+#include "thread_pool.hpp"
+#include "verify-internal.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace ethash
+{
+namespace
+{
+/// The seal which has passed the final hash check.
+template <typename Seed>
+struct candidate
+{
+    size_t index;
+    int epoch_number;
+    Seed seed;
+};
+
+template <typename Algorithm>
+std::vector<bool> verify_seals(const verification_request requests[], size_t num_requests)
+{
+    using candidate_type = candidate<typename Algorithm::seed_type>;
+
+    // Check the final hashes first, this costs a single Keccak per seal.
+    std::vector<candidate_type> candidates;
+    for (size_t i = 0; i < num_requests; ++i)
+    {
+        const verification_request& r = requests[i];
+        if (r.block_number < 0)
+            continue;
+
+        const auto seed = Algorithm::seed(r);
+        if (Algorithm::verify_final_hash(r, seed))
+            candidates.push_back({i, get_epoch_number(r.block_number), seed});
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](const candidate_type& a, const candidate_type& b) noexcept {
+            return a.epoch_number < b.epoch_number;
+        });
+
+    std::unique_ptr<bool[]> valid{new bool[candidates.size()]{}};
+    thread_pool& pool = get_thread_pool();
+
+    for (size_t begin = 0; begin != candidates.size();)
+    {
+        const int epoch_number = candidates[begin].epoch_number;
+        size_t end = begin + 1;
+        while (end != candidates.size() && candidates[end].epoch_number == epoch_number)
+            ++end;
+
+        const scoped_global_epoch_context context{epoch_number};
+        const size_t num_chunks =
+            (end - begin + verification_chunk_size - 1) / verification_chunk_size;
+        std::atomic<size_t> next_chunk{0};
+        pool.run(static_cast<unsigned>(std::min<size_t>(pool.num_threads(), num_chunks)),
+            [&](unsigned) noexcept {
+                size_t chunk;
+                while ((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < num_chunks)
+                {
+                    const size_t first = begin + chunk * verification_chunk_size;
+                    const size_t n = std::min(verification_chunk_size, end - first);
+                    const verification_request* chunk_requests[verification_chunk_size];
+                    typename Algorithm::seed_type seeds[verification_chunk_size];
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        chunk_requests[i] = &requests[candidates[first + i].index];
+                        seeds[i] = candidates[first + i].seed;
+                    }
+                    Algorithm::verify_mix_hashes(
+                        context.get(), chunk_requests, seeds, n, &valid[first]);
+                }
+            });
+        begin = end;
+    }
+
+    std::vector<bool> results(num_requests);
+    for (size_t i = 0; i < candidates.size(); ++i)
+        results[candidates[i].index] = valid[i];
+    return results;
+}
+}  // namespace
+
+std::vector<bool> verify_batch(const verification_request requests[], size_t num_requests)
+{
+    return verify_seals<ethash_algorithm>(requests, num_requests);
+}
+}  // namespace ethash
+
+namespace progpow
+{
+std::vector<bool> verify_batch(const verification_request requests[], size_t num_requests)
+{
+    return ethash::verify_seals<ethash::progpow_algorithm>(requests, num_requests);
+}
+}  // namespace progpow
+
+extern "C" {
+
+bool ethash_verify_batch(
+    const ethash_verification_request requests[], size_t num_requests, bool results[]) noexcept
+{
+    try
+    {
+        const auto valid = ethash::verify_batch(requests, num_requests);
+        std::copy(valid.begin(), valid.end(), results);
+        return true;
+    }
+    catch (...)
+    {
+        std::fill_n(results, num_requests, false);
+        return false;
+    }
+}
+
+bool ethash_progpow_verify_batch(
+    const ethash_verification_request requests[], size_t num_requests, bool results[]) noexcept
+{
+    try
+    {
+        const auto valid = progpow::verify_batch(requests, num_requests);
+        std::copy(valid.begin(), valid.end(), results);
+        return true;
+    }
+    catch (...)
+    {
+        std::fill_n(results, num_requests, false);
+        return false;
+    }
+}
+
+}  // extern "C"
@@ -367,6 +367,74 @@ union ethash_hash256 ethash_keccak256_32(const uint8_t data[32])
     return hash;
 }
 
+/// The block size of Keccak-256 in bytes.
+#define KECCAK256_BLOCK_SIZE ((1600 - 256 * 2) / 8)
+
+void ethash_keccak256_init(struct ethash_keccak256_context* context)
+{
+    size_t i;
+    for (i = 0; i < 25; ++i)
+        context->state[i] = 0;
+    context->offset = 0;
+}
+
+/// Absorbs the byte at the current offset of the block. The block must not be full.
+static inline void absorb_byte(struct ethash_keccak256_context* context, uint8_t byte)
+{
+    context->state[context->offset / 8] ^= (uint64_t)byte << (8 * (context->offset % 8));
+    if (++context->offset == KECCAK256_BLOCK_SIZE)
+    {
+        keccakf1600_best(context->state);
+        context->offset = 0;
+    }
+}
+
+void ethash_keccak256_update(
+    struct ethash_keccak256_context* context, const uint8_t* data, size_t size)
+{
+    static const size_t word_size = sizeof(uint64_t);
+
+    // Align to the state word, then absorb whole words.
+    while (size > 0 && context->offset % word_size != 0)
+    {
+        absorb_byte(context, *data++);
+        --size;
+    }
+
+    while (size >= word_size)
+    {
+        context->state[context->offset / word_size] ^= load_le(data);
+        context->offset += word_size;
+        if (context->offset == KECCAK256_BLOCK_SIZE)
+        {
+            keccakf1600_best(context->state);
+            context->offset = 0;
+        }
+        data += word_size;
+        size -= word_size;
+    }
+
+    while (size > 0)
+    {
+        absorb_byte(context, *data++);
+        --size;
+    }
+}
+
+union ethash_hash256 ethash_keccak256_final(struct ethash_keccak256_context* context)
+{
+    union ethash_hash256 hash;
+    size_t i;
+
+    context->state[context->offset / 8] ^= (uint64_t)0x01 << (8 * (context->offset % 8));
+    context->state[(KECCAK256_BLOCK_SIZE / 8) - 1] ^= 0x8000000000000000;
+    keccakf1600_best(context->state);
+
+    for (i = 0; i < 4; ++i)
+        hash.word64s[i] = to_le64(context->state[i]);
+    return hash;
+}
+
 union ethash_hash512 ethash_keccak512(const uint8_t* data, size_t size)
 {
     union ethash_hash512 hash;
@@ -19,3 +19,18 @@ static void get_epoch_context(benchmark::State& state)
     }
 }
 BENCHMARK(get_epoch_context)->Arg(0)->ThreadRange(1, 8);
+
+static void acquire_epoch_context(benchmark::State& state)
+{
+    const auto e = static_cast<int>(state.range(0));
+
+    ethash::release_global_epoch_context(ethash::acquire_global_epoch_context(e));
+
+    for (auto _ : state)
+    {
+        const auto handle = ethash::acquire_global_epoch_context(e);
+        benchmark::DoNotOptimize(handle.context);
+        ethash::release_global_epoch_context(handle);
+    }
+}
+BENCHMARK(acquire_epoch_context)->Arg(0)->ThreadRange(1, 8);
@@ -4,6 +4,7 @@
  */
 
 #include <ethash/ethash.h>
+#include <ethash/progpow.h>
 
 int test()
 {
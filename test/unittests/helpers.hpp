@@ -5,8 +5,21 @@
 #pragma once
 
 #include <ethash/ethash.hpp>
+#include <ethash/keccak.hpp>
 
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
+
+#if !_WIN32
+#include <sys/mman.h>
+#endif
+
+#if __linux__
+#include <sys/resource.h>
+#endif
 
 template <typename Hash>
 inline std::string to_hex(const Hash& h)
@@ -52,3 +65,170 @@ inline const ethash::epoch_context& get_ethash_epoch_context_0() noexcept
     static ethash::epoch_context_ptr context = ethash::create_epoch_context(0);
     return *context;
 }
+
+#if __linux__
+inline rlimit& get_orig_memory_limit() noexcept
+{
+    static rlimit orig_limit;
+    return orig_limit;
+}
+
+/// Limits the address space of the process, for the Out-Of-Memory tests.
+inline bool set_memory_limit(size_t size)
+{
+    auto& orig_limit = get_orig_memory_limit();
+    getrlimit(RLIMIT_AS, &orig_limit);
+    rlimit limit = orig_limit;
+    limit.rlim_cur = size;
+    return setrlimit(RLIMIT_AS, &limit) == 0;
+}
+
+inline bool restore_memory_limit()
+{
+    return setrlimit(RLIMIT_AS, &get_orig_memory_limit()) == 0;
+}
+#else
+inline bool set_memory_limit(size_t)
+{
+    return true;
+}
+
+inline bool restore_memory_limit()
+{
+    return true;
+}
+#endif
+
+#if !_WIN32
+/// The state of the allocator counting the blocks of the epoch contexts, indexed by the kind.
+struct counting_allocator_state
+{
+    std::atomic<int> num_allocs[2] = {};
+    std::atomic<int> num_frees[2] = {};
+    std::atomic<size_t> sizes[2] = {};
+    std::atomic<bool> invalid{false};
+};
+
+/// Allocates the blocks like the default allocator, but counts them.
+///
+/// The full dataset is mapped without being touched, so the pages of the ~1 GiB dataset
+/// are committed only when the dataset items are generated.
+inline void* counting_alloc(
+    void* user_data, size_t size, size_t alignment, ethash_memory_kind kind) noexcept
+{
+    auto& state = *static_cast<counting_allocator_state*>(user_data);
+    void* ptr = nullptr;
+    if (kind == ETHASH_MEMORY_FULL_DATASET)
+    {
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            return nullptr;
+    }
+    else
+    {
+        if (posix_memalign(&ptr, alignment, size) != 0)
+            return nullptr;
+        std::memset(ptr, 0, size);
+    }
+    ++state.num_allocs[kind];
+    state.sizes[kind] = size;
+    if (reinterpret_cast<uintptr_t>(ptr) % alignment != 0 || alignment < 64)
+        state.invalid = true;
+    return ptr;
+}
+
+inline void counting_free(void* user_data, void* ptr, size_t size, ethash_memory_kind kind) noexcept
+{
+    auto& state = *static_cast<counting_allocator_state*>(user_data);
+    ++state.num_frees[kind];
+    if (state.sizes[kind] != size)
+        state.invalid = true;
+    if (kind == ETHASH_MEMORY_FULL_DATASET)
+        munmap(ptr, size);
+    else
+        std::free(ptr);
+}
+#endif
+
+/// Encodes the RLP prefix of the payload of given size, the base is 0x80 or 0xc0.
+inline std::string rlp_prefix(size_t payload_size, uint8_t base)
+{
+    if (payload_size <= 55)
+        return std::string(1, char(base + payload_size));
+
+    std::string size_bytes;
+    for (size_t s = payload_size; s != 0; s >>= 8)
+        size_bytes.insert(size_bytes.begin(), char(s & 0xff));
+    return char(base + 55 + size_bytes.size()) + size_bytes;
+}
+
+inline std::string rlp_string(const std::string& bytes)
+{
+    if (bytes.size() == 1 && uint8_t(bytes[0]) < 0x80)
+        return bytes;
+    return rlp_prefix(bytes.size(), 0x80) + bytes;
+}
+
+inline std::string rlp_integer(uint64_t x)
+{
+    std::string bytes;
+    for (; x != 0; x >>= 8)
+        bytes.insert(bytes.begin(), char(x & 0xff));
+    return rlp_string(bytes);
+}
+
+inline std::string rlp_list(const std::vector<std::string>& encoded_items)
+{
+    std::string payload;
+    for (const auto& item : encoded_items)
+        payload += item;
+    return rlp_prefix(payload.size(), 0xc0) + payload;
+}
+
+/// The block header with dummy fields other than the ones checked by the seal verification.
+struct test_block_header
+{
+    uint64_t number = 0;
+    uint64_t difficulty = 0;
+    ethash::hash256 mix_hash = {};
+    uint64_t nonce = 0;
+
+    /// Adds the base fee field after the nonce, as in the headers since the London fork.
+    bool with_base_fee = false;
+
+    /// Returns the RLP encodings of the header fields, without the mix hash and the nonce
+    /// if with_seal is false.
+    std::vector<std::string> rlp_fields(bool with_seal = true) const
+    {
+        std::vector<std::string> fields;
+        for (const int size : {32, 32, 20, 32, 32, 32, 256})
+            fields.push_back(rlp_string(std::string(size_t(size), char(fields.size() + 1))));
+        fields.push_back(rlp_integer(difficulty));
+        fields.push_back(rlp_integer(number));
+        fields.push_back(rlp_integer(8000000));
+        fields.push_back(rlp_integer(21000));
+        fields.push_back(rlp_integer(1600000000));
+        fields.push_back(rlp_string("extra data"));
+        if (with_seal)
+        {
+            fields.push_back(
+                rlp_string(std::string(reinterpret_cast<const char*>(mix_hash.bytes), 32)));
+            std::string nonce_bytes(8, 0);
+            for (size_t i = 0; i < 8; ++i)
+                nonce_bytes[i] = char(nonce >> (56 - 8 * i));
+            fields.push_back(rlp_string(nonce_bytes));
+        }
+        if (with_base_fee)
+            fields.push_back(rlp_integer(1000000000));
+        return fields;
+    }
+
+    /// Returns the RLP encoding of the header, see rlp_fields().
+    std::string rlp(bool with_seal = true) const { return rlp_list(rlp_fields(with_seal)); }
+
+    ethash::hash256 seal_hash() const
+    {
+        const auto unsealed = rlp(false);
+        return ethash::keccak256(reinterpret_cast<const uint8_t*>(unsealed.data()), unsealed.size());
+    }
+};
@@ -10,24 +10,24 @@
 #include <ethash/ethash-internal.hpp>
 #include <ethash/ethash.hpp>
 #include <ethash/keccak.hpp>
+#include <ethash/merkle.hpp>
+#include <ethash/progpow.hpp>
 
 #include "helpers.hpp"
 #include "test_cases.hpp"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <array>
 #include <future>
+#include <limits>
+#include <thread>
 
 using namespace ethash;
 
 namespace
 {
-struct test_context_full : epoch_context
-{
-    hash1024* full_dataset;
-};
-
 /// Creates the epoch context of the correct size but filled with fake data.
 epoch_context_ptr create_epoch_context_mock(int epoch_number)
 {
@@ -36,26 +36,28 @@ epoch_context_ptr create_epoch_context_mock(int epoch_number)
     static constexpr uint64_t fill_word = 0xe14a54a1b2c3d4e5;
     std::fill_n(fill.word64s, sizeof(hash512) / sizeof(uint64_t), le::uint64(fill_word));
 
-    static const size_t context_alloc_size = std::max(sizeof(epoch_context), sizeof(hash512));
-
     // The copy of ethash_create_epoch_context() but without light cache building:
 
     const int light_cache_num_items = calculate_light_cache_num_items(epoch_number);
     const size_t light_cache_size = get_light_cache_size(light_cache_num_items);
-    const size_t alloc_size = context_alloc_size + light_cache_size;
+    const size_t alloc_size = context_header_size + light_cache_size;
 
     char* const alloc_data = static_cast<char*>(std::malloc(alloc_size));
-    hash512* const light_cache = reinterpret_cast<hash512*>(alloc_data + context_alloc_size);
+    hash512* const light_cache = reinterpret_cast<hash512*>(alloc_data + context_header_size);
     std::fill_n(light_cache, light_cache_num_items, fill);
 
-    epoch_context* const context = new (alloc_data) epoch_context{
+    epoch_context_full* const context = new (alloc_data) epoch_context_full{
         epoch_number,
         light_cache_num_items,
         light_cache,
         nullptr,
         calculate_full_dataset_num_items(epoch_number),
+        nullptr,
+        {},
     };
-    return {context, ethash_destroy_epoch_context};
+
+    // The full dataset of the mock is owned by the test, so only the header block is freed here.
+    return {context, [](epoch_context* c) noexcept { std::free(c); }};
 }
 
 hash512 copy(const hash512& h) noexcept
@@ -595,6 +597,51 @@ TEST(ethash, verify_hash)
     }
 }
 
+TEST(ethash, verify_batch)
+{
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const hash256 max_boundary =
+        to_hash256("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    const epoch_context_ptr contexts[] = {create_epoch_context(0), create_epoch_context(1)};
+
+    // Interleave the epochs 0 and 1. Every third seal has the wrong mix hash which passes
+    // the final hash check only because of the max boundary.
+    std::vector<verification_request> requests;
+    for (uint64_t nonce = 0; nonce < 15; ++nonce)
+    {
+        const int block_number = (nonce % 2 == 0) ? 1 : epoch_length + 1;
+        const auto& context = *contexts[get_epoch_number(block_number)];
+        const result r = hash(context, header_hash, nonce);
+        if (nonce % 3 == 0)
+            requests.push_back({block_number, header_hash, r.mix_hash, nonce + 1, max_boundary});
+        else
+            requests.push_back({block_number, header_hash, r.mix_hash, nonce, r.final_hash});
+    }
+    requests.push_back({-1, header_hash, {}, 0, max_boundary});
+    requests.push_back({1, header_hash, {}, 0, {}});
+
+    const auto results = verify_batch(requests.data(), requests.size());
+    ASSERT_EQ(results.size(), requests.size());
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const auto& r = requests[i];
+        const bool expected =
+            r.block_number >= 0 && verify(*contexts[get_epoch_number(r.block_number)],
+                                       r.header_hash, r.mix_hash, r.nonce, r.boundary);
+        EXPECT_EQ(results[i], expected) << i;
+        EXPECT_EQ(results[i], i < 15 && i % 3 != 0) << i;
+    }
+
+    EXPECT_TRUE(verify_batch(nullptr, 0).empty());
+
+    std::unique_ptr<bool[]> c_results{new bool[requests.size()]};
+    EXPECT_TRUE(ethash_verify_batch(requests.data(), requests.size(), c_results.get()));
+    for (size_t i = 0; i < requests.size(); ++i)
+        EXPECT_EQ(c_results[i], results[i]) << i;
+}
+
 TEST(ethash, verify_final_hash_only)
 {
     auto& context = get_ethash_epoch_context_0();
@@ -636,6 +683,299 @@ TEST(ethash, verify_boundary)
     EXPECT_FALSE(verify(context, example_header_hash, r.mix_hash, nonce, boundary_lt));
 }
 
+namespace
+{
+struct boundary_test_case
+{
+    const char* difficulty_hex;
+    const char* boundary_hex;
+};
+
+boundary_test_case boundary_test_cases[] = {
+    {"0000000000000000000000000000000000000000000000000000000000000000",
+        "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"},
+    {"0000000000000000000000000000000000000000000000000000000000000001",
+        "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"},
+    {"0000000000000000000000000000000000000000000000000000000000000002",
+        "8000000000000000000000000000000000000000000000000000000000000000"},
+    {"0000000000000000000000000000000000000000000000000000000000000003",
+        "5555555555555555555555555555555555555555555555555555555555555555"},
+    {"0000000000000000000000000000000000000000000000000000000000000100",
+        "0100000000000000000000000000000000000000000000000000000000000000"},
+    {"0000000000000000000000000000000000000000000000003c2d8c9e1a2b3f40",
+        "0000000000000004410984d4c77e7c85814656dddefbc8ad7549e9c8cc2eb266"},
+    {"0000000000000000000000000000000000000000000000010000000000000001",
+        "0000000000000000ffffffffffffffff0000000000000000ffffffffffffffff"},
+    {"00000000000000000000000000000000ffffffffffffffffffffffffffffffff",
+        "0000000000000000000000000000000100000000000000000000000000000001"},
+    {"00000000000000000123456789abcdeffedcba98765432100123456789abcdef",
+        "0000000000000000000000000000000000000000000000e10000000000000ef1"},
+    {"8000000000000000000000000000000000000000000000000000000000000000",
+        "0000000000000000000000000000000000000000000000000000000000000002"},
+    {"8000000000000000000000000000000000000000000000000000000000000001",
+        "0000000000000000000000000000000000000000000000000000000000000001"},
+    {"fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff1",
+        "0000000000000000000000000000000000000000000000000000000000000001"},
+};
+}  // namespace
+
+TEST(ethash, boundary_from_difficulty)
+{
+    // Repeat to hit the thread's cache of the conversions.
+    for (int i = 0; i < 2; ++i)
+    {
+        for (const auto& t : boundary_test_cases)
+        {
+            const auto difficulty = to_hash256(t.difficulty_hex);
+            EXPECT_EQ(to_hex(get_boundary_from_difficulty(difficulty)), t.boundary_hex)
+                << t.difficulty_hex;
+        }
+    }
+}
+
+TEST(ethash, check_against_difficulty)
+{
+    for (const auto& t : boundary_test_cases)
+    {
+        const auto difficulty = to_hash256(t.difficulty_hex);
+        const auto boundary = to_hash256(t.boundary_hex);
+        EXPECT_TRUE(check_against_difficulty(boundary, difficulty)) << t.difficulty_hex;
+
+        auto above_boundary = boundary;
+        for (size_t i = sizeof(above_boundary); i-- != 0 && ++above_boundary.bytes[i] == 0;)
+        {
+        }
+        if (!is_equal(above_boundary, hash256{}))
+        {
+            EXPECT_FALSE(check_against_difficulty(above_boundary, difficulty)) << t.difficulty_hex;
+        }
+    }
+
+    // The product final_hash * difficulty equal to 2^256 still meets the difficulty.
+    auto final_hash = to_hash256("0000000000000000000000000000000000000000000000000000000000000001");
+    auto difficulty = to_hash256("0000000000000000000000000000000000000000000000000000000000000000");
+    EXPECT_TRUE(check_against_difficulty(final_hash, difficulty));
+    final_hash = to_hash256("8000000000000000000000000000000000000000000000000000000000000000");
+    difficulty = to_hash256("0000000000000000000000000000000000000000000000000000000000000002");
+    EXPECT_TRUE(check_against_difficulty(final_hash, difficulty));
+    final_hash = to_hash256("8000000000000000000000000000000000000000000000000000000000000001");
+    EXPECT_FALSE(check_against_difficulty(final_hash, difficulty));
+}
+
+TEST(ethash, verify_against_difficulty)
+{
+    auto& context = get_ethash_epoch_context_0();
+    const auto header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const uint64_t nonce = 6666;
+    const auto r = hash(context, header_hash, nonce);
+
+    // The final hash 13c5a668... is at most 2^256 / 12 but above 2^256 / 13.
+    const auto difficulty_12 =
+        to_hash256("000000000000000000000000000000000000000000000000000000000000000c");
+    const auto difficulty_13 =
+        to_hash256("000000000000000000000000000000000000000000000000000000000000000d");
+
+    EXPECT_TRUE(verify_final_hash_against_difficulty(header_hash, r.mix_hash, nonce, difficulty_12));
+    EXPECT_FALSE(
+        verify_final_hash_against_difficulty(header_hash, r.mix_hash, nonce, difficulty_13));
+    EXPECT_TRUE(verify_against_difficulty(context, header_hash, r.mix_hash, nonce, difficulty_12));
+    EXPECT_FALSE(verify_against_difficulty(context, header_hash, r.mix_hash, nonce, difficulty_13));
+
+    auto different_mix = r.mix_hash;
+    ++different_mix.bytes[7];
+    EXPECT_FALSE(verify_against_difficulty(context, header_hash, different_mix, nonce, {}));
+}
+
+namespace
+{
+/// Seals the header with the first nonce meeting its difficulty.
+void seal_header(const epoch_context& context, test_block_header& header)
+{
+    const auto seal_hash = header.seal_hash();
+    hash256 difficulty = {};
+    difficulty.word64s[3] = be::uint64(header.difficulty);
+    for (header.nonce = 0;; ++header.nonce)
+    {
+        const auto r = hash(context, seal_hash, header.nonce);
+        if (check_against_difficulty(r.final_hash, difficulty))
+        {
+            header.mix_hash = r.mix_hash;
+            return;
+        }
+    }
+}
+
+bool verify_rlp(const epoch_context& context, int block_number, const std::string& rlp)
+{
+    return verify_header_rlp(
+        context, block_number, reinterpret_cast<const uint8_t*>(rlp.data()), rlp.size());
+}
+}  // namespace
+
+TEST(ethash, verify_header_rlp)
+{
+    auto& context = get_ethash_epoch_context_0();
+
+    for (const bool with_base_fee : {false, true})
+    {
+        test_block_header header;
+        header.number = 1000;
+        header.difficulty = 0x10;
+        header.with_base_fee = with_base_fee;
+        seal_header(context, header);
+        const auto rlp = header.rlp();
+
+        EXPECT_TRUE(verify_rlp(context, 1000, rlp));
+        EXPECT_FALSE(verify_rlp(context, 1001, rlp));
+        EXPECT_FALSE(verify_rlp(context, 30000, rlp));
+
+        // The seal hash covers the fields before and after the mix hash and the nonce.
+        for (const size_t i : {size_t{5}, rlp.size() - 1})
+        {
+            auto modified = rlp;
+            ++modified[i];
+            EXPECT_FALSE(verify_rlp(context, 1000, modified)) << i;
+        }
+
+        auto modified_header = header;
+        ++modified_header.mix_hash.bytes[0];
+        EXPECT_FALSE(verify_rlp(context, 1000, modified_header.rlp()));
+        modified_header = header;
+        ++modified_header.nonce;
+        EXPECT_FALSE(verify_rlp(context, 1000, modified_header.rlp()));
+
+        EXPECT_FALSE(verify_rlp(context, 1000, rlp.substr(0, rlp.size() - 1)));
+        EXPECT_FALSE(verify_rlp(context, 1000, rlp + '\0'));
+        EXPECT_FALSE(verify_rlp(context, 1000, std::string{}));
+    }
+
+    // The zero difficulty header.
+    test_block_header header;
+    header.number = 1;
+    header.mix_hash = hash(context, header.seal_hash(), header.nonce).mix_hash;
+    EXPECT_FALSE(verify_rlp(context, 1, header.rlp()));
+}
+
+TEST(ethash, decode_header_seal_non_canonical)
+{
+    test_block_header header;
+    header.number = 5;
+    header.difficulty = 0x10;
+    const auto fields = header.rlp_fields();
+
+    const auto decodes = [](const std::vector<std::string>& f) {
+        const auto rlp = rlp_list(f);
+        header_seal seal;
+        return decode_header_seal(reinterpret_cast<const uint8_t*>(rlp.data()), rlp.size(), seal);
+    };
+    const auto decodes_with = [&](size_t index, const std::string& encoding) {
+        auto f = fields;
+        f[index] = encoding;
+        return decodes(f);
+    };
+
+    constexpr size_t logs_bloom_index = 6;
+    constexpr size_t difficulty_index = 7;
+    constexpr size_t number_index = 8;
+    constexpr size_t extra_data_index = 12;
+    const std::string logs_bloom(256, char(logs_bloom_index + 1));
+
+    EXPECT_TRUE(decodes(fields));
+    EXPECT_TRUE(decodes_with(extra_data_index, "\x05"));
+    EXPECT_TRUE(decodes_with(extra_data_index, "\x81\x80"));
+    EXPECT_TRUE(decodes_with(extra_data_index, std::string("\xb8\x38") + std::string(56, 'x')));
+    EXPECT_TRUE(decodes_with(difficulty_index, "\x80"));
+
+    // The single byte below 0x80 with the prefix.
+    EXPECT_FALSE(decodes_with(extra_data_index, "\x81\x05"));
+    EXPECT_FALSE(decodes_with(extra_data_index, std::string("\x81\x00", 2)));
+
+    // The long form of the size at most 55.
+    EXPECT_FALSE(decodes_with(extra_data_index, "\xb8\x0a" "extra data"));
+    EXPECT_FALSE(decodes_with(extra_data_index, std::string("\xb8\x37") + std::string(55, 'x')));
+
+    // The size with leading zero bytes.
+    EXPECT_FALSE(decodes_with(logs_bloom_index, std::string("\xba\x00\x01\x00", 4) + logs_bloom));
+    auto list = rlp_list(fields);
+    ASSERT_EQ(uint8_t(list[0]), 0xf9);
+    list.replace(0, 1, std::string("\xfa\x00", 2));
+    header_seal seal;
+    EXPECT_FALSE(
+        decode_header_seal(reinterpret_cast<const uint8_t*>(list.data()), list.size(), seal));
+
+    // The integers with leading zero bytes.
+    EXPECT_FALSE(decodes_with(difficulty_index, std::string("\x82\x00\x10", 3)));
+    EXPECT_FALSE(decodes_with(difficulty_index, std::string("\x00", 1)));
+    EXPECT_FALSE(decodes_with(number_index, std::string("\x82\x00\x05", 3)));
+}
+
+#if !_WIN32
+TEST(ethash, context_allocator)
+{
+    counting_allocator_state state;
+    const allocator a{counting_alloc, counting_free, &state};
+
+    {
+        auto context = create_epoch_context(0, a);
+        ASSERT_NE(context, nullptr);
+        EXPECT_EQ(state.num_allocs[ETHASH_MEMORY_LIGHT_CACHE], 1);
+        EXPECT_EQ(state.num_allocs[ETHASH_MEMORY_FULL_DATASET], 0);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(context->light_cache) % 64, 0);
+
+        const hash256 header_hash =
+            to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+        const auto r0 = hash(*context, header_hash, 6666);
+        const auto r1 = hash(get_ethash_epoch_context_0(), header_hash, 6666);
+        EXPECT_EQ(r0.final_hash, r1.final_hash);
+        EXPECT_EQ(r0.mix_hash, r1.mix_hash);
+    }
+    EXPECT_EQ(state.num_frees[ETHASH_MEMORY_LIGHT_CACHE], 1);
+
+    {
+        auto context = create_epoch_context_full(0, a);
+        ASSERT_NE(context, nullptr);
+        EXPECT_EQ(state.num_allocs[ETHASH_MEMORY_LIGHT_CACHE], 2);
+        EXPECT_EQ(state.num_allocs[ETHASH_MEMORY_FULL_DATASET], 1);
+        EXPECT_EQ(state.sizes[ETHASH_MEMORY_FULL_DATASET], get_full_dataset_size(8388593));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(context->full_dataset) % memory_alignment, 0);
+        EXPECT_EQ(static_cast<const void*>(context->l1_cache), context->full_dataset);
+    }
+    EXPECT_EQ(state.num_frees[ETHASH_MEMORY_LIGHT_CACHE], 2);
+    EXPECT_EQ(state.num_frees[ETHASH_MEMORY_FULL_DATASET], 1);
+
+    ethash_set_global_allocator(&a);
+    auto context = create_epoch_context(0);
+    ethash_set_global_allocator(nullptr);
+    EXPECT_EQ(state.num_allocs[ETHASH_MEMORY_LIGHT_CACHE], 3);
+    context.reset();
+    EXPECT_EQ(state.num_frees[ETHASH_MEMORY_LIGHT_CACHE], 3);
+    EXPECT_FALSE(state.invalid);
+}
+#endif
+
+TEST(ethash, context_null_allocator)
+{
+    // The null allocator is the default one.
+    epoch_context_ptr context{
+        ethash_create_epoch_context_with_allocator(0, nullptr), ethash_destroy_epoch_context};
+    ASSERT_NE(context, nullptr);
+    EXPECT_EQ(context->epoch_number, 0);
+
+    epoch_context_full_ptr context_full{ethash_create_epoch_context_full_with_allocator(0, nullptr),
+        ethash_destroy_epoch_context_full};
+    ASSERT_NE(context_full, nullptr);
+    EXPECT_NE(context_full->full_dataset, nullptr);
+}
+
+TEST(ethash, context_default_allocator_alignment)
+{
+    auto context = create_epoch_context_full(0);
+    ASSERT_NE(context, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(context->light_cache) % sizeof(hash512), 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(context->full_dataset) % memory_alignment, 0);
+}
+
 TEST(ethash_multithreaded, small_dataset)
 {
     // This test creates an extremely small dataset for full search to discover
@@ -650,8 +990,8 @@ TEST(ethash_multithreaded, small_dataset)
     const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
 
     std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
-    reinterpret_cast<test_context_full*>(context.get())->full_dataset = full_dataset.get();
-    auto context_full = reinterpret_cast<epoch_context_full*>(context.get());
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
 
     std::array<std::future<search_result>, num_treads> futures;
     for (auto& f : futures)
@@ -674,8 +1014,8 @@ TEST(ethash, small_dataset)
     const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
 
     std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
-    reinterpret_cast<test_context_full*>(context.get())->full_dataset = full_dataset.get();
-    auto context_full = reinterpret_cast<epoch_context_full*>(context.get());
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
 
     auto solution = search_light(*context, {}, boundary, 940, 10);
     EXPECT_TRUE(solution.solution_found);
@@ -705,52 +1045,604 @@ TEST(ethash, small_dataset)
     EXPECT_EQ(solution.nonce, 0);
 }
 
-#if !__APPLE__
+TEST(ethash, search_interleaved)
+{
+    // The full dataset search processes nonces in batches. Check it finds the same
+    // first solution as hashing nonces one by one for different positions in a batch.
+    constexpr int num_dataset_items = 1021;
+    constexpr uint64_t num_nonces = 40;
 
-// The Out-Of-Memory tests try to allocate huge memory buffers. This fails on
-// Linux and Windows, but not on macOS. Because the macOS tries too hard
-// the tests go forever.
-// The tests are disabled on macOS at compile time (instead of using GTest
-// filter) because we don't want developers using macOS to be hit by this
-// behavior.
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
 
-#if __linux__
-#include <sys/resource.h>
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
 
-namespace
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+
+    for (const uint64_t start_nonce : {0u, 3u, 100u})
+    {
+        result results[num_nonces];
+        for (uint64_t i = 0; i < num_nonces; ++i)
+            results[i] = hash(*context, header_hash, start_nonce + i);
+
+        for (const uint64_t solution_offset : {0u, 5u, 7u, 8u, 19u, 33u, 39u})
+        {
+            const hash256 boundary = results[solution_offset].final_hash;
+            uint64_t expected_offset = 0;
+            while (!is_less_or_equal(results[expected_offset].final_hash, boundary))
+                ++expected_offset;
+
+            const auto r = search(*context_full, header_hash, boundary, start_nonce, num_nonces);
+            EXPECT_TRUE(r.solution_found);
+            EXPECT_EQ(r.nonce, start_nonce + expected_offset);
+            EXPECT_EQ(r.final_hash, results[expected_offset].final_hash);
+            EXPECT_EQ(r.mix_hash, results[expected_offset].mix_hash);
+        }
+
+        const auto r = search(*context_full, header_hash, {}, start_nonce, num_nonces);
+        EXPECT_FALSE(r.solution_found);
+    }
+}
+
+TEST(ethash_multithreaded, search_parallel)
+{
+    constexpr int num_dataset_items = 1021;
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
+
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const hash256 boundary =
+        to_hash256("0010000000000000000000000000000000000000000000000000000000000000");
+
+    for (const unsigned num_threads : {0u, 1u, 3u, 64u})
+    {
+        // Without a solution all nonces are hashed exactly once.
+        constexpr size_t iterations = 10007;
+        auto r = search_parallel(*context_full, header_hash, {}, 5, iterations, num_threads);
+        EXPECT_FALSE(r.solution.solution_found);
+        EXPECT_FALSE(r.hash_counts.empty());
+        if (num_threads != 0)
+        {
+            EXPECT_LE(r.hash_counts.size(), num_threads);
+        }
+        uint64_t num_hashes = 0;
+        for (const auto count : r.hash_counts)
+            num_hashes += count;
+        EXPECT_EQ(num_hashes, iterations);
+
+        r = search_parallel(*context_full, header_hash, boundary, 5, iterations, num_threads);
+        ASSERT_TRUE(r.solution.solution_found);
+        EXPECT_GE(r.solution.nonce, 5);
+        EXPECT_LT(r.solution.nonce, 5 + iterations);
+        const auto expected = hash(*context, header_hash, r.solution.nonce);
+        EXPECT_EQ(r.solution.final_hash, expected.final_hash);
+        EXPECT_EQ(r.solution.mix_hash, expected.mix_hash);
+        EXPECT_TRUE(is_less_or_equal(r.solution.final_hash, boundary));
+    }
+
+    const hash256 light_boundary =
+        to_hash256("0400000000000000000000000000000000000000000000000000000000000000");
+    const auto r = search_light_parallel(*context, header_hash, light_boundary, 5, 1000, 4);
+    ASSERT_TRUE(r.solution.solution_found);
+    EXPECT_TRUE(is_less_or_equal(r.solution.final_hash, light_boundary));
+    EXPECT_EQ(r.solution.final_hash, hash(*context, header_hash, r.solution.nonce).final_hash);
+}
+
+TEST(ethash, search_preemptible)
+{
+    constexpr int num_dataset_items = 1021;
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
+
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const hash256 boundary =
+        to_hash256("0100000000000000000000000000000000000000000000000000000000000000");
+    std::atomic<uint64_t> generation{7};
+
+    auto r = search_preemptible(*context_full, header_hash, {}, 3, 101, generation, 7);
+    EXPECT_EQ(r.status, search_status::exhausted);
+    EXPECT_FALSE(r.solution.solution_found);
+    EXPECT_EQ(r.num_hashes, 101);
+
+    const auto expected = search(*context_full, header_hash, boundary, 3, 1000);
+    ASSERT_TRUE(expected.solution_found);
+    r = search_preemptible(*context_full, header_hash, boundary, 3, 1000, generation, 7);
+    EXPECT_EQ(r.status, search_status::solution_found);
+    EXPECT_EQ(r.solution.nonce, expected.nonce);
+    EXPECT_EQ(r.solution.final_hash, expected.final_hash);
+    EXPECT_EQ(r.solution.mix_hash, expected.mix_hash);
+    EXPECT_EQ(r.num_hashes, expected.nonce - 3 + 1);
+
+    r = search_light_preemptible(*context, header_hash, boundary, 3, 1000, generation, 7);
+    EXPECT_EQ(r.status, search_status::solution_found);
+    EXPECT_EQ(r.solution.nonce, expected.nonce);
+    EXPECT_EQ(r.num_hashes, expected.nonce - 3 + 1);
+
+    // The job has already been replaced.
+    r = search_preemptible(*context_full, header_hash, boundary, 3, 1000, generation, 6);
+    EXPECT_EQ(r.status, search_status::preempted);
+    EXPECT_EQ(r.num_hashes, 0);
+
+    // The job is replaced during the search.
+    auto new_job = std::async(std::launch::async, [&generation] {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        ++generation;
+    });
+    constexpr size_t max_iterations = std::numeric_limits<size_t>::max();
+    r = search_preemptible(*context_full, header_hash, {}, 0, max_iterations, generation, 7);
+    new_job.wait();
+    EXPECT_EQ(r.status, search_status::preempted);
+    EXPECT_GT(r.num_hashes, 0);
+    EXPECT_EQ(r.num_hashes % 8, 0);
+}
+
+TEST(ethash, search_shares)
 {
-rlimit orig_limit;
+    constexpr int num_dataset_items = 1021;
+    constexpr uint64_t start_nonce = 17;
+    constexpr size_t iterations = 403;
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
 
-bool set_memory_limit(size_t size)
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
+
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const hash256 share_boundary =
+        to_hash256("1000000000000000000000000000000000000000000000000000000000000000");
+    const hash256 block_boundary =
+        to_hash256("0400000000000000000000000000000000000000000000000000000000000000");
+
+    std::vector<share> expected;
+    for (uint64_t nonce = start_nonce; nonce < start_nonce + iterations; ++nonce)
+    {
+        const auto r = hash(*context, header_hash, nonce);
+        if (is_less_or_equal(r.final_hash, share_boundary))
+        {
+            expected.push_back(
+                {nonce, r.final_hash, r.mix_hash, is_less_or_equal(r.final_hash, block_boundary)});
+        }
+    }
+    ASSERT_GT(expected.size(), 3);
+    const auto num_block_solutions = std::count_if(expected.begin(), expected.end(),
+        [](const share& sh) noexcept { return sh.block_solution; });
+    EXPECT_GT(num_block_solutions, 0);
+
+    std::vector<share> shares(expected.size() + 1);
+    for (const bool light : {false, true})
+    {
+        const size_t n =
+            light ? search_light_shares(*context, header_hash, share_boundary, block_boundary,
+                        start_nonce, iterations, shares.data(), shares.size()) :
+                    search_shares(*context_full, header_hash, share_boundary, block_boundary,
+                        start_nonce, iterations, shares.data(), shares.size());
+        ASSERT_EQ(n, expected.size());
+        for (size_t i = 0; i < n; ++i)
+        {
+            EXPECT_EQ(shares[i].nonce, expected[i].nonce);
+            EXPECT_EQ(shares[i].final_hash, expected[i].final_hash);
+            EXPECT_EQ(shares[i].mix_hash, expected[i].mix_hash);
+            EXPECT_EQ(shares[i].block_solution, expected[i].block_solution);
+        }
+    }
+
+    // The search stops when the output array is full.
+    const size_t n = search_shares(*context_full, header_hash, share_boundary, block_boundary,
+        start_nonce, iterations, shares.data(), 2);
+    EXPECT_EQ(n, 2);
+    EXPECT_EQ(shares[1].nonce, expected[1].nonce);
+
+    EXPECT_EQ(search_shares(*context_full, header_hash, share_boundary, block_boundary,
+                  start_nonce, iterations, nullptr, 0),
+        0);
+}
+
+TEST(ethash, c_api_full_and_batch)
 {
-    getrlimit(RLIMIT_AS, &orig_limit);
-    rlimit limit = orig_limit;
-    limit.rlim_cur = size;
-    return setrlimit(RLIMIT_AS, &limit) == 0;
+    constexpr int num_dataset_items = 1021;
+    constexpr size_t num_hashes = 70;
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
+
+    hash256 header_hashes[num_hashes];
+    uint64_t nonces[num_hashes];
+    result expected[num_hashes];
+    for (size_t i = 0; i < num_hashes; ++i)
+    {
+        header_hashes[i] = keccak256(reinterpret_cast<const uint8_t*>(&i), sizeof(i));
+        nonces[i] = i * 7919;
+        expected[i] = hash(*context, header_hashes[i], nonces[i]);
+    }
+
+    // The light batch is longer than the internal chunk.
+    ethash_result results[num_hashes];
+    ethash_hash_batch(context.get(), header_hashes, nonces, num_hashes, results);
+    for (size_t i = 0; i < num_hashes; ++i)
+    {
+        EXPECT_EQ(results[i].final_hash, expected[i].final_hash) << i;
+        EXPECT_EQ(results[i].mix_hash, expected[i].mix_hash) << i;
+    }
+
+    ethash_hash_full_batch(context_full, header_hashes, nonces, num_hashes, results);
+    for (size_t i = 0; i < num_hashes; ++i)
+    {
+        EXPECT_EQ(results[i].final_hash, expected[i].final_hash) << i;
+        EXPECT_EQ(results[i].mix_hash, expected[i].mix_hash) << i;
+    }
+
+    const auto r = ethash_hash_full(context_full, &header_hashes[3], nonces[3]);
+    EXPECT_EQ(r.final_hash, expected[3].final_hash);
+    EXPECT_EQ(r.mix_hash, expected[3].mix_hash);
+
+    // Search the nonces of the first header for the final hash of the nonce 5.
+    const hash256& header_hash = header_hashes[0];
+    const hash256 boundary = hash(*context, header_hash, 5).final_hash;
+    const search_result cpp_solution = search_light(*context, header_hash, boundary, 0, 10);
+    ASSERT_TRUE(cpp_solution.solution_found);
+
+    ethash_search_result solution;
+    ethash_search_light(context.get(), &header_hash, &boundary, 0, 10, &solution);
+    EXPECT_TRUE(solution.solution_found);
+    EXPECT_EQ(solution.nonce, cpp_solution.nonce);
+    EXPECT_EQ(solution.final_hash, cpp_solution.final_hash);
+    EXPECT_EQ(solution.mix_hash, cpp_solution.mix_hash);
+
+    ethash_search(context_full, &header_hash, &boundary, 0, 10, &solution);
+    EXPECT_TRUE(solution.solution_found);
+    EXPECT_EQ(solution.nonce, cpp_solution.nonce);
+    EXPECT_EQ(solution.mix_hash, cpp_solution.mix_hash);
+
+    ethash_search(context_full, &header_hash, &boundary, 6, 0, &solution);
+    EXPECT_FALSE(solution.solution_found);
+
+    ethash_share shares[10];
+    const size_t n = ethash_search_shares(
+        context_full, &header_hash, &boundary, &boundary, 0, 10, shares, 10);
+    EXPECT_EQ(n, search_shares(*context_full, header_hash, boundary, boundary, 0, 10, shares, 10));
+    ASSERT_GT(n, 0);
+    EXPECT_EQ(shares[0].nonce, cpp_solution.nonce);
+    EXPECT_TRUE(shares[0].block_solution);
 }
 
-bool restore_memory_limit()
+TEST(ethash, instruction_set_features)
 {
-    return setrlimit(RLIMIT_AS, &orig_limit) == 0;
+    // Every feature the kernels are compiled for must be checked before they are selected.
+    for (const auto set :
+        {instruction_set::x86_64_v2, instruction_set::x86_64_v3, instruction_set::x86_64_v4})
+    {
+        const std::string features = get_target_features(set);
+        bool all_supported = true;
+        size_t begin = 0;
+        while (begin < features.size())
+        {
+            size_t end = features.find(',', begin);
+            if (end == std::string::npos)
+                end = features.size();
+            const std::string name = features.substr(begin, end - begin);
+            bool known = false;
+            all_supported &= is_cpu_feature_supported(name, known);
+            EXPECT_TRUE(known) << name;
+            begin = end + 1;
+        }
+
+        // The instruction set can be selected if and only if all its features are supported.
+        const instruction_set selected = get_instruction_set();
+        EXPECT_EQ(set_instruction_set(set), all_supported) << features;
+        set_instruction_set(selected);
+    }
+
+    bool known = true;
+    EXPECT_FALSE(is_cpu_feature_supported("avx1024", known));
+    EXPECT_FALSE(known);
+    EXPECT_STREQ(get_target_features(instruction_set::generic), "");
+}
+
+TEST(ethash, instruction_sets)
+{
+    // All the implementations supported by the CPU must give the results of the generic one.
+    constexpr int num_light_cache_items = 1001;
+    constexpr int num_dataset_items = 1021;
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const hash256 boundary =
+        to_hash256("0400000000000000000000000000000000000000000000000000000000000000");
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+
+    struct results
+    {
+        std::vector<hash512> light_cache;
+        hash512 item512;
+        hash1024 item1024;
+        hash2048 item2048;
+        result light_hash;
+        search_result solution;
+    };
+
+    const auto compute = [&]() {
+        results r;
+        r.light_cache.resize(num_light_cache_items);
+        build_light_cache(r.light_cache.data(), num_light_cache_items, header_hash);
+        r.item512 = calculate_dataset_item_512(*context, 1711);
+        r.item1024 = calculate_dataset_item_1024(*context, 517);
+        r.item2048 = calculate_dataset_item_2048(*context, 93);
+        r.light_hash = hash(*context, header_hash, 13);
+
+        std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+        context_full->full_dataset = full_dataset.get();
+        r.solution = search(*context_full, header_hash, boundary, 0, 1000);
+        context_full->full_dataset = nullptr;
+        return r;
+    };
+
+    const instruction_set selected = get_instruction_set();
+
+    ASSERT_TRUE(set_instruction_set(instruction_set::generic));
+    const results expected = compute();
+    EXPECT_TRUE(expected.solution.solution_found);
+
+    for (const auto set :
+        {instruction_set::x86_64_v2, instruction_set::x86_64_v3, instruction_set::x86_64_v4})
+    {
+        if (!set_instruction_set(set))
+            continue;
+
+        const results r = compute();
+        EXPECT_EQ(std::memcmp(r.light_cache.data(), expected.light_cache.data(),
+                      num_light_cache_items * sizeof(hash512)),
+            0);
+        EXPECT_EQ(to_hex(r.item512), to_hex(expected.item512));
+        EXPECT_EQ(to_hex(r.item1024.hash512s[0]), to_hex(expected.item1024.hash512s[0]));
+        EXPECT_EQ(to_hex(r.item1024.hash512s[1]), to_hex(expected.item1024.hash512s[1]));
+        for (size_t i = 0; i < 4; ++i)
+            EXPECT_EQ(to_hex(r.item2048.hash512s[i]), to_hex(expected.item2048.hash512s[i]));
+        EXPECT_EQ(r.light_hash.final_hash, expected.light_hash.final_hash);
+        EXPECT_EQ(r.light_hash.mix_hash, expected.light_hash.mix_hash);
+        EXPECT_EQ(r.solution.nonce, expected.solution.nonce);
+        EXPECT_EQ(r.solution.final_hash, expected.solution.final_hash);
+        EXPECT_EQ(r.solution.mix_hash, expected.solution.mix_hash);
+    }
+
+    set_instruction_set(selected);
+    EXPECT_EQ(selected, detect_instruction_set());
 }
-}  // namespace
 
+TEST(ethash, telemetry)
+{
+    const auto before = get_telemetry();
+    if (!before.enabled)
+    {
+        EXPECT_EQ(before.num_hashes, 0);
+        EXPECT_EQ(before.dataset_items_generated, 0);
+        EXPECT_EQ(before.dataset_items_cached, 0);
+        EXPECT_EQ(before.light_items_computed, 0);
+        return;
+    }
+
+    constexpr int num_dataset_items = 1021;
+    constexpr size_t iterations = 20;
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    context_full->full_dataset = full_dataset.get();
+
+    search(*context_full, header_hash, {}, 0, iterations);
+    const auto full = get_telemetry();
+    EXPECT_EQ(full.num_hashes - before.num_hashes, iterations);
+    const auto generated = full.dataset_items_generated - before.dataset_items_generated;
+    const auto cached = full.dataset_items_cached - before.dataset_items_cached;
+    EXPECT_GT(generated, 0);
+    EXPECT_LE(generated, num_dataset_items);
+    EXPECT_EQ(generated + cached, iterations * num_dataset_accesses);
+    EXPECT_EQ(full.dataset_bytes_read() - before.dataset_bytes_read(),
+        iterations * num_dataset_accesses * sizeof(hash1024));
+    context_full->full_dataset = nullptr;
+
+    // The counts of the exited threads are kept.
+    std::thread{[&] { hash(*context, header_hash, 0); }}.join();
+    const auto light = get_telemetry();
+    EXPECT_EQ(light.num_hashes - full.num_hashes, 1);
+    EXPECT_EQ(light.light_items_computed - full.light_items_computed, num_dataset_accesses);
+    EXPECT_EQ(light.dataset_items_generated, full.dataset_items_generated);
+}
+
+TEST(ethash, create_context_full_on_demand)
+{
+    auto context = create_epoch_context_full_on_demand(0);
+    ASSERT_NE(context, nullptr);
+    ASSERT_NE(context->full_dataset, nullptr);
+#if __linux__
+    if (!context->full_dataset_pager)
+        std::cout << "userfaultfd not available, using lazily generated full dataset\n";
 #else
+    EXPECT_EQ(context->full_dataset_pager, nullptr);
+#endif
 
-namespace
+    auto& light_context = get_ethash_epoch_context_0();
+    const uint32_t last_index = static_cast<uint32_t>(context->full_dataset_num_items - 1);
+    for (const uint32_t index : {0u, 1u, 31u, 32u, 1000000u, last_index})
+    {
+        EXPECT_EQ(to_hex(context->full_dataset[index]),
+            to_hex(calculate_dataset_item_1024(light_context, index)))
+            << index;
+    }
+
+    for (size_t i = 0; i < progpow::l1_cache_num_items; ++i)
+        ASSERT_EQ(context->l1_cache[i], light_context.l1_cache[i]) << i;
+
+    for (const auto& t : hash_test_cases)
+    {
+        if (get_epoch_number(t.block_number) != 0)
+            continue;
+
+        const hash256 header_hash = to_hash256(t.header_hash_hex);
+        const uint64_t nonce = std::stoull(t.nonce_hex, nullptr, 16);
+        const result r = hash(*context, header_hash, nonce);
+        EXPECT_EQ(to_hex(r.final_hash), t.final_hash_hex);
+        EXPECT_EQ(to_hex(r.mix_hash), t.mix_hash_hex);
+
+        const result p = progpow::hash(*context, t.block_number, header_hash, nonce);
+        const result pl = progpow::hash(light_context, t.block_number, header_hash, nonce);
+        EXPECT_EQ(p.final_hash, pl.final_hash);
+        EXPECT_EQ(p.mix_hash, pl.mix_hash);
+    }
+}
+
+TEST(ethash, dataset_merkle_tree_small)
 {
-bool set_memory_limit(size_t)
+    constexpr int num_dataset_items = 3;
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
+
+    const auto tree = build_dataset_merkle_tree(*context_full);
+    EXPECT_EQ(get_dataset_merkle_depth(num_dataset_items), 2);
+    EXPECT_EQ(tree.num_items, num_dataset_items);
+    EXPECT_EQ(tree.nodes.size(), 6);
+
+    hash256 leaves[4] = {};
+    for (uint32_t i = 0; i < num_dataset_items; ++i)
+    {
+        const hash1024 item = calculate_dataset_item_1024(*context, i);
+        EXPECT_EQ(to_hex(full_dataset[i]), to_hex(item));
+        leaves[i] = keccak256(item.bytes, sizeof(item));
+    }
+
+    const auto hash_pair = [](const hash256& a, const hash256& b) {
+        uint8_t data[64];
+        std::memcpy(&data[0], a.bytes, 32);
+        std::memcpy(&data[32], b.bytes, 32);
+        return keccak256(data, sizeof(data));
+    };
+    const hash256 expected_root = hash_pair(
+        hash_pair(leaves[0], leaves[1]), hash_pair(leaves[2], hash256{}));
+    EXPECT_EQ(tree.root(), expected_root);
+}
+
+TEST(ethash, dataset_merkle_proof)
 {
-    return true;
+    constexpr int num_dataset_items = 501;
+    const hash256 boundary =
+        to_hash256("0080000000000000000000000000000000000000000000000000000000000000");
+    const hash256 header_hash = {};
+    constexpr uint64_t nonce = 948;
+
+    auto context = create_epoch_context_mock(0);
+    const_cast<int&>(context->full_dataset_num_items) = num_dataset_items;
+
+    std::unique_ptr<hash1024[]> full_dataset{new hash1024[num_dataset_items]{}};
+    auto context_full = static_cast<epoch_context_full*>(context.get());
+    context_full->full_dataset = full_dataset.get();
+
+    const auto tree = build_dataset_merkle_tree(*context_full, 4);
+    const auto tree1 = build_dataset_merkle_tree(*context_full, 1);
+    EXPECT_EQ(tree.root(), tree1.root());
+
+    const auto r = hash(*context, header_hash, nonce);
+    const auto proof = create_dataset_proof(*context_full, tree, header_hash, nonce);
+    EXPECT_EQ(proof.branches.size(), num_dataset_accesses * get_dataset_merkle_depth(501));
+
+    const auto& root = tree.root();
+    EXPECT_TRUE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, boundary, proof));
+    EXPECT_TRUE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, r.final_hash, proof));
+
+    auto lower_boundary = r.final_hash;
+    --lower_boundary.bytes[31];
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, lower_boundary, proof));
+
+    auto wrong_root = root;
+    ++wrong_root.bytes[0];
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        wrong_root, num_dataset_items, header_hash, r.mix_hash, nonce, boundary, proof));
+
+    auto wrong_item_proof = proof;
+    ++wrong_item_proof.items[17].bytes[100];
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, boundary, wrong_item_proof));
+
+    auto wrong_branch_proof = proof;
+    ++wrong_branch_proof.branches[5].bytes[3];
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, boundary, wrong_branch_proof));
+
+    auto truncated_proof = proof;
+    truncated_proof.branches.pop_back();
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, boundary, truncated_proof));
+
+    const auto other_proof = create_dataset_proof(*context_full, tree, header_hash, nonce + 1);
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        root, num_dataset_items, header_hash, r.mix_hash, nonce, boundary, other_proof));
+
+    // The public verifier only accepts the numbers of items of real full datasets.
+    for (const int n : {num_dataset_items, 0, -1, std::numeric_limits<int>::min()})
+    {
+        EXPECT_FALSE(verify_dataset_proof(root, n, header_hash, r.mix_hash, nonce, boundary, proof))
+            << n;
+    }
+    EXPECT_FALSE(verify_dataset_proof_any_size(
+        root, 0, header_hash, r.mix_hash, nonce, boundary, proof));
 }
 
-bool restore_memory_limit()
+TEST(ethash, is_full_dataset_num_items)
 {
-    return true;
+    for (const int epoch_number : {0, 1, 2, 100, 1000, 32638})
+    {
+        const int n = calculate_full_dataset_num_items(epoch_number);
+        EXPECT_TRUE(is_full_dataset_num_items(n)) << epoch_number;
+        EXPECT_FALSE(is_full_dataset_num_items(n - 1)) << epoch_number;
+        EXPECT_FALSE(is_full_dataset_num_items(n + 1)) << epoch_number;
+    }
+    EXPECT_FALSE(is_full_dataset_num_items(0));
+    EXPECT_FALSE(is_full_dataset_num_items(-8388593));
+    EXPECT_FALSE(is_full_dataset_num_items(501));
+    EXPECT_FALSE(is_full_dataset_num_items(std::numeric_limits<int>::max()));
 }
-}  // namespace
 
-#endif
+#if !__APPLE__
+
+// The Out-Of-Memory tests try to allocate huge memory buffers. This fails on
+// Linux and Windows, but not on macOS. Because the macOS tries too hard
+// the tests go forever.
+// The tests are disabled on macOS at compile time (instead of using GTest
+// filter) because we don't want developers using macOS to be hit by this
+// behavior.
 
 static constexpr bool arch64bit = sizeof(void*) == 8;
 
@@ -769,6 +1661,23 @@ TEST(ethash, create_context_oom)
     ASSERT_TRUE(restore_memory_limit());
     EXPECT_EQ(context, nullptr);
 }
+
+TEST(ethash, verify_batch_oom)
+{
+    // The light cache of the epoch does not fit in the memory limit.
+    static constexpr int epoch = arch64bit ? 30000 : 10000;
+    hash256 boundary;
+    std::memset(boundary.bytes, 0xff, sizeof(boundary));
+    const ethash_verification_request request{epoch * epoch_length, {}, {}, 0, boundary};
+
+    bool result = true;
+    ASSERT_TRUE(set_memory_limit(1024 * 1024 * 1024));
+    const bool ok = ethash_verify_batch(&request, 1, &result);
+    ASSERT_TRUE(restore_memory_limit());
+    EXPECT_FALSE(ok);
+    EXPECT_FALSE(result);
+}
+
 #endif
 
 namespace
@@ -8,6 +8,8 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+
 using namespace ethash;
 
 struct keccak_test_case
@@ -239,6 +241,23 @@ TEST(keccak, unaligned)
     }
 }
 
+TEST(keccak, incremental)
+{
+    const uint8_t* const data = reinterpret_cast<const uint8_t*>(test_text);
+
+    for (auto& t : test_cases)
+    {
+        for (size_t piece_size = 1; piece_size <= 17; ++piece_size)
+        {
+            keccak256_hasher hasher;
+            for (size_t i = 0; i < t.input_size; i += piece_size)
+                hasher.update(&data[i], std::min(piece_size, t.input_size - i));
+            ASSERT_EQ(to_hex(hasher.final()), t.expected_hash256)
+                << t.input_size << " " << piece_size;
+        }
+    }
+}
+
 TEST(keccak, hpp_aliases)
 {
     uint8_t data[64] = {42};
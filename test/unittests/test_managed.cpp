@@ -10,7 +10,9 @@
 #include <gtest/gtest.h>
 
 #include <array>
+#include <chrono>
 #include <future>
+#include <thread>
 
 using namespace ethash;
 
@@ -154,3 +156,193 @@ TEST(managed_multithreaded, get_epoch_context_full)
     for (auto& f : futures)
         EXPECT_TRUE(f.get());
 }
+
+TEST(managed, global_context_lru)
+{
+    // Start from the epoch 2 only. The context of the epoch used last by the thread may have
+    // been evicted by other tests, it is kept by the thread until it switches to another epoch.
+    set_global_epoch_context_capacity(1);
+    get_global_epoch_context(2);
+    release_global_epoch_context(acquire_global_epoch_context(2));
+    set_global_epoch_context_capacity(2);
+
+    // Switching between the resident epochs does not rebuild the contexts.
+    const auto* context_1 = &get_global_epoch_context(1);
+    get_global_epoch_context(0);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{0, 1}));
+    EXPECT_EQ(&get_global_epoch_context(1), context_1);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{1, 0}));
+
+    // The least recently used epoch is evicted.
+    get_global_epoch_context(2);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{2, 1}));
+    EXPECT_EQ(&get_global_epoch_context(1), context_1);
+
+    set_global_epoch_context_capacity(3);
+    get_global_epoch_context(0);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{0, 1, 2}));
+
+    int epoch_numbers[2];
+    EXPECT_EQ(ethash_get_global_epoch_contexts(epoch_numbers, 2), 3);
+    EXPECT_EQ(epoch_numbers[0], 0);
+    EXPECT_EQ(epoch_numbers[1], 1);
+
+    set_global_epoch_context_capacity(0);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{0}));
+    set_global_epoch_context_capacity(2);
+}
+
+TEST(managed, global_context_handles)
+{
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const auto expected = hash(get_ethash_epoch_context_0(), header_hash, 6666);
+
+    const auto handle_0 = acquire_global_epoch_context(0);
+    ASSERT_NE(handle_0.context, nullptr);
+    EXPECT_EQ(handle_0.context->epoch_number, 0);
+
+    // Acquiring the resident epoch again gives the same context.
+    const auto handle_0b = acquire_global_epoch_context(0);
+    EXPECT_EQ(handle_0b.context, handle_0.context);
+    release_global_epoch_context(handle_0b);
+
+    // The evicted context stays valid until its handle is released.
+    set_global_epoch_context_capacity(1);
+    const auto handle_1 = acquire_global_epoch_context(1);
+    ASSERT_NE(handle_1.context, nullptr);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{1}));
+    EXPECT_EQ(handle_0.context->epoch_number, 0);
+    const auto r = hash(*handle_0.context, header_hash, 6666);
+    EXPECT_EQ(r.final_hash, expected.final_hash);
+    EXPECT_EQ(r.mix_hash, expected.mix_hash);
+
+    // The handles can be released by other threads.
+    std::thread{[handle_0] { release_global_epoch_context(handle_0); }}.join();
+    release_global_epoch_context(handle_1);
+    release_global_epoch_context(ethash_epoch_context_handle{});
+    set_global_epoch_context_capacity(2);
+}
+
+TEST(managed, global_context_prepare)
+{
+    // The prepared context takes an extra slot instead of evicting the context in use.
+    set_global_epoch_context_capacity(1);
+    const auto handle_7 = acquire_global_epoch_context(7);
+    ASSERT_NE(handle_7.context, nullptr);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{7}));
+
+    EXPECT_TRUE(prepare_global_epoch_context(8));
+    while (get_global_epoch_contexts().size() != 2)
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{7, 8}));
+
+    // The prepared context becomes the most recently used one when acquired
+    // and the context it replaces is evicted.
+    const auto handle_8 = acquire_global_epoch_context(8);
+    ASSERT_NE(handle_8.context, nullptr);
+    EXPECT_EQ(handle_8.context->epoch_number, 8);
+    EXPECT_EQ(get_global_epoch_contexts(), (std::vector<int>{8}));
+    EXPECT_EQ(handle_7.context->epoch_number, 7);
+
+    release_global_epoch_context(handle_7);
+    release_global_epoch_context(handle_8);
+    set_global_epoch_context_capacity(2);
+}
+
+TEST(managed_multithreaded, global_context_handles)
+{
+    constexpr size_t num_treads = 4;
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const auto expected = hash(get_ethash_epoch_context_0(), header_hash, 6666);
+
+    // The threads acquire the contexts while the other threads keep evicting them.
+    std::array<std::future<void>, num_treads> futures;
+    for (size_t t = 0; t < num_treads; ++t)
+    {
+        futures[t] = std::async(std::launch::async, [t, &header_hash, &expected] {
+            for (int i = 0; i < 4; ++i)
+            {
+                const int epoch_number = static_cast<int>((t + static_cast<size_t>(i)) % 3);
+                const auto handle = acquire_global_epoch_context(epoch_number);
+                ASSERT_NE(handle.context, nullptr);
+                EXPECT_EQ(handle.context->epoch_number, epoch_number);
+                if (epoch_number == 0)
+                {
+                    const auto r = hash(*handle.context, header_hash, 6666);
+                    EXPECT_EQ(r.final_hash, expected.final_hash);
+                }
+                release_global_epoch_context(handle);
+            }
+        });
+    }
+    for (auto& f : futures)
+        f.wait();
+}
+
+#if !_WIN32
+TEST(managed, global_context_reclaim_on_release)
+{
+    static counting_allocator_state state;
+    static const allocator counting_allocator{counting_alloc, counting_free, &state};
+    ethash_set_global_allocator(&counting_allocator);
+    auto& num_freed = state.num_frees[ETHASH_MEMORY_LIGHT_CACHE];
+
+    // The evicted context is freed by the release of its last handle.
+    set_global_epoch_context_capacity(1);
+    const auto handle_5 = acquire_global_epoch_context(5);
+    ASSERT_NE(handle_5.context, nullptr);
+    const auto handle_6 = acquire_global_epoch_context(6);
+    ASSERT_NE(handle_6.context, nullptr);
+    const int num_freed_before = num_freed;
+    release_global_epoch_context(handle_5);
+    EXPECT_EQ(num_freed, num_freed_before + 1);
+
+    release_global_epoch_context(handle_6);
+    EXPECT_EQ(num_freed, num_freed_before + 1);
+    set_global_epoch_context_capacity(2);
+    ethash_set_global_allocator(nullptr);
+}
+
+TEST(managed_multithreaded, global_context_single_build)
+{
+    constexpr size_t num_treads = 4;
+    static counting_allocator_state state;
+    static const allocator counting_allocator{counting_alloc, counting_free, &state};
+    ethash_set_global_allocator(&counting_allocator);
+    auto& num_light_caches = state.num_allocs[ETHASH_MEMORY_LIGHT_CACHE];
+
+    // The threads requesting the same new epoch wait for the single build.
+    num_light_caches = 0;
+    std::array<const epoch_context*, num_treads> contexts{};
+    std::array<std::future<void>, num_treads> futures;
+    for (size_t t = 0; t < num_treads; ++t)
+    {
+        futures[t] = std::async(std::launch::async, [t, &contexts] {
+            const auto handle = acquire_global_epoch_context(3);
+            contexts[t] = handle.context;
+            release_global_epoch_context(handle);
+        });
+    }
+    for (auto& f : futures)
+        f.wait();
+    EXPECT_EQ(num_light_caches, 1);
+    for (const auto* context : contexts)
+    {
+        ASSERT_NE(context, nullptr);
+        EXPECT_EQ(context, contexts[0]);
+    }
+
+    // The request for the epoch being prepared in the background waits for this build.
+    num_light_caches = 0;
+    EXPECT_TRUE(prepare_global_epoch_context(4));
+    const auto handle = acquire_global_epoch_context(4);
+    ASSERT_NE(handle.context, nullptr);
+    EXPECT_EQ(handle.context->epoch_number, 4);
+    EXPECT_EQ(num_light_caches, 1);
+    release_global_epoch_context(handle);
+
+    ethash_set_global_allocator(nullptr);
+}
+#endif
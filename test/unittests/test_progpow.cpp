@@ -6,9 +6,13 @@
 #include "progpow_test_vectors.hpp"
 
 #include <ethash/endianness.hpp>
+#include <ethash/ethash-internal.hpp>
 #include <ethash/progpow.hpp>
+#include <ethash/sync_pipeline.hpp>
+#include <ethash/verification_cache.hpp>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <array>
 
 TEST(progpow, revision)
@@ -65,6 +69,178 @@ TEST(progpow, hash_30000)
     EXPECT_EQ(to_hex(result.final_hash), final_hex);
 }
 
+TEST(progpow, hash_30000_revision_0_9_2)
+{
+    using ethash::instruction_set;
+    using revision = progpow::revision_0_9_2;
+
+    const int block_number = 30000;
+    const auto header =
+        to_hash256("ffeeddccbbaa9988776655443322110000112233445566778899aabbccddeeff");
+    const uint64_t nonce = 0x123456789abcdef0;
+    const auto mix_hex = "11f19805c58ab46610ff9c719dcf0a5f18fa2f1605798eef770c47219274767d";
+    const auto final_hex = "5b7ccd472dbefdd95b895cac8ece67ff0deb5a6bd2ecc6e162383d00c3728ece";
+
+    auto context = ethash::create_epoch_context_full(ethash::get_epoch_number(block_number));
+    auto& light = reinterpret_cast<const ethash::epoch_context&>(*context);
+    const instruction_set selected = ethash::get_instruction_set();
+
+    for (const auto set : {instruction_set::generic, instruction_set::x86_64_v2,
+             instruction_set::x86_64_v3, instruction_set::x86_64_v4})
+    {
+        if (!ethash::set_instruction_set(set))
+            continue;
+
+        for (const bool jit : {false, true})
+        {
+            progpow::set_jit_enabled(jit);
+
+            const auto result = progpow::hash<revision>(light, block_number, header, nonce);
+            EXPECT_EQ(to_hex(result.mix_hash), mix_hex) << int(set) << jit;
+            EXPECT_EQ(to_hex(result.final_hash), final_hex) << int(set) << jit;
+
+            const auto full = progpow::hash<revision>(*context, block_number, header, nonce);
+            EXPECT_EQ(to_hex(full.mix_hash), mix_hex) << int(set) << jit;
+
+            const auto boundary = result.final_hash;
+            EXPECT_TRUE(progpow::verify<revision>(
+                light, block_number, header, result.mix_hash, nonce, boundary));
+            EXPECT_FALSE(progpow::verify<progpow::revision_0_9_3>(
+                light, block_number, header, result.mix_hash, nonce, boundary));
+
+            const auto sr = progpow::search<revision>(
+                *context, block_number, header, boundary, nonce, 10);
+            EXPECT_EQ(sr.nonce, nonce);
+            EXPECT_EQ(to_hex(sr.mix_hash), mix_hex);
+        }
+    }
+
+    progpow::set_jit_enabled(true);
+    ethash::set_instruction_set(selected);
+
+    // The default revision.
+    const auto result = progpow::hash<progpow::revision_0_9_3>(light, block_number, header, nonce);
+    EXPECT_EQ(result.mix_hash, progpow::hash(light, block_number, header, nonce).mix_hash);
+}
+
+TEST(progpow, instruction_sets)
+{
+    using ethash::instruction_set;
+
+    auto& context = get_ethash_epoch_context_0();
+    const instruction_set selected = ethash::get_instruction_set();
+
+    for (const auto set : {instruction_set::generic, instruction_set::x86_64_v2,
+             instruction_set::x86_64_v3, instruction_set::x86_64_v4})
+    {
+        if (!ethash::set_instruction_set(set))
+            continue;
+
+        for (const auto& t : progpow_hash_test_cases)
+        {
+            if (ethash::get_epoch_number(t.block_number) != 0)
+                continue;
+
+            const auto header_hash = to_hash256(t.header_hash_hex);
+            const auto nonce = std::stoull(t.nonce_hex, nullptr, 16);
+            const auto result = progpow::hash(context, t.block_number, header_hash, nonce);
+            EXPECT_EQ(to_hex(result.mix_hash), t.mix_hash_hex);
+            EXPECT_EQ(to_hex(result.final_hash), t.final_hash_hex);
+        }
+    }
+
+    ethash::set_instruction_set(selected);
+}
+
+TEST(progpow, instruction_sets_periods)
+{
+    using ethash::instruction_set;
+
+    // The programs of many periods cover all the random math and merge kinds.
+    auto& context = get_ethash_epoch_context_0();
+    const instruction_set selected = ethash::get_instruction_set();
+    const auto header_hash =
+        to_hash256("ffeeddccbbaa9988776655443322110000112233445566778899aabbccddeeff");
+
+    constexpr int num_periods = 64;
+    int block_numbers[num_periods];
+    uint64_t seeds[num_periods];
+    ethash::hash256 expected[num_periods];
+    ethash::set_instruction_set(instruction_set::generic);
+    for (int i = 0; i < num_periods; ++i)
+    {
+        block_numbers[i] = i * 3 * progpow::period_length + i;
+        seeds[i] = progpow::keccak_progpow_64(header_hash, uint64_t(i));
+        expected[i] = progpow::hash(context, block_numbers[i], header_hash, uint64_t(i)).mix_hash;
+    }
+
+    for (const auto set : {instruction_set::x86_64_v2, instruction_set::x86_64_v3,
+             instruction_set::x86_64_v4})
+    {
+        if (!ethash::set_instruction_set(set))
+            continue;
+
+        for (int i = 0; i < num_periods; ++i)
+        {
+            const auto r = progpow::hash(context, block_numbers[i], header_hash, uint64_t(i));
+            EXPECT_EQ(to_hex(r.mix_hash), to_hex(expected[i])) << int(set) << " " << i;
+        }
+
+        ethash::hash256 mix_hashes[num_periods];
+        progpow::hash_mix_light_batch(context, block_numbers, seeds, mix_hashes, num_periods);
+        for (int i = 0; i < num_periods; ++i)
+            EXPECT_EQ(to_hex(mix_hashes[i]), to_hex(expected[i])) << int(set) << " " << i;
+    }
+
+    ethash::set_instruction_set(selected);
+}
+
+TEST(progpow, jit)
+{
+    using ethash::instruction_set;
+
+    // The JIT compiled rounds replace the interpreter in the scalar kernels.
+    const instruction_set selected = ethash::get_instruction_set();
+    if (!progpow::set_jit_enabled(true))
+        return;
+
+    ethash::epoch_context_ptr context{nullptr, nullptr};
+    for (const auto set : {instruction_set::generic, instruction_set::x86_64_v2})
+    {
+        if (!ethash::set_instruction_set(set))
+            continue;
+
+        for (const auto& t : progpow_hash_test_cases)
+        {
+            const auto epoch_number = ethash::get_epoch_number(t.block_number);
+            if (!context || context->epoch_number != epoch_number)
+                context = ethash::create_epoch_context(epoch_number);
+
+            const auto header_hash = to_hash256(t.header_hash_hex);
+            const auto nonce = std::stoull(t.nonce_hex, nullptr, 16);
+            const auto result = progpow::hash(*context, t.block_number, header_hash, nonce);
+            EXPECT_EQ(to_hex(result.mix_hash), t.mix_hash_hex);
+            EXPECT_EQ(to_hex(result.final_hash), t.final_hash_hex);
+        }
+    }
+
+    // Compare with the interpreter on the programs of many periods.
+    auto& context_0 = get_ethash_epoch_context_0();
+    const auto header_hash =
+        to_hash256("00112233445566778899aabbccddeeffffeeddccbbaa99887766554433221100");
+    for (int i = 0; i < 64; ++i)
+    {
+        const int block_number = i * 7 * progpow::period_length;
+        progpow::set_jit_enabled(false);
+        const auto expected = progpow::hash(context_0, block_number, header_hash, uint64_t(i));
+        progpow::set_jit_enabled(true);
+        const auto r = progpow::hash(context_0, block_number, header_hash, uint64_t(i));
+        EXPECT_EQ(to_hex(r.mix_hash), to_hex(expected.mix_hash)) << i;
+    }
+
+    ethash::set_instruction_set(selected);
+}
+
 TEST(progpow, hash_and_verify)
 {
     ethash::epoch_context_ptr context{nullptr, nullptr};
@@ -99,6 +275,192 @@ TEST(progpow, hash_and_verify)
     }
 }
 
+TEST(progpow, verify_against_difficulty)
+{
+    const int block_number = 30000;
+    auto context = ethash::create_epoch_context(ethash::get_epoch_number(block_number));
+    const auto header_hash =
+        to_hash256("ffeeddccbbaa9988776655443322110000112233445566778899aabbccddeeff");
+    const uint64_t nonce = 0x123456789abcdef0;
+    const auto r = progpow::hash(*context, block_number, header_hash, nonce);
+
+    // The maximum difficulty met by the final hash.
+    const auto difficulty = ethash::get_boundary_from_difficulty(r.final_hash);
+    auto difficulty_above = difficulty;
+    ++difficulty_above.bytes[31];
+
+    EXPECT_TRUE(progpow::verify_against_difficulty(
+        *context, block_number, header_hash, r.mix_hash, nonce, difficulty));
+    EXPECT_FALSE(progpow::verify_against_difficulty(
+        *context, block_number, header_hash, r.mix_hash, nonce, difficulty_above));
+
+    auto different_mix = r.mix_hash;
+    ++different_mix.bytes[7];
+    EXPECT_FALSE(progpow::verify_against_difficulty(
+        *context, block_number, header_hash, different_mix, nonce, difficulty));
+}
+
+TEST(progpow, verify_header_rlp)
+{
+    const int block_number = 30000;
+    auto context = ethash::create_epoch_context(ethash::get_epoch_number(block_number));
+
+    test_block_header header;
+    header.number = block_number;
+    header.difficulty = 0x10;
+    header.with_base_fee = true;
+    const auto seal_hash = header.seal_hash();
+    const auto difficulty = to_hash256(
+        "0000000000000000000000000000000000000000000000000000000000000010");
+    for (;; ++header.nonce)
+    {
+        const auto r = progpow::hash(*context, block_number, seal_hash, header.nonce);
+        if (ethash::check_against_difficulty(r.final_hash, difficulty))
+        {
+            header.mix_hash = r.mix_hash;
+            break;
+        }
+    }
+
+    const auto rlp = header.rlp();
+    const auto data = reinterpret_cast<const uint8_t*>(rlp.data());
+    EXPECT_TRUE(progpow::verify_header_rlp(*context, block_number, data, rlp.size()));
+    EXPECT_FALSE(progpow::verify_header_rlp(*context, block_number + 1, data, rlp.size()));
+    EXPECT_FALSE(progpow::verify_header_rlp(*context, block_number, data, rlp.size() - 1));
+
+    // The Ethash seal of the same header is different.
+    EXPECT_FALSE(ethash::verify_header_rlp(*context, block_number, data, rlp.size()));
+}
+
+TEST(progpow, verify_batch)
+{
+    std::vector<ethash::verification_request> requests;
+    for (const auto& t : progpow_hash_test_cases)
+    {
+        if (ethash::get_epoch_number(t.block_number) > 1)
+            continue;
+
+        const auto header_hash = to_hash256(t.header_hash_hex);
+        const auto nonce = std::stoull(t.nonce_hex, nullptr, 16);
+        const auto mix_hash = to_hash256(t.mix_hash_hex);
+        const auto final_hash = to_hash256(t.final_hash_hex);
+        requests.push_back({t.block_number, header_hash, mix_hash, nonce, final_hash});
+
+        // The different mix hash makes the final hash check fail.
+        auto different_mix = mix_hash;
+        ++different_mix.bytes[7];
+        requests.push_back({t.block_number, header_hash, different_mix, nonce, final_hash});
+
+        // The different period gives a different mix hash.
+        requests.push_back({t.block_number + progpow::period_length, header_hash, mix_hash, nonce,
+            final_hash});
+    }
+    ASSERT_GT(requests.size(), 3 * 8);
+
+    const auto results = progpow::verify_batch(requests.data(), requests.size());
+    ASSERT_EQ(results.size(), requests.size());
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const auto& r = requests[i];
+        const auto epoch_number = ethash::get_epoch_number(r.block_number);
+        const auto& context = ethash::get_global_epoch_context(epoch_number);
+        EXPECT_EQ(results[i], progpow::verify(context, r.block_number, r.header_hash, r.mix_hash,
+                                  r.nonce, r.boundary))
+            << i;
+        if (i % 3 != 2)
+        {
+            EXPECT_EQ(results[i], i % 3 == 0) << i;
+        }
+    }
+}
+
+TEST(progpow, sync_pipeline)
+{
+    std::vector<ethash::verification_request> requests;
+    for (const int epoch_number : {0, 1})
+    {
+        const auto context = ethash::create_epoch_context(epoch_number);
+        for (int i = 0; i < 12; ++i)
+        {
+            const int block_number = epoch_number * ethash::epoch_length + i * 7;
+            const auto header_hash = to_hash256("ff");
+            const uint64_t nonce = static_cast<uint64_t>(i);
+            const auto r = progpow::hash(*context, block_number, header_hash, nonce);
+            requests.push_back({block_number, header_hash, r.mix_hash, nonce, r.final_hash});
+        }
+    }
+    ++requests[5].mix_hash.bytes[0];
+
+    ethash::sync_pipeline_options options;
+    options.progpow = true;
+    options.max_pending = 5;
+    ethash::sync_pipeline pipeline{options};
+
+    // Submit and take the results from the same thread.
+    size_t n = 0;
+    ethash::sync_result result;
+    for (const auto& request : requests)
+    {
+        while (!pipeline.try_push(request))
+        {
+            ASSERT_TRUE(pipeline.pop(result));
+            EXPECT_EQ(result.request.block_number, requests[n].block_number);
+            EXPECT_EQ(result.valid, n != 5) << n;
+            ++n;
+        }
+    }
+    pipeline.close();
+    while (pipeline.pop(result))
+    {
+        EXPECT_EQ(result.request.block_number, requests[n].block_number);
+        EXPECT_EQ(result.valid, n != 5) << n;
+        ++n;
+    }
+    EXPECT_EQ(n, requests.size());
+}
+
+TEST(progpow, verification_cache)
+{
+    auto& context = get_ethash_epoch_context_0();
+    ethash::verification_cache cache{64};
+
+    std::vector<ethash::verification_request> requests;
+    for (const auto& t : progpow_hash_test_cases)
+    {
+        if (ethash::get_epoch_number(t.block_number) != 0)
+            continue;
+
+        const auto header_hash = to_hash256(t.header_hash_hex);
+        const auto nonce = std::stoull(t.nonce_hex, nullptr, 16);
+        const auto mix_hash = to_hash256(t.mix_hash_hex);
+        const auto final_hash = to_hash256(t.final_hash_hex);
+        requests.push_back({t.block_number, header_hash, mix_hash, nonce, final_hash});
+
+        for (int i = 0; i < 2; ++i)
+        {
+            EXPECT_TRUE(cache.verify_progpow(
+                context, t.block_number, header_hash, mix_hash, nonce, final_hash));
+        }
+
+        // Other period.
+        EXPECT_EQ(cache.verify_progpow(context, t.block_number + progpow::period_length,
+                      header_hash, mix_hash, nonce, final_hash),
+            progpow::verify(context, t.block_number + progpow::period_length, header_hash,
+                mix_hash, nonce, final_hash));
+    }
+    const auto num_seals = requests.size();
+    ASSERT_GT(num_seals, 0);
+    EXPECT_EQ(cache.get_stats().hits, num_seals);
+
+    // The Ethash outcomes are separate.
+    const auto& r = requests[0];
+    EXPECT_FALSE(cache.verify(context, r.header_hash, r.mix_hash, r.nonce, r.boundary));
+
+    const auto results = cache.verify_batch_progpow(requests.data(), requests.size());
+    EXPECT_EQ(std::count(results.begin(), results.end(), true), num_seals);
+    EXPECT_EQ(cache.get_stats().hits, 2 * num_seals);
+}
+
 TEST(progpow, search)
 {
     auto ctxp = ethash::create_epoch_context_full(0);
@@ -135,6 +497,269 @@ TEST(progpow, search)
     EXPECT_EQ(sr.mix_hash, r.mix_hash);
 }
 
+TEST(progpow, search_parallel)
+{
+    auto ctxp = ethash::create_epoch_context_full(0);
+    ASSERT_NE(ctxp.get(), nullptr);
+    auto& ctx = *ctxp;
+    auto& ctxl = reinterpret_cast<const ethash::epoch_context&>(ctx);
+
+    constexpr size_t iterations = 40;
+    auto boundary = to_hash256("00ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    auto r = progpow::search_parallel(ctx, 0, {}, {}, 0, iterations, 4);
+    EXPECT_FALSE(r.solution.solution_found);
+    uint64_t num_hashes = 0;
+    for (const auto count : r.hash_counts)
+        num_hashes += count;
+    EXPECT_EQ(num_hashes, iterations);
+
+    r = progpow::search_parallel(ctx, 0, {}, boundary, 0, iterations, 4);
+    ASSERT_TRUE(r.solution.solution_found);
+    auto expected = progpow::hash(ctx, 0, {}, r.solution.nonce);
+    EXPECT_EQ(r.solution.final_hash, expected.final_hash);
+    EXPECT_EQ(r.solution.mix_hash, expected.mix_hash);
+
+    r = progpow::search_light_parallel(ctxl, 0, {}, boundary, 0, iterations, 4);
+    ASSERT_TRUE(r.solution.solution_found);
+    expected = progpow::hash(ctxl, 0, {}, r.solution.nonce);
+    EXPECT_EQ(r.solution.final_hash, expected.final_hash);
+    EXPECT_EQ(r.solution.mix_hash, expected.mix_hash);
+}
+
+TEST(progpow, search_preemptible)
+{
+    auto ctxp = ethash::create_epoch_context_full(0);
+    ASSERT_NE(ctxp.get(), nullptr);
+    auto& ctx = *ctxp;
+    auto& ctxl = reinterpret_cast<const ethash::epoch_context&>(ctx);
+
+    constexpr uint64_t expected_nonce = 11;
+    auto boundary = to_hash256("00ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    std::atomic<uint64_t> generation{1};
+
+    auto r = progpow::search_preemptible(ctx, 0, {}, boundary, 0, 10, generation, 1);
+    EXPECT_EQ(r.status, ethash::search_status::exhausted);
+    EXPECT_EQ(r.num_hashes, 10);
+
+    r = progpow::search_preemptible(ctx, 0, {}, boundary, 10, 10, generation, 1);
+    EXPECT_EQ(r.status, ethash::search_status::solution_found);
+    EXPECT_EQ(r.solution.nonce, expected_nonce);
+    EXPECT_EQ(r.num_hashes, 2);
+
+    r = progpow::search_light_preemptible(ctxl, 0, {}, boundary, 10, 10, generation, 1);
+    EXPECT_EQ(r.status, ethash::search_status::solution_found);
+    EXPECT_EQ(r.solution.nonce, expected_nonce);
+    EXPECT_EQ(r.num_hashes, 2);
+
+    generation = 2;
+    r = progpow::search_preemptible(ctx, 0, {}, boundary, 10, 10, generation, 1);
+    EXPECT_EQ(r.status, ethash::search_status::preempted);
+    EXPECT_EQ(r.num_hashes, 0);
+    r = progpow::search_light_preemptible(ctxl, 0, {}, boundary, 10, 10, generation, 1);
+    EXPECT_EQ(r.status, ethash::search_status::preempted);
+    EXPECT_EQ(r.num_hashes, 0);
+}
+
+TEST(progpow, search_shares)
+{
+    auto ctxp = ethash::create_epoch_context_full(0);
+    ASSERT_NE(ctxp.get(), nullptr);
+    auto& ctx = *ctxp;
+    auto& ctxl = reinterpret_cast<const ethash::epoch_context&>(ctx);
+
+    constexpr size_t iterations = 40;
+    auto share_boundary =
+        to_hash256("1fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    auto block_boundary =
+        to_hash256("00ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    std::vector<ethash::share> expected;
+    for (uint64_t nonce = 0; nonce < iterations; ++nonce)
+    {
+        const auto r = progpow::hash(ctx, 0, {}, nonce);
+        if (ethash::is_less_or_equal(r.final_hash, share_boundary))
+        {
+            expected.push_back({nonce, r.final_hash, r.mix_hash,
+                ethash::is_less_or_equal(r.final_hash, block_boundary)});
+        }
+    }
+    ASSERT_FALSE(expected.empty());
+
+    ethash::share shares[iterations];
+    auto n = progpow::search_shares(
+        ctx, 0, {}, share_boundary, block_boundary, 0, iterations, shares, iterations);
+    ASSERT_EQ(n, expected.size());
+    for (size_t i = 0; i < n; ++i)
+    {
+        EXPECT_EQ(shares[i].nonce, expected[i].nonce);
+        EXPECT_EQ(shares[i].final_hash, expected[i].final_hash);
+        EXPECT_EQ(shares[i].block_solution, expected[i].block_solution);
+    }
+
+    // The nonce 11 is the first block solution, see the progpow.search test.
+    const auto it = std::find_if(shares, shares + n,
+        [](const ethash::share& sh) noexcept { return sh.block_solution; });
+    ASSERT_NE(it, shares + n);
+    EXPECT_EQ(it->nonce, 11);
+
+    n = progpow::search_light_shares(
+        ctxl, 0, {}, share_boundary, block_boundary, 0, iterations, shares, 1);
+    ASSERT_EQ(n, 1);
+    EXPECT_EQ(shares[0].nonce, expected[0].nonce);
+    EXPECT_EQ(shares[0].mix_hash, expected[0].mix_hash);
+}
+
+TEST(progpow, search_shares_instruction_sets)
+{
+    using ethash::instruction_set;
+
+    // The interleaved search hashes the nonces in batches of 8, then the remaining ones alone.
+    auto ctxp = ethash::create_epoch_context_full(0);
+    ASSERT_NE(ctxp.get(), nullptr);
+    auto& ctx = *ctxp;
+    const instruction_set selected = ethash::get_instruction_set();
+
+    constexpr int block_number = 120;
+    constexpr uint64_t start_nonce = 5;
+    constexpr size_t iterations = 21;
+    const auto header_hash =
+        to_hash256("ffeeddccbbaa9988776655443322110000112233445566778899aabbccddeeff");
+    const auto share_boundary =
+        to_hash256("3fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    const auto block_boundary =
+        to_hash256("1fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    std::vector<ethash::share> expected;
+    ethash::set_instruction_set(instruction_set::generic);
+    for (uint64_t nonce = start_nonce; nonce < start_nonce + iterations; ++nonce)
+    {
+        const auto r = progpow::hash(ctx, block_number, header_hash, nonce);
+        if (ethash::is_less_or_equal(r.final_hash, share_boundary))
+        {
+            expected.push_back({nonce, r.final_hash, r.mix_hash,
+                ethash::is_less_or_equal(r.final_hash, block_boundary)});
+        }
+    }
+    ASSERT_GE(expected.size(), 2);
+
+    for (const auto set : {instruction_set::generic, instruction_set::x86_64_v2,
+             instruction_set::x86_64_v3, instruction_set::x86_64_v4})
+    {
+        if (!ethash::set_instruction_set(set))
+            continue;
+
+        ethash::share shares[iterations];
+        auto n = progpow::search_shares(ctx, block_number, header_hash, share_boundary,
+            block_boundary, start_nonce, iterations, shares, iterations);
+        ASSERT_EQ(n, expected.size()) << int(set);
+        for (size_t i = 0; i < n; ++i)
+        {
+            EXPECT_EQ(shares[i].nonce, expected[i].nonce) << int(set);
+            EXPECT_EQ(to_hex(shares[i].final_hash), to_hex(expected[i].final_hash)) << int(set);
+            EXPECT_EQ(to_hex(shares[i].mix_hash), to_hex(expected[i].mix_hash)) << int(set);
+            EXPECT_EQ(shares[i].block_solution, expected[i].block_solution) << int(set);
+        }
+
+        // The search stops at the output capacity in the middle of a batch.
+        n = progpow::search_shares(ctx, block_number, header_hash, share_boundary,
+            block_boundary, start_nonce, iterations, shares, 1);
+        ASSERT_EQ(n, 1);
+        EXPECT_EQ(shares[0].nonce, expected[0].nonce);
+
+        const auto sr = progpow::search(
+            ctx, block_number, header_hash, share_boundary, start_nonce, iterations);
+        EXPECT_EQ(sr.nonce, expected[0].nonce) << int(set);
+        EXPECT_EQ(to_hex(sr.mix_hash), to_hex(expected[0].mix_hash)) << int(set);
+    }
+
+    ethash::set_instruction_set(selected);
+}
+
+TEST(progpow, c_api)
+{
+    auto ctxp = ethash::create_epoch_context_full(0);
+    ASSERT_NE(ctxp.get(), nullptr);
+    auto* ctx = ctxp.get();
+    auto* ctxl = reinterpret_cast<const ethash::epoch_context*>(ctx);
+
+    // The light batch is longer than the internal chunk.
+    // The runs of 9 blocks of the same period are hashed in lock-step in the full batch.
+    constexpr size_t num_hashes = 67;
+    int block_numbers[num_hashes];
+    ethash::hash256 header_hashes[num_hashes];
+    uint64_t nonces[num_hashes];
+    for (size_t i = 0; i < num_hashes; ++i)
+    {
+        block_numbers[i] = static_cast<int>((i / 9) * 401);
+        header_hashes[i] = ethash::keccak256(reinterpret_cast<const uint8_t*>(&i), sizeof(i));
+        nonces[i] = i * 7919;
+    }
+
+    ethash_result results[num_hashes];
+    ethash_result full_results[num_hashes];
+    ethash_progpow_hash_batch(ctxl, block_numbers, header_hashes, nonces, num_hashes, results);
+    ethash_progpow_hash_full_batch(
+        ctx, block_numbers, header_hashes, nonces, num_hashes, full_results);
+    for (size_t i = 0; i < num_hashes; ++i)
+    {
+        const auto r = progpow::hash(*ctxl, block_numbers[i], header_hashes[i], nonces[i]);
+        EXPECT_EQ(results[i].final_hash, r.final_hash) << i;
+        EXPECT_EQ(results[i].mix_hash, r.mix_hash) << i;
+        EXPECT_EQ(full_results[i].mix_hash, r.mix_hash) << i;
+
+        const auto c = ethash_progpow_hash(ctxl, block_numbers[i], &header_hashes[i], nonces[i]);
+        EXPECT_EQ(c.mix_hash, r.mix_hash) << i;
+        EXPECT_TRUE(ethash_progpow_verify(ctxl, block_numbers[i], &header_hashes[i], &r.mix_hash,
+            nonces[i], &r.final_hash));
+    }
+
+    const auto r = ethash_progpow_hash_full(ctx, block_numbers[1], &header_hashes[1], nonces[1]);
+    EXPECT_EQ(r.mix_hash, results[1].mix_hash);
+    const auto difficulty =
+        to_hash256("0000000000000000000000000000000000000000000000000000000000000001");
+    EXPECT_TRUE(ethash_progpow_verify_against_difficulty(
+        ctxl, block_numbers[1], &header_hashes[1], &r.mix_hash, nonces[1], &difficulty));
+
+    // The nonce 11 is the first block solution, see the progpow.search test.
+    const ethash::hash256 header_hash{};
+    const auto boundary =
+        to_hash256("00ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    const auto expected = progpow::search(*ctx, 0, header_hash, boundary, 0, 20);
+    ASSERT_TRUE(expected.solution_found);
+
+    ethash_search_result solution;
+    ethash_progpow_search(ctx, 0, &header_hash, &boundary, 0, 20, &solution);
+    EXPECT_TRUE(solution.solution_found);
+    EXPECT_EQ(solution.nonce, expected.nonce);
+    EXPECT_EQ(solution.final_hash, expected.final_hash);
+    EXPECT_EQ(solution.mix_hash, expected.mix_hash);
+
+    ethash_progpow_search_light(ctxl, 0, &header_hash, &boundary, 0, 20, &solution);
+    EXPECT_TRUE(solution.solution_found);
+    EXPECT_EQ(solution.nonce, expected.nonce);
+
+    ethash_progpow_search_light(ctxl, 0, &header_hash, &boundary, 0, 10, &solution);
+    EXPECT_FALSE(solution.solution_found);
+
+    ethash_share shares[20];
+    const size_t n = ethash_progpow_search_shares(
+        ctx, 0, &header_hash, &boundary, &boundary, 0, 20, shares, 20);
+    ASSERT_GT(n, 0);
+    EXPECT_EQ(shares[0].nonce, expected.nonce);
+    EXPECT_TRUE(shares[0].block_solution);
+
+    // The batch verification uses the global contexts.
+    const ethash_verification_request requests[] = {
+        {block_numbers[2], header_hashes[2], results[2].mix_hash, nonces[2], results[2].final_hash},
+        {block_numbers[2], header_hashes[2], results[3].mix_hash, nonces[2], results[2].final_hash},
+    };
+    bool valid[2] = {};
+    EXPECT_TRUE(ethash_progpow_verify_batch(requests, 2, valid));
+    EXPECT_TRUE(valid[0]);
+    EXPECT_FALSE(valid[1]);
+}
+
 #if ETHASH_TEST_GENERATION
 TEST(progpow, generate_hash_test_cases)
 {
@@ -0,0 +1,109 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include "helpers.hpp"
+
+#include <ethash/sync_pipeline.hpp>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace ethash;
+
+TEST(sync_pipeline_multithreaded, epochs)
+{
+    // The seals of 3 epochs with some invalid ones, then the first epoch again.
+    std::vector<verification_request> requests;
+    std::vector<bool> expected;
+    for (const int epoch_number : {0, 1, 2})
+    {
+        const auto context = create_epoch_context(epoch_number);
+        for (int i = 0; i < 20; ++i)
+        {
+            const int block_number = epoch_number * epoch_length + i;
+            const auto header_hash = keccak256(reinterpret_cast<const uint8_t*>(&block_number),
+                sizeof(block_number));
+            const uint64_t nonce = static_cast<uint64_t>(i);
+            const auto r = hash(*context, header_hash, nonce);
+            verification_request request{block_number, header_hash, r.mix_hash, nonce, r.final_hash};
+            if (i % 3 == 1)
+                ++request.mix_hash.bytes[0];
+            if (i % 5 == 2)
+                request.boundary = {};
+            requests.push_back(request);
+            expected.push_back(i % 3 != 1 && i % 5 != 2);
+        }
+    }
+    requests.push_back(requests[0]);
+    expected.push_back(expected[0]);
+    requests.push_back({-1, requests[0].header_hash, requests[0].mix_hash, 0, requests[0].boundary});
+    expected.push_back(false);
+
+    sync_pipeline_options options;
+    options.max_resident_contexts = 2;
+    options.num_verify_threads = 4;
+    options.max_pending = 16;
+    sync_pipeline pipeline{options};
+
+    std::thread producer{[&] {
+        for (const auto& request : requests)
+            pipeline.push(request);
+        pipeline.close();
+    }};
+
+    size_t n = 0;
+    sync_result result;
+    while (pipeline.pop(result))
+    {
+        ASSERT_LT(n, requests.size());
+        EXPECT_EQ(result.request.block_number, requests[n].block_number);
+        EXPECT_EQ(result.request.mix_hash, requests[n].mix_hash);
+        EXPECT_EQ(result.valid, expected[n]) << n;
+        EXPECT_FALSE(result.error) << n;
+        ++n;
+    }
+    producer.join();
+    EXPECT_EQ(n, requests.size());
+
+    const auto stats = pipeline.get_stats();
+    EXPECT_EQ(stats.contexts_built, 4);
+    EXPECT_EQ(stats.peak_resident_contexts, 2);
+}
+
+#if !__APPLE__
+// The Out-Of-Memory tests are disabled on macOS, see test_ethash.cpp.
+TEST(sync_pipeline, context_oom)
+{
+    // The light cache of the epoch does not fit in the memory limit.
+    static constexpr int epoch = sizeof(void*) == 8 ? 30000 : 10000;
+    hash256 boundary;
+    std::memset(boundary.bytes, 0xff, sizeof(boundary));
+    const verification_request request{epoch * epoch_length, {}, {}, 0, boundary};
+
+    sync_pipeline_options options;
+    options.num_verify_threads = 1;
+
+    sync_result result{};
+    ASSERT_TRUE(set_memory_limit(1024 * 1024 * 1024));
+    {
+        sync_pipeline pipeline{options};
+        pipeline.push(request);
+        pipeline.push(request);
+        pipeline.close();
+
+        for (int i = 0; i < 2; ++i)
+        {
+            ASSERT_TRUE(pipeline.pop(result));
+            EXPECT_FALSE(result.valid);
+            EXPECT_TRUE(result.error);
+        }
+        EXPECT_FALSE(pipeline.pop(result));
+        EXPECT_EQ(pipeline.get_stats().contexts_built, 0);
+        EXPECT_EQ(pipeline.get_stats().build_failures, 1);
+    }
+    ASSERT_TRUE(restore_memory_limit());
+}
+#endif
@@ -0,0 +1,36 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include <ethash/thread_pool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <future>
+
+using namespace ethash;
+
+TEST(thread_pool, concurrent_and_nested_runs)
+{
+    thread_pool pool{4};
+
+    // The concurrent jobs share the pool threads, the nested ones are executed
+    // by the tasks calling run() if the pool threads are busy.
+    constexpr unsigned num_jobs = 4;
+    std::array<std::atomic<unsigned>, num_jobs> sums{};
+    std::array<std::future<void>, num_jobs> futures;
+    for (unsigned j = 0; j < num_jobs; ++j)
+    {
+        futures[j] = std::async(std::launch::async, [&pool, &sums, j] {
+            pool.run(8, [&pool, &sums, j](unsigned i) noexcept {
+                pool.run(4, [&sums, i, j](unsigned k) noexcept { sums[j] += i * 4 + k; });
+            });
+        });
+    }
+    for (auto& f : futures)
+        f.wait();
+    for (const auto& sum : sums)
+        EXPECT_EQ(sum, 31 * 32 / 2);
+}
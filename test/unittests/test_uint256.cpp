@@ -0,0 +1,64 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include <ethash/ethash-internal.hpp>
+#include <ethash/keccak.hpp>
+#include <ethash/uint256.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace ethash;
+
+TEST(ethash, divide_uint256)
+{
+    // Check q * v + r == u and r < v for pseudo-random numbers of different lengths.
+    hash256 h = {};
+    for (int i = 0; i < 1000; ++i)
+    {
+        h = keccak256(h.bytes, sizeof(h));
+        uint256 u = uint256_from_be(h);
+        h = keccak256(h.bytes, sizeof(h));
+        uint256 v = uint256_from_be(h);
+        for (int j = 0; j < (i % 4); ++j)
+            u.words[3 - j] = 0;
+        for (int j = 0; j < ((i / 4) % 4); ++j)
+            v.words[3 - j] = 0;
+        if (i % 3 == 0)
+            v.words[0] = 0;
+        if (i % 7 == 0)
+            v.words[0] = 1;
+        if (is_zero(v))
+            continue;
+
+        const auto result = udivrem(u, v);
+
+        uint256 x{};
+        for (size_t k = 0; k < 4; ++k)
+        {
+            uint64_t carry = 0;
+            for (size_t l = 0; k + l < 4; ++l)
+            {
+                uint64_t hi;
+                uint64_t lo = umul(result.quot.words[k], v.words[l], hi);
+                lo += carry;
+                hi += lo < carry;
+                x.words[k + l] += lo;
+                carry = hi + (x.words[k + l] < lo);
+            }
+        }
+        uint64_t carry = 0;
+        for (size_t k = 0; k < 4; ++k)
+        {
+            const uint64_t s = x.words[k] + carry;
+            carry = s < carry;
+            x.words[k] = s + result.rem.words[k];
+            carry += x.words[k] < s;
+        }
+
+        EXPECT_TRUE(is_equal(uint256_to_be(x), uint256_to_be(u))) << i;
+        EXPECT_TRUE(is_less_or_equal(uint256_to_be(result.rem), uint256_to_be(v)) &&
+                    !is_equal(uint256_to_be(result.rem), uint256_to_be(v)))
+            << i;
+    }
+}
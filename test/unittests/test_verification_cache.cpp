@@ -0,0 +1,90 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include "helpers.hpp"
+
+#include <ethash/verification_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace ethash;
+
+TEST(ethash, verification_cache)
+{
+    const auto& context = get_ethash_epoch_context_0();
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const hash256 max_boundary =
+        to_hash256("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    verification_cache cache{4};
+
+    std::vector<verification_request> requests;
+    for (uint64_t nonce = 0; nonce < 10; ++nonce)
+    {
+        const result r = hash(context, header_hash, nonce);
+        requests.push_back({0, header_hash, r.mix_hash, nonce, r.final_hash});
+        EXPECT_TRUE(cache.verify(context, header_hash, r.mix_hash, nonce, r.final_hash));
+    }
+    EXPECT_EQ(cache.get_stats().misses, 10);
+    EXPECT_EQ(cache.get_stats().hits, 0);
+    EXPECT_EQ(cache.size(), 4);
+
+    // The final hash is checked against the boundary also for the cached outcome.
+    const auto& last = requests.back();
+    EXPECT_TRUE(cache.verify(context, header_hash, last.mix_hash, last.nonce, last.boundary));
+    EXPECT_EQ(cache.get_stats().hits, 1);
+    hash256 lower_boundary = last.boundary;
+    --lower_boundary.bytes[31];
+    EXPECT_FALSE(cache.verify(context, header_hash, last.mix_hash, last.nonce, lower_boundary));
+    EXPECT_EQ(cache.get_stats().hits, 1);
+
+    // The invalid outcomes are cached as well.
+    EXPECT_FALSE(cache.verify(context, header_hash, last.mix_hash, last.nonce + 1, max_boundary));
+    EXPECT_FALSE(cache.verify(context, header_hash, last.mix_hash, last.nonce + 1, max_boundary));
+    EXPECT_EQ(cache.get_stats().misses, 11);
+    EXPECT_EQ(cache.get_stats().hits, 2);
+
+    // The batch with duplicates and invalid seals.
+    requests.push_back(requests[0]);
+    requests.push_back({0, header_hash, last.mix_hash, last.nonce + 1, max_boundary});
+    requests.push_back({0, header_hash, last.mix_hash, last.nonce, lower_boundary});
+    const auto expected = verify_batch(requests.data(), requests.size());
+    const auto results = cache.verify_batch(requests.data(), requests.size());
+    EXPECT_EQ(results, expected);
+    EXPECT_EQ(std::count(results.begin(), results.end(), true), 11);
+    EXPECT_LE(cache.size(), 4);
+}
+
+TEST(ethash_multithreaded, verification_cache)
+{
+    const auto& context = get_ethash_epoch_context_0();
+    const hash256 header_hash =
+        to_hash256("e74e5e8688d3c6f17885fa5e64eb6718046b57895a2a24c593593070ab71f5fd");
+    const result r = hash(context, header_hash, 1);
+
+    // Concurrent verifications of the same seal compute the outcome once.
+    verification_cache cache{100};
+    constexpr size_t num_threads = 8;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> num_valid{0};
+    for (size_t i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back([&] {
+            if (cache.verify(context, header_hash, r.mix_hash, 1, r.final_hash))
+                ++num_valid;
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    EXPECT_EQ(num_valid, num_threads);
+    EXPECT_EQ(cache.get_stats().misses, 1);
+    EXPECT_EQ(cache.get_stats().hits, num_threads - 1);
+}